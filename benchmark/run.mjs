@@ -25,7 +25,9 @@ const OPERATIONS = [
   [null, "Generate + Get Sites", "sites", null],
   ["voronoi-edges", "Generate + Render Edges", "edges", "Voronoi diagram"],
   ["delaunay-edges", "Generate + Get Delaunay", "delaunay", "Delaunay diagram"],
+  ["delaunay-triangles", "Generate + Triangulate", "triangulate", "Delaunay triangulation"],
 ];
+const SCALED_OPERATIONS = new Set(["delaunay", "triangulate"]);
 const LIBRARIES = [
   ["JCV 0.11", "#5267d9"],
   ["d3-delaunay", "#14a38b"],
@@ -85,6 +87,7 @@ function prepareJcv(voronoi, points, bounds) {
       return checksum;
     }),
     delaunay: () => voronoi.delaunayEdges(points, { bounds }).length / 4,
+    triangulate: () => voronoi.triangulate(points, { bounds }).triangles.length / 3,
   };
 }
 
@@ -141,9 +144,8 @@ function niceMaximum(value) {
 }
 
 function chart(operationTitle, operationKey, results) {
-  const chartLibraries = operationKey === "delaunay"
-    ? LIBRARIES.filter(([library]) => library !== "gorhill/voronoi")
-    : LIBRARIES;
+  const chartLibraries = LIBRARIES.filter(([library]) =>
+    Object.values(results).some((result) => result[operationKey][library] != null));
   const width = 1200;
   const height = 720;
   const left = 120;
@@ -154,7 +156,7 @@ function chart(operationTitle, operationKey, results) {
   const measuredMaximum = Math.max(...Object.values(results).flatMap((result) =>
     chartLibraries.map(([library]) => result[operationKey][library]).filter(Number.isFinite),
   ));
-  const maximum = operationKey === "delaunay"
+  const maximum = SCALED_OPERATIONS.has(operationKey)
     ? niceMaximum(measuredMaximum * 1.1)
     : 500;
   const caseWidth = (width - left - right) / CASES.length;
@@ -162,9 +164,11 @@ function chart(operationTitle, operationKey, results) {
   const barGap = 8;
   const groupWidth = chartLibraries.length * barWidth + (chartLibraries.length - 1) * barGap;
   const lines = [];
-  const subtitle = operationKey === "edges" || operationKey === "delaunay"
-    ? "Diagram generation + complete edge retrieval · median time · lower is better"
-    : "Median time · linear scale · lower is better";
+  const subtitle = operationKey === "triangulate"
+    ? "Triangulation + triangles, halfedges and hull retrieval · median time · lower is better"
+    : operationKey === "edges" || operationKey === "delaunay"
+      ? "Diagram generation + complete edge retrieval · median time · lower is better"
+      : "Median time · linear scale · lower is better";
 
   lines.push(`<svg xmlns="http://www.w3.org/2000/svg" width="${width}" height="${height}" viewBox="0 0 ${width} ${height}" role="img" aria-labelledby="title desc">`);
   lines.push(`  <title id="title">${escapeXml(operationTitle)}</title>`);
@@ -362,7 +366,7 @@ function markdown(results, memoryResults, workerMemoryResults, codeSizes) {
     "",
     "The random cases use a deterministic seed. `100k pathological` is the issue48 input with 99,998 symmetric diagonal-pair sites. Each measurement has two untimed warmups followed by 10 samples for 10k and five samples for 100k and the pathological case.",
     "",
-    "JCV copies one packed result from WebAssembly into a JavaScript-owned `ArrayBuffer` and disposes each result inside the timed operation. Site access materializes ergonomic `Site` objects; edge rendering reads packed vertex arrays without creating edge objects. The Delaunay row instead uses JCV's adjacency-only generator and returns every edge as flat coordinates, without constructing a Voronoi diagram. Other libraries expose different public output forms: d3-voronoi and voronoi eagerly provide arrays, while d3-delaunay renders its Voronoi mesh. These rows therefore compare public access workflows, not identical post-processing algorithms.",
+    "JCV copies one packed result from WebAssembly into a JavaScript-owned `ArrayBuffer` and disposes each result inside the timed operation. Site access materializes ergonomic `Site` objects; edge rendering reads packed vertex arrays without creating edge objects. The Delaunay row instead uses JCV's adjacency-only generator and returns every edge as flat coordinates, without constructing a Voronoi diagram. The triangulation row returns delaunator-style `triangles`, `halfedges`, and `hull` arrays and is compared against d3-delaunay, which exposes the same arrays from its delaunator triangulation. Other libraries expose different public output forms: d3-voronoi and voronoi eagerly provide arrays, while d3-delaunay renders its Voronoi mesh. These rows therefore compare public access workflows, not identical post-processing algorithms.",
     "",
   ];
 
@@ -425,7 +429,7 @@ function markdown(results, memoryResults, workerMemoryResults, codeSizes) {
     "- Wasm compiled with Emscripten `-O3 -flto`",
     "- d3-delaunay 6.0.4, d3-voronoi 1.1.4, gorhill/voronoi 1.0.0",
     "",
-    "The `gorhill/voronoi` package has no direct Delaunay retrieval operation, so that entry is not applicable.",
+    "The `gorhill/voronoi` package has no direct Delaunay retrieval operation, so that entry is not applicable. Only d3-delaunay provides delaunator-style triangulation arrays, so the triangulation row compares JCV against it alone.",
     "",
     "<!-- wasm-benchmarks:end -->",
   );
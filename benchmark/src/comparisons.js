@@ -20,6 +20,10 @@ function d3Delaunay(points, bounds) {
       const delaunay = generateDelaunay();
       return delaunay.triangles.length / 3;
     },
+    triangulate() {
+      // The constructor already builds the triangles, halfedges and hull arrays.
+      return generateDelaunay().triangles.length / 3;
+    },
   };
 }
 
@@ -38,6 +42,7 @@ function d3Voronoi(points, [minX, minY, maxX, maxY]) {
     delaunay() {
       return generate().triangles().length;
     },
+    triangulate: null,
   };
 }
 
@@ -54,6 +59,7 @@ function raymondHill(points, [minX, minY, maxX, maxY]) {
       return generate().edges.length;
     },
     delaunay: null,
+    triangulate: null,
   };
 }
 
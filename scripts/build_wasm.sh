@@ -15,7 +15,7 @@ emcc wasm/voronoi_wasm.c \
   -sENVIRONMENT=web,worker,node \
   -sFILESYSTEM=0 \
   -sALLOW_MEMORY_GROWTH=1 \
-  -sEXPORTED_FUNCTIONS='["_jcv_wasm_generate_packed","_jcv_voronoi_edges","_jcv_delaunay_edges","_malloc","_free"]' \
+  -sEXPORTED_FUNCTIONS='["_jcv_wasm_generate_packed","_jcv_voronoi_edges","_jcv_delaunay_edges","_jcv_delaunay_triangles","_malloc","_free"]' \
   -sEXPORTED_RUNTIME_METHODS='["HEAPU8","HEAP32","HEAPF32"]' \
   -o "${OUTPUT_DIR}/jc_voronoi.js"
 
@@ -33,6 +33,11 @@ extern "C" {
     #define JCV_SQRT(_X_)       sqrtf(_X_)
 #endif
 
+#ifndef JCV_FMA
+    // The double precision fused multiply-add of the exact predicates and vertices
+    #define JCV_FMA(_A_, _B_, _C_) fma(_A_, _B_, _C_)
+#endif
+
 #ifndef JCV_PI
     #define JCV_PI 3.14159265358979323846264338327950288f
 #endif
@@ -41,11 +46,23 @@ extern "C" {
     #define JCV_FLT_MAX 3.402823466e+38F
 #endif
 
-#ifndef JCV_EDGE_INTERSECT_THRESHOLD
-    // Fix for Issue #40
-    #define JCV_EDGE_INTERSECT_THRESHOLD 1.0e-10F
+// Define JCV_PARALLEL_FOR(_COUNT_, _FN_, _CTX_) to let the generation run independent tasks on several threads.
+// It must call _FN_(_CTX_, i) (a jcv_parallel_task_fn) once for each i in [0, _COUNT_), in any order and on any
+// threads, and return when all calls have returned. Or define JCV_USE_PTHREADS to use a built-in POSIX threads version.
+#if defined(JCV_USE_PTHREADS) && !defined(JCV_PARALLEL_FOR)
+    #define JCV_PARALLEL_FOR(_COUNT_, _FN_, _CTX_) jcv_pthread_parallel_for(_COUNT_, _FN_, _CTX_)
+#endif
+
+// Define JCV_USE_MIXED_PRECISION to keep the jcv_real (e.g. float) sites, edges and vertices, while the sweep
+// computes the vertices and the order of its circle events in double precision.
+
+#ifndef JCV_PARALLEL_MIN_SITES
+    // Fewer sites than this are sorted on the calling thread
+    #define JCV_PARALLEL_MIN_SITES 65536
 #endif
 
+typedef void (*jcv_parallel_task_fn)(void* ctx, int index);
+
 typedef JCV_REAL_TYPE jcv_real;
 
 typedef struct jcv_point_           jcv_point;
@@ -58,11 +75,15 @@ typedef struct jcv_delaunay_iter_   jcv_delaunay_iter;
 typedef struct jcv_diagram_         jcv_diagram;
 typedef struct jcv_clipper_         jcv_clipper;
 typedef struct jcv_context_internal_ jcv_context_internal;
+typedef struct jcv_site_locator_    jcv_site_locator;
 
 typedef enum jcv_diagram_option_
 {
     JCV_OPTION_NONE = 0,
-    JCV_OPTION_DELAUNAY_ONLY = 1 << 0
+    JCV_OPTION_DELAUNAY_ONLY = 1 << 0,
+    JCV_OPTION_LAZY_CELLS = 1 << 1,
+    JCV_OPTION_EXACT_VERTICES = 1 << 2,
+    JCV_OPTION_NORMALIZE = 1 << 3
 } jcv_diagram_option;
 
 /// Tests if a point is inside the final shape
@@ -93,6 +114,57 @@ extern void jcv_diagram_generate( int num_points, const jcv_point* points, const
  */
 extern void jcv_delaunay_generate( int num_points, const jcv_point* points, const jcv_rect* rect, const jcv_clipper* clipper, jcv_diagram* diagram );
 
+/** Like jcv_diagram_generate, but a site's ordered and gap filled cell is only built (and then kept) the first time
+ * it's needed, e.g. by jcv_site_get_edges. After the sweep, only the clipped edges and an index of each site's
+ * edges are built. The edges along the clipping boundary, and their vertices, are added as their cells are built,
+ * so use jcv_get_num_vertices and jcv_diagram_get_edge_count rather than diagram->numvertices.
+ * Building a cell modifies the diagram, so a lazy diagram can't be queried from several threads at once.
+ */
+extern void jcv_diagram_generate_lazy( int num_points, const jcv_point* points, const jcv_rect* rect, const jcv_clipper* clipper, jcv_diagram* diagram );
+
+/** Generates a power diagram (a weighted Voronoi diagram, also known as a Laguerre diagram).
+ * weights has one value per input point. The cell of a site holds the points p where
+ * |p - site|^2 - weight is the smallest, so a cell may be empty, and needn't contain its site.
+ * Of several points with the same position, the largest weight is used.
+ * The clipper is used like in jcv_diagram_generate: its test_fn rejects the sites and vertices outside
+ * of the shape, and its clip_fn and fill_fn clip the edges and close the cells.
+ */
+extern void jcv_diagram_generate_weighted( int num_points, const jcv_point* points, const jcv_real* weights, const jcv_rect* rect, const jcv_clipper* clipper, jcv_diagram* diagram );
+
+/** Generates a periodic diagram, where the rect wraps around (a torus), e.g. for tiling textures.
+ * The points are wrapped into the rect. Only the sites near the rect's sides are copied across it,
+ * so the cost stays close to that of the rect alone.
+ * Each cell is complete, and may extend past the rect's sides. An edge crossing a side has a copy
+ * of the wrapped neighbour as its other site (same index, position shifted by the rect's size).
+ * jcv_diagram_get_sites only returns the sites inside the rect, the edge list has each edge once,
+ * and the vertices are shared across the wrap (jcv_diagram_get_vertices wraps them into the rect).
+ * The rect is the period. Without it (or if it is empty), a regular diagram is generated.
+ */
+extern void jcv_diagram_generate_periodic( int num_points, const jcv_point* points, const jcv_rect* rect, jcv_diagram* diagram );
+
+// Same as jcv_diagram_generate, but reads point i from (const char*)points + i * stride, e.g. a jcv_point
+// member of the first struct in an array of structs, with the struct size as the stride. No copy of the input is made.
+extern void jcv_diagram_generate_strided( int num_points, const jcv_point* points, size_t stride, const jcv_rect* rect, const jcv_clipper* clipper, jcv_diagram* diagram );
+
+// Same as jcv_diagram_generate, but reads the coordinates from separate x and y arrays
+extern void jcv_diagram_generate_soa( int num_points, const jcv_real* x, const jcv_real* y, const jcv_rect* rect, const jcv_clipper* clipper, jcv_diagram* diagram );
+
+/** Generates the diagram of integer sites, with points holding x0,y0,x1,y1,...
+ * The circle events use the exact circumcentre of their sites, rounded to the nearest double (halfway cases upwards)
+ * and then to jcv_real, so sites on the same circle share one vertex and the sweep gives the same diagram on every platform.
+ * Ties are broken the same way every time: sites are swept in order of y, then x, duplicate points keep one site
+ * (see jcv_diagram_get_input_sources), and a site on a breakpoint goes to the arc left of it.
+ * The float build rounds coordinates beyond +-2^24, the double build holds every int32 exactly.
+ */
+extern void jcv_diagram_generate_int( int num_points, const int32_t* points, const jcv_rect* rect, const jcv_clipper* clipper, jcv_diagram* diagram );
+
+/** Same as jcv_diagram_generate (with the box clipper), for sites with a large magnitude, e.g. projected geodata.
+ * The sites are swept relative to the centre of their bounds, scaled by a power of two into [-1, 1], and the
+ * sites, edges and vertices are then mapped back. The vertices are then within about one ulp of their
+ * coordinates, instead of losing the precision of the (much larger) coordinates in every computation.
+ */
+extern void jcv_diagram_generate_normalized( int num_points, const jcv_point* points, const jcv_rect* rect, jcv_diagram* diagram );
+
 typedef void* (*FJCVAllocFn)(void* userctx, size_t size);
 typedef void (*FJCVFreeFn)(void* userctx, void* p);
 
@@ -105,12 +177,35 @@ extern void jcv_diagram_free( jcv_diagram* diagram );
 // Returns an array of sites, where each index is the same as the original input point array.
 extern const jcv_site* jcv_diagram_get_sites( const jcv_diagram* diagram );
 
+// Returns, for each input point, the index of its site in jcv_diagram_get_sites(), or -1 if the point was pruned
+// (a duplicate, NaN or infinite, or outside the clipping shape). This is the reverse of jcv_site.index, and is built during generation.
+extern const int* jcv_diagram_get_input_to_site( const jcv_diagram* diagram );
+
+// Returns, for each input point, the input index of the point whose site stands for it: its own index if it was kept,
+// the kept point's index if it was merged into that point as a duplicate, or -1 if it was NaN or infinite or the clipper rejected it.
+extern const int* jcv_diagram_get_input_sources( const jcv_diagram* diagram );
+
 // Returns the number of unique vertices in the diagram.
 extern int jcv_get_num_vertices( const jcv_diagram* diagram );
 
 // Writes all unique vertices to a client-owned array of diagram->numvertices points.
 extern void jcv_diagram_get_vertices( const jcv_diagram* diagram, jcv_point* vertices );
 
+// Returns the diagram's own array of diagram->numvertices unique vertices, indexed by jcv_edge.vertices.
+extern const jcv_point* jcv_diagram_get_vertex_positions( const jcv_diagram* diagram );
+
+// Merges the vertices joined by an edge no longer than the tolerance (transitively), e.g. the slightly different
+// vertices of nearly cocircular sites, and renumbers the remaining vertices in their order. Each merged vertex takes
+// the position of its lowest numbered vertex, and the edges that become empty are removed from the edges and cells.
+// Returns the new number of vertices. Lazy, periodic and Delaunay-only diagrams are left unchanged.
+extern int jcv_diagram_weld_vertices( jcv_diagram* diagram, jcv_real tolerance );
+
+// Returns the sites on the convex hull, as indices into jcv_diagram_get_sites(), in counter clockwise order
+// (with the y axis pointing up). Sites on a straight side of the hull are included, and if all sites are collinear,
+// the hull is every site from one end of the line to the other. It's found from the sorted sites during generation,
+// in O(n). Periodic diagrams have no hull.
+extern const int* jcv_diagram_get_hull( const jcv_diagram* diagram, int* count );
+
 // Returns the stored number of edges yielded by jcv_diagram_get_edges (O(1)).
 extern int jcv_diagram_get_edge_count( const jcv_diagram* diagram );
 
@@ -127,6 +222,20 @@ extern void jcv_site_get_edges( const jcv_diagram* diagram, const jcv_site* site
 // Writes the next edge to client-owned storage. Returns 0 at the end.
 extern int jcv_edge_next( jcv_edge_iter* iter, jcv_edge* edge );
 
+// Writes up to max next edges (as jcv_edge_next would) to client-owned storage. Returns the number written, 0 at the end.
+extern int jcv_edge_next_batch( jcv_edge_iter* iter, jcv_edge* edges, int max );
+
+// Like jcv_edge_next_batch, but only writes the edge end points, to separate arrays (e.g. for vertex buffers).
+extern int jcv_edge_next_positions( jcv_edge_iter* iter, jcv_real* x0, jcv_real* y0, jcv_real* x1, jcv_real* y1, int max );
+
+// Returns the total number of neighbours written by jcv_diagram_get_neighbors (O(1)).
+extern int jcv_diagram_get_neighbor_count( const jcv_diagram* diagram );
+
+// Writes the neighbours of every site as CSR arrays, without copying any jcv_edge: offsets holds numsites+1 ints,
+// and the neighbours of site i are neighbors[offsets[i]] up to neighbors[offsets[i+1]]. They are indices into
+// jcv_diagram_get_sites(), in counter-clockwise order, with -1 for an edge along the clipping boundary.
+extern void jcv_diagram_get_neighbors( const jcv_diagram* diagram, int* offsets, int* neighbors );
+
 // Creates an iterator over the delaunay edges of a voronoi diagram
 void jcv_delaunay_begin( const jcv_diagram* diagram, jcv_delaunay_iter* iter );
 
@@ -137,6 +246,51 @@ int jcv_delaunay_get_edge_count( const jcv_diagram* diagram );
 // Returns 0 when there are no more edges
 int jcv_delaunay_next( jcv_delaunay_iter* iter, jcv_delaunay_edge* next );
 
+// Returns the site whose cell contains the point, i.e. the nearest site, or 0 if the diagram
+// has no cells (empty or Delaunay-only). The search walks over neighbouring sites, starting
+// at the hint (e.g. the previous result) or at a seed site from a coarse grid, whichever is closer.
+// The point should be inside the diagram's clipping shape.
+extern const jcv_site* jcv_diagram_find_site( const jcv_diagram* diagram, jcv_point p, const jcv_site* hint );
+
+// Finds the site for each of the points, using each result as the hint for the next query.
+// Queries that are sorted spatially (e.g. in scanline order) keep each walk short.
+extern void jcv_diagram_find_sites( const jcv_diagram* diagram, int num_points, const jcv_point* points, const jcv_site** sites );
+
+// Builds a grid where each bucket lists every site whose cell overlaps it, for bulk nearest-site queries.
+// Uses the diagram's allocator. Returns 0 if the diagram has no cells (empty or Delaunay-only).
+// The locator refers to the diagram, and must be freed before the diagram is.
+extern jcv_site_locator* jcv_site_locator_create( const jcv_diagram* diagram );
+extern void jcv_site_locator_free( jcv_site_locator* locator );
+
+// Writes the index (into jcv_diagram_get_sites()) of the nearest site for each query point.
+// The locator isn't modified, so threads may query disjoint ranges of the same arrays concurrently.
+// Points outside the diagram's rect, or rejected by the clipper's test_fn, fall back to a linear scan over all sites.
+extern void jcv_site_locator_find( const jcv_site_locator* locator, int num_points, const jcv_real* x, const jcv_real* y, int* site_indices );
+
+// Fills a width*height label image, mapped onto the area (or the diagram's min/max if area is 0), with the index
+// (into jcv_diagram_get_sites()) of the cell containing each pixel centre. Only rows [row_begin, row_end) are written,
+// so threads may fill disjoint row bands of the same image. Pixels outside every cell are left untouched.
+extern void jcv_diagram_rasterize_labels( const jcv_diagram* diagram, const jcv_rect* area, int width, int height, int row_begin, int row_end, uint32_t* labels );
+
+// Natural neighbour (Sibson) interpolation of per-site values, indexed by the input index (jcv_site.index).
+// Each point is inserted locally: its weights are the areas it would take from the neighbouring cells.
+// Points outside the diagram's rect take the nearest site's value. Does nothing for a Delaunay-only diagram.
+extern void jcv_diagram_interpolate( const jcv_diagram* diagram, const jcv_real* values, int num_points, const jcv_point* points, jcv_real* results );
+
+// Interpolates at each pixel centre of a width*height image over the area (or the diagram's min/max if area is 0).
+// Only rows [row_begin, row_end) are written, so threads may fill disjoint row bands of the same image.
+extern void jcv_diagram_interpolate_image( const jcv_diagram* diagram, const jcv_real* values, const jcv_rect* area, int width, int height, int row_begin, int row_end, jcv_real* image );
+
+// Writes the Euclidean minimum spanning tree of the sites as pairs of indices into jcv_diagram_get_sites(),
+// to an array of at least 2*(numsites-1) ints. Returns the number of tree edges (fewer if the Delaunay graph
+// is disconnected). Kruskal's algorithm over the Delaunay edges, radix sorted by their squared lengths.
+extern int jcv_diagram_get_emst( const jcv_diagram* diagram, int* edges );
+
+// Writes the k nearest neighbours of each site, nearest first, as indices into jcv_diagram_get_sites(), to an
+// array of numsites*k ints (padded with -1). Found by a best first search over the Delaunay neighbours, which is
+// exact as long as the Delaunay graph is complete (edges clipped away by the rect may hide some neighbours).
+extern void jcv_diagram_get_knn( const jcv_diagram* diagram, int k, int* neighbors );
+
 // For the default clipper
 extern int jcv_boxshape_test(const jcv_clipper* clipper, const jcv_point p);
 extern int jcv_boxshape_clip(const jcv_clipper* clipper, jcv_edge* e);
@@ -223,6 +377,31 @@ struct jcv_diagram_
 
 #include <memory.h>
 
+#if defined(JCV_USE_PTHREADS)
+    #include <pthread.h>
+#endif
+
+// The bounds and validity scan of packed input uses SSE2, AVX2, NEON (64 bit ARM) or WASM SIMD,
+// whichever the compiler targets. Define JCV_NO_SIMD to always use the scalar loop.
+#if !defined(JCV_NO_SIMD)
+    #if defined(__AVX2__)
+        #include <immintrin.h>
+        #define JCV_SIMD_AVX2
+    #elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #include <emmintrin.h>
+        #define JCV_SIMD_SSE2
+    #elif (defined(__ARM_NEON) && defined(__aarch64__)) || defined(_M_ARM64)
+        #include <arm_neon.h>
+        #define JCV_SIMD_NEON
+    #elif defined(__wasm_simd128__)
+        #include <wasm_simd128.h>
+        #define JCV_SIMD_WASM
+    #endif
+#endif
+#if defined(JCV_SIMD_AVX2) || defined(JCV_SIMD_SSE2) || defined(JCV_SIMD_NEON) || defined(JCV_SIMD_WASM)
+    #define JCV_HAS_SIMD
+#endif
+
 // INTERNAL FUNCTIONS
 
 #if defined(_MSC_VER) && !defined(__cplusplus)
@@ -234,12 +413,25 @@ static const int JCV_DIRECTION_RIGHT = 1;
 static const jcv_real JCV_INVALID_VALUE = (jcv_real)-JCV_FLT_MAX;
 static const int JCV_INVALID_VERTEX = -1;
 
+// The precision of the sweep's vertex and circle event calculations
+#if defined(JCV_USE_MIXED_PRECISION)
+    typedef double jcv_calc_real;
+    #define JCV_CALC_SQRT(_X_) sqrt(_X_)
+#else
+    typedef jcv_real jcv_calc_real;
+    #define JCV_CALC_SQRT(_X_) JCV_SQRT(_X_)
+#endif
+
 // jcv_real
 
 static inline jcv_real jcv_abs(jcv_real v) {
     return (v < 0) ? -v : v;
 }
 
+static inline double jcv_abs_double(double v) {
+    return (v < 0) ? -v : v;
+}
+
 static inline int jcv_real_eq(jcv_real a, jcv_real b)
 {
     return jcv_abs(a - b) < JCV_REAL_TYPE_EPSILON;
@@ -423,13 +615,11 @@ static void jcv_sites_introsort(jcv_site* sites, int count, int depth)
     jcv_sites_insertion_sort(sites, count);
 }
 
-// Sorts sites in ascending y/x order before Fortune's sweep. Already sorted
-// input returns immediately and reverse-sorted input is reversed in place;
-// all other input is passed to the specialized introsort above.
-static void jcv_sites_sort(jcv_site* sites, int count)
+// Returns 1 if the sites were already sorted, or reverse sorted and are now reversed in place
+static int jcv_sites_sort_presorted(jcv_site* sites, int count)
 {
     if( count < 2 )
-        return;
+        return 1;
 
     int ascending = 1;
     int descending = 1;
@@ -441,13 +631,23 @@ static void jcv_sites_sort(jcv_site* sites, int count)
             descending = 0;
     }
     if( ascending )
-        return;
+        return 1;
     if( descending )
     {
         for( int left = 0, right = count-1; left < right; ++left, --right )
             jcv_site_swap(&sites[left], &sites[right]);
-        return;
+        return 1;
     }
+    return 0;
+}
+
+// Sorts sites in ascending y/x order before Fortune's sweep. Already sorted
+// input returns immediately and reverse-sorted input is reversed in place;
+// all other input is passed to the specialized introsort above.
+static void jcv_sites_sort(jcv_site* sites, int count)
+{
+    if( jcv_sites_sort_presorted(sites, count) )
+        return;
 
     int depth = 0;
     for( int n = count; n > 1; n >>= 1 )
@@ -552,6 +752,10 @@ typedef struct jcv_graphedge_
     unsigned char           flip;
 } jcv_graphedge;
 
+typedef struct jcv_halfedge_event_ jcv_halfedge_event;
+
+// The part of a half edge that the beachline search, rotations and neighbour walks touch. Its circle event
+// is in a jcv_halfedge_event, allocated with it in a parallel pool, so that a node fits in one cache line.
 typedef struct jcv_halfedge_
 {
     jcv_edge_internal*      edge;
@@ -560,13 +764,23 @@ typedef struct jcv_halfedge_
     struct jcv_halfedge_*   tree_parent;
     struct jcv_halfedge_*   tree_left;
     struct jcv_halfedge_*   tree_right;
-    jcv_point               vertex;
-    jcv_real                y;
+    jcv_halfedge_event*     event;
     uint32_t                direction : 1; // 0=left, 1=right
     uint32_t                tree_rank : 31;
-    int                     pqpos;
 } jcv_halfedge;
 
+// The circle event of a half edge, which is all that the priority queue reads
+struct jcv_halfedge_event_
+{
+    jcv_halfedge*           he;
+    jcv_point               vertex;
+    jcv_calc_real           y;
+    int                     pqpos;
+};
+
+// The number of half edges allocated at once
+#define JCV_HALFEDGE_POOL_CHUNK 64
+
 typedef struct jcv_memoryblock_
 {
     size_t sizefree;
@@ -580,7 +794,7 @@ typedef struct jcv_priorityqueue_
     // Implements a binary heap
     int             maxnumitems;
     int             numitems;
-    jcv_halfedge**  items;
+    jcv_halfedge_event** items;
 } jcv_priorityqueue;
 
 struct jcv_context_internal_
@@ -590,18 +804,35 @@ struct jcv_context_internal_
     jcv_halfedge*       beachline_start;
     jcv_halfedge*       beachline_end;
     jcv_halfedge*       beachline_root;
+    jcv_halfedge*       beachline_hint;     // The right half edge of the last site, while it is on the beachline
+    jcv_real            beachline_hint_y;
     jcv_halfedge        beachline_nil;
     jcv_priorityqueue*  eventqueue;
 
     jcv_site*           sites;
     jcv_edge_internal** site_edge_refs;
-    int*                site_edge_offsets;
+    int*                site_edge_offsets;  // Lazy cells: the index of each site's unordered edges
+    jcv_edge_internal*** cell_refs;         // Lazy cells: each site's ordered edges, once built
+    int*                cell_counts;        // Lazy cells: -1 until built
     jcv_graphedge**     build_site_edges;
     int*                build_site_counts;
+    jcv_real*           weights;            // Power diagram weights by input index, or 0
+    int*                site_sources;       // Periodic diagrams: the site inside the rect, for each site and copy
+    int*                input_to_site;      // The site index of each input point, or -1 if it was pruned
+    int*                input_sources;      // The input index of the kept point for each input point, or -1
+    int*                hull;               // Hull site indices, in counter clockwise order
+    int                 numhull;
+    int*                site_grid;          // A seed site index per grid cell, for point queries
+    int                 site_grid_width;
+    int                 site_grid_height;
+    jcv_point           site_grid_scale;    // Grid cells per unit
     jcv_site*           bottomsite;
     int                 numsites;
     int                 currentsite;
     int                 numvertices;
+    int                 vertexcapacity;
+    jcv_point*          vertices;           // Unique vertex positions, stored as they are created
+    int                 lastcirclevertex;   // The vertex of the last circle event, or JCV_INVALID_VERTEX
     int                 numedges;
     int                 numdelaunayedges;
     unsigned int        options;
@@ -609,7 +840,7 @@ struct jcv_context_internal_
     jcv_memoryblock*    memblocks;
     jcv_memoryblock*    tempmemblocks;
     jcv_halfedge*       halfedgepool;
-    jcv_halfedge**      eventmem;
+    jcv_halfedge_event** eventmem;
     jcv_clipper         clipper;
 
     void*               memctx; // Given by the user
@@ -619,6 +850,33 @@ struct jcv_context_internal_
     jcv_rect            rect;
 };
 
+// Wraps the value into [min, max)
+static inline jcv_real jcv_periodic_wrap(jcv_real v, jcv_real min, jcv_real max)
+{
+    jcv_real size = max - min;
+    v -= jcv_floor((v - min) / size) * size;
+    return (v >= min && v < max) ? v : min;
+}
+
+static inline jcv_point jcv_periodic_wrap_point(const jcv_context_internal* internal, jcv_point p)
+{
+    p.x = jcv_periodic_wrap(p.x, internal->rect.min.x, internal->rect.max.x);
+    p.y = jcv_periodic_wrap(p.y, internal->rect.min.y, internal->rect.max.y);
+    return p;
+}
+
+// Which period the value is in, relative to [min, max)
+static inline int jcv_periodic_shift(jcv_real v, jcv_real min, jcv_real max)
+{
+    return v < min ? -1 : (v >= max ? 1 : 0);
+}
+
+// In a periodic diagram, maps a copy of a site to the site inside the rect
+static inline int jcv_site_source(const jcv_context_internal* internal, int index)
+{
+    return internal->site_sources ? internal->site_sources[index] : index;
+}
+
 void jcv_diagram_free( jcv_diagram* d )
 {
     jcv_context_internal* internal = d->internal;
@@ -630,6 +888,8 @@ void jcv_diagram_free( jcv_diagram* d )
         internal->memblocks = internal->memblocks->next;
         freefn( memctx, p );
     }
+    if( internal->vertices )
+        freefn( memctx, internal->vertices );
 
     freefn( memctx, internal->mem );
 }
@@ -641,19 +901,27 @@ const jcv_site* jcv_diagram_get_sites( const jcv_diagram* diagram )
 
 int jcv_get_num_vertices( const jcv_diagram* diagram )
 {
-    return diagram->numvertices;
+    return diagram->internal->cell_counts ? diagram->internal->numvertices : diagram->numvertices;
 }
 
 void jcv_diagram_get_vertices( const jcv_diagram* diagram, jcv_point* vertices )
 {
-    jcv_edge_iter iter;
-    jcv_edge edge;
-    jcv_diagram_get_edges(diagram, &iter);
-    while( jcv_edge_next(&iter, &edge) )
-    {
-        vertices[edge.vertices[0]] = edge.pos[0];
-        vertices[edge.vertices[1]] = edge.pos[1];
-    }
+    int numvertices = jcv_get_num_vertices(diagram);
+    if( numvertices > 0 )
+        memcpy(vertices, diagram->internal->vertices, sizeof(jcv_point) * (size_t)numvertices);
+}
+
+const jcv_point* jcv_diagram_get_vertex_positions( const jcv_diagram* diagram )
+{
+    return diagram->internal->vertices;
+}
+
+// The first site's cell lies on the side of the edge facing away from the second site.
+// Unlike the first site itself, that also holds for power diagrams.
+static inline int jcv_edge_flip(const jcv_edge_internal* e)
+{
+    return ((e->pos[1].x - e->pos[0].x) * (e->sites[0]->p.y - e->sites[1]->p.y) -
+            (e->pos[1].y - e->pos[0].y) * (e->sites[0]->p.x - e->sites[1]->p.x)) > (jcv_real)0 ? 0 : 1;
 }
 
 static void jcv_edge_copy(const jcv_edge_internal* source, jcv_edge* target)
@@ -669,6 +937,23 @@ static void jcv_edge_copy(const jcv_edge_internal* source, jcv_edge* target)
     target->c = source->c;
 }
 
+const int* jcv_diagram_get_input_to_site( const jcv_diagram* diagram )
+{
+    return diagram->internal->input_to_site;
+}
+
+const int* jcv_diagram_get_input_sources( const jcv_diagram* diagram )
+{
+    return diagram->internal->input_sources;
+}
+
+const int* jcv_diagram_get_hull( const jcv_diagram* diagram, int* count )
+{
+    const jcv_context_internal* internal = diagram->internal;
+    *count = internal->numhull;
+    return internal->hull;
+}
+
 int jcv_diagram_get_edge_count( const jcv_diagram* diagram )
 {
     return (diagram->internal->options & JCV_OPTION_DELAUNAY_ONLY) ? 0 : diagram->internal->numedges;
@@ -681,13 +966,30 @@ void jcv_diagram_get_edges( const jcv_diagram* diagram, jcv_edge_iter* iter )
     iter->site = 0;
 }
 
+static void jcv_build_cell(jcv_context_internal* internal, int index);
+
+// Returns a site's edges, in counter-clockwise order. A lazy cell is built on first use.
+static inline jcv_edge_internal* const* jcv_site_cell_edges(jcv_context_internal* internal, int index, jcv_edge_internal* const** end)
+{
+    if( internal->cell_counts )
+    {
+        if( internal->cell_counts[index] < 0 )
+            jcv_build_cell(internal, index);
+        *end = internal->cell_refs[index] + internal->cell_counts[index];
+        return internal->cell_refs[index];
+    }
+    *end = internal->site_edge_refs + internal->site_edge_offsets[index+1];
+    return internal->site_edge_refs + internal->site_edge_offsets[index];
+}
+
 void jcv_site_get_edges( const jcv_diagram* diagram, const jcv_site* site, jcv_edge_iter* iter )
 {
     int index = (int)(site - diagram->internal->sites);
     if( diagram->internal->site_edge_refs && index >= 0 && index < diagram->numsites )
     {
-        iter->current = diagram->internal->site_edge_refs + diagram->internal->site_edge_offsets[index];
-        iter->end = diagram->internal->site_edge_refs + diagram->internal->site_edge_offsets[index+1];
+        jcv_edge_internal* const* end;
+        iter->current = jcv_site_cell_edges(diagram->internal, index, &end);
+        iter->end = end;
     }
     else
     {
@@ -697,33 +999,26 @@ void jcv_site_get_edges( const jcv_diagram* diagram, const jcv_site* site, jcv_e
     iter->site = site;
 }
 
-int jcv_edge_next( jcv_edge_iter* iter, jcv_edge* edge )
+// Returns the next edge of a diagram iterator, skipping the ones clipped away
+static inline const jcv_edge_internal* jcv_edge_iter_next_diagram(jcv_edge_iter* iter)
 {
-    if( !iter->site )
-    {
-        const jcv_edge_internal* source = (const jcv_edge_internal*)iter->current;
-        while( source && jcv_point_eq(&source->pos[0], &source->pos[1]) )
-            source = source->next;
-        if( !source )
-            return 0;
-        iter->current = source->next;
-        jcv_edge_copy(source, edge);
-        return 1;
-    }
+    const jcv_edge_internal* source = (const jcv_edge_internal*)iter->current;
+    while( source && jcv_point_eq(&source->pos[0], &source->pos[1]) )
+        source = source->next;
+    iter->current = source ? source->next : 0;
+    return source;
+}
 
-    jcv_edge_internal* const* current = (jcv_edge_internal* const*)iter->current;
-    if( !current || current == (jcv_edge_internal* const*)iter->end )
-        return 0;
-    const jcv_edge_internal* source = *current;
-    iter->current = current + 1;
-    int site_index = source->sites[0] == iter->site ? 0 : 1;
+// Site iterators orient each edge counter-clockwise around the site
+static inline void jcv_edge_copy_for_site(const jcv_site* site, const jcv_edge_internal* source, jcv_edge* edge)
+{
+    int site_index = source->sites[0] == site ? 0 : 1;
     if( source->sites[1] == 0 )
     {
         jcv_edge_copy(source, edge);
-        return 1;
+        return;
     }
-    int flip = ((source->pos[0].x - source->sites[0]->p.x) * (source->pos[1].y - source->sites[0]->p.y) -
-                (source->pos[0].y - source->sites[0]->p.y) * (source->pos[1].x - source->sites[0]->p.x)) > (jcv_real)0 ? 0 : 1;
+    int flip = jcv_edge_flip(source);
     edge->sites[0] = source->sites[site_index];
     edge->sites[1] = source->sites[1-site_index];
     edge->pos[flip] = source->pos[site_index];
@@ -733,9 +1028,232 @@ int jcv_edge_next( jcv_edge_iter* iter, jcv_edge* edge )
     edge->a = source->a;
     edge->b = source->b;
     edge->c = source->c;
+}
+
+static int jcv_weld_find(int* parents, int v)
+{
+    while( parents[v] != v )
+    {
+        parents[v] = parents[parents[v]];
+        v = parents[v];
+    }
+    return v;
+}
+
+// Merges the sets of vertices a and b if they are within the tolerance, keeping the lower root
+static void jcv_weld_join(const jcv_context_internal* internal, int* parents, int a, int b, jcv_real tolerance_sq)
+{
+    if( a < 0 || b < 0 )
+        return;
+    jcv_real dx = internal->vertices[b].x - internal->vertices[a].x;
+    jcv_real dy = internal->vertices[b].y - internal->vertices[a].y;
+    if( dx * dx + dy * dy > tolerance_sq )
+        return;
+    a = jcv_weld_find(parents, a);
+    b = jcv_weld_find(parents, b);
+    if( a < b )
+        parents[b] = a;
+    else if( b < a )
+        parents[a] = b;
+}
+
+int jcv_diagram_weld_vertices( jcv_diagram* diagram, jcv_real tolerance )
+{
+    jcv_context_internal* internal = diagram->internal;
+    int numvertices = internal->numvertices;
+    if( internal->cell_counts || internal->site_sources || !internal->site_edge_offsets || numvertices == 0 )
+        return jcv_get_num_vertices(diagram);
+
+    // Each set's root is its lowest numbered vertex
+    int* parents = (int*)internal->alloc(internal->memctx, sizeof(int) * (size_t)numvertices);
+    for( int i = 0; i < numvertices; ++i )
+        parents[i] = i;
+    // The edges that generation dropped as empty still join their two vertices
+    jcv_real tolerance_sq = tolerance * tolerance;
+    for( jcv_edge_internal* e = internal->edges; e; e = e->next )
+        jcv_weld_join(internal, parents, e->vertices[0], e->vertices[1], tolerance_sq);
+
+    // The new index of each root is at most its old one, so the vertices are compacted in place
+    for( int i = 0; i < numvertices; ++i )
+        parents[i] = jcv_weld_find(parents, i);
+    int count = 0;
+    for( int i = 0; i < numvertices; ++i )
+    {
+        if( parents[i] == i )
+        {
+            internal->vertices[count] = internal->vertices[i];
+            parents[i] = count++;
+        }
+        else
+        {
+            parents[i] = parents[parents[i]];
+        }
+    }
+
+    for( jcv_edge_internal* e = internal->edges; e; e = e->next )
+    {
+        int dropped = e->a == JCV_INVALID_VALUE;
+        for( int i = 0; i < 2; ++i )
+        {
+            if( e->vertices[i] < 0 )
+                continue;
+            e->vertices[i] = parents[e->vertices[i]];
+            if( !dropped )
+                e->pos[i] = internal->vertices[e->vertices[i]];
+        }
+        if( !dropped && e->vertices[0] >= 0 && e->vertices[0] == e->vertices[1] )
+        {
+            // Like the edges clipped away during generation
+            e->a = JCV_INVALID_VALUE;
+            --internal->numedges;
+            if( e->sites[1] )
+                --internal->numdelaunayedges;
+        }
+    }
+    FJCVFreeFn freefn = internal->free;
+    freefn(internal->memctx, parents);
+
+    // Drop the empty edges from the cells
+    int* offsets = internal->site_edge_offsets;
+    jcv_edge_internal** refs = internal->site_edge_refs;
+    int cursor = 0;
+    for( int i = 0; i < internal->numsites; ++i )
+    {
+        int begin = offsets[i];
+        int end = offsets[i+1];
+        offsets[i] = cursor;
+        for( int j = begin; j < end; ++j )
+        {
+            if( refs[j]->a != JCV_INVALID_VALUE )
+                refs[cursor++] = refs[j];
+        }
+    }
+    offsets[internal->numsites] = cursor;
+
+    internal->numvertices = count;
+    diagram->numvertices = count;
+    return count;
+}
+
+int jcv_edge_next( jcv_edge_iter* iter, jcv_edge* edge )
+{
+    if( !iter->site )
+    {
+        const jcv_edge_internal* source = jcv_edge_iter_next_diagram(iter);
+        if( !source )
+            return 0;
+        jcv_edge_copy(source, edge);
+        return 1;
+    }
+
+    jcv_edge_internal* const* current = (jcv_edge_internal* const*)iter->current;
+    if( !current || current == (jcv_edge_internal* const*)iter->end )
+        return 0;
+    iter->current = current + 1;
+    jcv_edge_copy_for_site(iter->site, *current, edge);
     return 1;
 }
 
+int jcv_edge_next_batch( jcv_edge_iter* iter, jcv_edge* edges, int max )
+{
+    int count = 0;
+    if( !iter->site )
+    {
+        const jcv_edge_internal* source;
+        while( count < max && (source = jcv_edge_iter_next_diagram(iter)) != 0 )
+            jcv_edge_copy(source, &edges[count++]);
+        return count;
+    }
+
+    jcv_edge_internal* const* current = (jcv_edge_internal* const*)iter->current;
+    jcv_edge_internal* const* end = (jcv_edge_internal* const*)iter->end;
+    if( !current )
+        return 0;
+    for( ; count < max && current != end; ++current )
+        jcv_edge_copy_for_site(iter->site, *current, &edges[count++]);
+    iter->current = current;
+    return count;
+}
+
+int jcv_edge_next_positions( jcv_edge_iter* iter, jcv_real* x0, jcv_real* y0, jcv_real* x1, jcv_real* y1, int max )
+{
+    int count = 0;
+    if( !iter->site )
+    {
+        const jcv_edge_internal* source;
+        while( count < max && (source = jcv_edge_iter_next_diagram(iter)) != 0 )
+        {
+            x0[count] = source->pos[0].x;
+            y0[count] = source->pos[0].y;
+            x1[count] = source->pos[1].x;
+            y1[count] = source->pos[1].y;
+            ++count;
+        }
+        return count;
+    }
+
+    jcv_edge_internal* const* current = (jcv_edge_internal* const*)iter->current;
+    jcv_edge_internal* const* end = (jcv_edge_internal* const*)iter->end;
+    if( !current )
+        return 0;
+    for( ; count < max && current != end; ++current, ++count )
+    {
+        const jcv_edge_internal* source = *current;
+        // See jcv_edge_copy_for_site: the end points swap when the flip differs from the site's side
+        int swap = source->sites[1] != 0 && (source->sites[0] == iter->site ? 0 : 1) != jcv_edge_flip(source);
+        x0[count] = source->pos[swap].x;
+        y0[count] = source->pos[swap].y;
+        x1[count] = source->pos[1-swap].x;
+        y1[count] = source->pos[1-swap].y;
+    }
+    iter->current = current;
+    return count;
+}
+
+int jcv_diagram_get_neighbor_count( const jcv_diagram* diagram )
+{
+    jcv_context_internal* internal = diagram->internal;
+    if( !internal->site_edge_offsets )
+        return 0;
+    if( !internal->cell_counts )
+        return internal->site_edge_offsets[diagram->numsites];
+    int count = 0;
+    for( int i = 0; i < diagram->numsites; ++i )
+    {
+        jcv_edge_internal* const* end;
+        jcv_edge_internal* const* begin = jcv_site_cell_edges(internal, i, &end);
+        count += (int)(end - begin);
+    }
+    return count;
+}
+
+void jcv_diagram_get_neighbors( const jcv_diagram* diagram, int* offsets, int* neighbors )
+{
+    jcv_context_internal* internal = diagram->internal;
+    int numsites = diagram->numsites;
+    if( !internal->site_edge_offsets )
+    {
+        memset(offsets, 0, sizeof(int) * (size_t)(numsites + 1));
+        return;
+    }
+
+    const jcv_site* sites = internal->sites;
+    int n = 0;
+    for( int i = 0; i < numsites; ++i )
+    {
+        offsets[i] = n;
+        jcv_edge_internal* const* end;
+        jcv_edge_internal* const* current = jcv_site_cell_edges(internal, i, &end);
+        for( ; current != end; ++current, ++n )
+        {
+            const jcv_edge_internal* e = *current;
+            const jcv_site* neighbor = e->sites[0] == &sites[i] ? e->sites[1] : e->sites[0];
+            neighbors[n] = neighbor ? jcv_site_source(internal, (int)(neighbor - sites)) : -1;
+        }
+    }
+    offsets[numsites] = n;
+}
+
 void jcv_delaunay_begin( const jcv_diagram* diagram, jcv_delaunay_iter* iter )
 {
     iter->delaunay_only = (diagram->internal->options & JCV_OPTION_DELAUNAY_ONLY) != 0;
@@ -783,1506 +1301,4182 @@ int jcv_delaunay_next( jcv_delaunay_iter* iter, jcv_delaunay_edge* next )
     return 1;
 }
 
-static inline void* jcv_align(void* value, size_t alignment)
+static inline int jcv_site_grid_cell(const jcv_context_internal* internal, const jcv_point* p)
 {
-    return (void*) (((uintptr_t) value + (alignment-1)) & ~(alignment-1));
+    jcv_real x = (p->x - internal->rect.min.x) * internal->site_grid_scale.x;
+    jcv_real y = (p->y - internal->rect.min.y) * internal->site_grid_scale.y;
+    jcv_real maxx = (jcv_real)(internal->site_grid_width - 1);
+    jcv_real maxy = (jcv_real)(internal->site_grid_height - 1);
+    x = !(x > 0) ? 0 : (x > maxx ? maxx : x);
+    y = !(y > 0) ? 0 : (y > maxy ? maxy : y);
+    return (int)y * internal->site_grid_width + (int)x;
 }
 
-static void* jcv_alloc(jcv_context_internal* internal, size_t size)
+// The squared distance, less the site's weight in a power diagram
+static inline jcv_real jcv_site_power(const jcv_context_internal* internal, const jcv_site* site, const jcv_point* p)
 {
-    if( !internal->memblocks || internal->memblocks->sizefree < (size+sizeof(void*)) )
-    {
-        size_t blocksize = 16 * 1024;
-        size_t required = sizeof(jcv_memoryblock) + size + sizeof(void*);
-        if( blocksize < required )
-            blocksize = required;
-        jcv_memoryblock* block = (jcv_memoryblock*)internal->alloc( internal->memctx, blocksize );
-        size_t offset = sizeof(jcv_memoryblock);
-        block->sizefree = blocksize - offset;
-        block->next = internal->memblocks;
-        block->memory = ((char*)block) + offset;
-        internal->memblocks = block;
-    }
-    void* p_raw = internal->memblocks->memory;
-    void* p_aligned = jcv_align(p_raw, sizeof(void*));
-    size += (uintptr_t)p_aligned - (uintptr_t)p_raw;
-    internal->memblocks->memory += size;
-    internal->memblocks->sizefree -= size;
-    return p_aligned;
+    jcv_real dist = jcv_point_dist_sq(&site->p, p);
+    return internal->weights ? dist - internal->weights[site->index] : dist;
 }
 
-static jcv_edge_internal* jcv_alloc_edge(jcv_context_internal* internal)
+static inline int jcv_site_has_edges(const jcv_context_internal* internal, int index)
 {
-    return (jcv_edge_internal*)jcv_alloc(internal, sizeof(jcv_edge_internal));
+    // Every site of a lazy (unweighted) diagram has a cell, which may not be built yet
+    return internal->cell_counts || internal->site_edge_offsets[index] != internal->site_edge_offsets[index+1];
 }
 
-static jcv_halfedge* jcv_alloc_halfedge(jcv_context_internal* internal)
+// Greedy walk towards the point. Each step moves to the neighbour nearest to the point,
+// if it's nearer than the current site, and a site without one owns the point.
+static const jcv_site* jcv_find_site_walk(const jcv_context_internal* internal, const jcv_site* site, const jcv_point* p)
 {
-    if( internal->halfedgepool )
+    jcv_real best = jcv_site_power(internal, site, p);
+    for(;;)
     {
-        jcv_halfedge* edge = internal->halfedgepool;
-        internal->halfedgepool = internal->halfedgepool->right;
-        return edge;
+        const jcv_site* next = site;
+        int index = (int)(site - internal->sites);
+        jcv_edge_internal* const* current = internal->site_edge_refs + internal->site_edge_offsets[index];
+        jcv_edge_internal* const* end = internal->site_edge_refs + internal->site_edge_offsets[index+1];
+        for( ; current != end; ++current )
+        {
+            const jcv_edge_internal* e = *current;
+            const jcv_site* neighbor = e->sites[0] == site ? e->sites[1] : e->sites[0];
+            if( !neighbor )
+                continue;
+            jcv_real dist = jcv_site_power(internal, neighbor, p);
+            if( dist < best )
+            {
+                best = dist;
+                next = neighbor;
+            }
+        }
+        if( next == site )
+            return site;
+        site = next;
     }
+}
 
-    return (jcv_halfedge*)jcv_alloc(internal, sizeof(jcv_halfedge));
+// Returns the nearest site, which in a periodic diagram may be a copy outside the rect
+static const jcv_site* jcv_find_site_internal(const jcv_context_internal* internal, const jcv_point* p, const jcv_site* hint)
+{
+    // A hint further away than the seed site (e.g. for an unsorted query) would only lengthen the walk
+    const jcv_site* seed = &internal->sites[internal->site_grid[jcv_site_grid_cell(internal, p)]];
+    if( !hint || hint < internal->sites || hint >= internal->sites + internal->numsites ||
+        !jcv_site_has_edges(internal, (int)(hint - internal->sites)) ||
+        jcv_site_power(internal, seed, p) < jcv_site_power(internal, hint, p) )
+        hint = seed;
+    return jcv_find_site_walk(internal, hint, p);
 }
 
-static void* jcv_temp_alloc(jcv_context_internal* internal, size_t size)
+const jcv_site* jcv_diagram_find_site( const jcv_diagram* diagram, jcv_point p, const jcv_site* hint )
 {
-    if( !internal->tempmemblocks || internal->tempmemblocks->sizefree < (size+sizeof(void*)) )
+    const jcv_context_internal* internal = diagram->internal;
+    if( !internal || !internal->site_grid )
+        return 0;
+    if( internal->site_sources )
+        p = jcv_periodic_wrap_point(internal, p);
+    const jcv_site* site = jcv_find_site_internal(internal, &p, hint);
+    return &internal->sites[jcv_site_source(internal, (int)(site - internal->sites))];
+}
+
+void jcv_diagram_find_sites( const jcv_diagram* diagram, int num_points, const jcv_point* points, const jcv_site** sites )
+{
+    const jcv_site* hint = 0;
+    for( int i = 0; i < num_points; ++i )
     {
-        size_t blocksize = 16 * 1024;
-        size_t required = sizeof(jcv_memoryblock) + size + sizeof(void*);
-        if( blocksize < required )
-            blocksize = required;
-        jcv_memoryblock* block = (jcv_memoryblock*)internal->alloc(internal->memctx, blocksize);
-        size_t offset = sizeof(jcv_memoryblock);
-        block->sizefree = blocksize - offset;
-        block->next = internal->tempmemblocks;
-        block->memory = ((char*)block) + offset;
-        internal->tempmemblocks = block;
+        hint = jcv_diagram_find_site(diagram, points[i], hint);
+        sites[i] = hint;
     }
-    void* p_raw = internal->tempmemblocks->memory;
-    void* p_aligned = jcv_align(p_raw, sizeof(void*));
-    size += (uintptr_t)p_aligned - (uintptr_t)p_raw;
-    internal->tempmemblocks->memory += size;
-    internal->tempmemblocks->sizefree -= size;
-    return p_aligned;
 }
 
-static jcv_graphedge* jcv_alloc_graphedge(jcv_context_internal* internal)
+static inline void* jcv_align(void* value, size_t alignment)
 {
-    return (jcv_graphedge*)jcv_temp_alloc(internal, sizeof(jcv_graphedge));
+    return (void*) (((uintptr_t) value + (alignment-1)) & ~(alignment-1));
 }
 
-static void jcv_temp_free_all(jcv_context_internal* internal)
+// The buckets are a bit larger than the seed grid cells, since each cell is listed in every bucket it overlaps
+static const int JCV_SITE_LOCATOR_SITES_PER_BUCKET = 2;
+
+struct jcv_site_locator_
 {
-    FJCVFreeFn freefn = internal->free;
-    while( internal->tempmemblocks )
-    {
-        jcv_memoryblock* block = internal->tempmemblocks;
-        internal->tempmemblocks = block->next;
-        freefn(internal->memctx, block);
-    }
-}
+    const jcv_diagram*  diagram;
+    jcv_rect            rect;
+    jcv_point           scale;          // Buckets per unit
+    int                 width;
+    int                 height;
+    int*                offsets;        // [width*height+1] Candidate range of each bucket
+    int*                indices;        // Candidate site indices
+    jcv_real*           x;              // Candidate site positions, in the same order as indices
+    jcv_real*           y;
+    jcv_real*           w;              // Candidate site weights in a power diagram, or 0
+};
 
-static void* jcv_alloc_fn(void* memctx, size_t size)
+static inline int jcv_site_locator_column(const jcv_site_locator* locator, jcv_real x)
 {
-    (void)memctx;
-    return malloc(size);
+    jcv_real v = jcv_floor((x - locator->rect.min.x) * locator->scale.x);
+    return !(v > 0) ? 0 : (v >= (jcv_real)locator->width ? locator->width - 1 : (int)v);
 }
 
-static void jcv_free_fn(void* memctx, void* p)
+static inline int jcv_site_locator_row(const jcv_site_locator* locator, jcv_real y)
 {
-    (void)memctx;
-    free(p);
+    jcv_real v = jcv_floor((y - locator->rect.min.y) * locator->scale.y);
+    return !(v > 0) ? 0 : (v >= (jcv_real)locator->height ? locator->height - 1 : (int)v);
 }
 
-// jcv_edge
-
-static inline int jcv_is_valid(const jcv_point* p)
+static jcv_rect jcv_site_get_bounds(jcv_context_internal* internal, int index)
 {
-    return (p->x != JCV_INVALID_VALUE || p->y != JCV_INVALID_VALUE) ? 1 : 0;
+    jcv_rect bounds;
+    bounds.min = bounds.max = internal->sites[index].p;
+    jcv_edge_internal* const* end;
+    jcv_edge_internal* const* current = jcv_site_cell_edges(internal, index, &end);
+    for( ; current != end; ++current )
+    {
+        for( int i = 0; i < 2; ++i )
+        {
+            const jcv_point* p = &(*current)->pos[i];
+            bounds.min.x = jcv_min(bounds.min.x, p->x);
+            bounds.min.y = jcv_min(bounds.min.y, p->y);
+            bounds.max.x = jcv_max(bounds.max.x, p->x);
+            bounds.max.y = jcv_max(bounds.max.y, p->y);
+        }
+    }
+    return bounds;
 }
 
-static void jcv_edge_create(jcv_edge_internal* e, jcv_site* s1, jcv_site* s2)
+jcv_site_locator* jcv_site_locator_create( const jcv_diagram* diagram )
 {
-    e->next = 0;
-    e->sites[0] = s1;
-    e->sites[1] = s2;
-    e->pos[0].x = JCV_INVALID_VALUE;
-    e->pos[0].y = JCV_INVALID_VALUE;
-    e->pos[1].x = JCV_INVALID_VALUE;
-    e->pos[1].y = JCV_INVALID_VALUE;
-    e->vertices[0] = JCV_INVALID_VERTEX;
-    e->vertices[1] = JCV_INVALID_VERTEX;
-
-    // Create line equation between S1 and S2:
-    // jcv_real a = -1 * (s2->p.y - s1->p.y);
-    // jcv_real b = s2->p.x - s1->p.x;
-    // //jcv_real c = -1 * (s2->p.x - s1->p.x) * s1->p.y + (s2->p.y - s1->p.y) * s1->p.x;
-    //
-    // // create perpendicular line
-    // jcv_real pa = b;
-    // jcv_real pb = -a;
-    // //jcv_real pc = pa * s1->p.x + pb * s1->p.y;
-    //
-    // // Move to the mid point
-    // jcv_real mx = s1->p.x + dx * jcv_real(0.5);
-    // jcv_real my = s1->p.y + dy * jcv_real(0.5);
-    // jcv_real pc = ( pa * mx + pb * my );
-
-    jcv_real dx = s2->p.x - s1->p.x;
-    jcv_real dy = s2->p.y - s1->p.y;
-    int dx_is_larger = (dx*dx) > (dy*dy); // instead of fabs
-
-    // Simplify it, using dx and dy
-    e->c = dx * (s1->p.x + dx * (jcv_real)0.5) + dy * (s1->p.y + dy * (jcv_real)0.5);
+    jcv_context_internal* internal = diagram->internal;
+    if( !internal || !internal->site_edge_offsets || internal->numsites == 0 )
+        return 0;
 
-    if( dx_is_larger )
+    int numsites = internal->numsites;
+    jcv_rect rect = internal->rect;
+    jcv_real width = rect.max.x - rect.min.x;
+    jcv_real height = rect.max.y - rect.min.y;
+    int numbuckets = numsites / JCV_SITE_LOCATOR_SITES_PER_BUCKET + 1;
+    int gridwidth = 1;
+    if( width > 0 && height > 0 )
     {
-        e->a = (jcv_real)1;
-        e->b = dy / dx;
-        e->c /= dx;
+        jcv_real columns = jcv_ceil(JCV_SQRT((jcv_real)numbuckets * (width / height)));
+        gridwidth = columns < 1 ? 1 : (columns > (jcv_real)numbuckets ? numbuckets : (int)columns);
     }
-    else
+    else if( width > 0 )
+    {
+        gridwidth = numbuckets;
+    }
+    int gridheight = (numbuckets + gridwidth - 1) / gridwidth;
+    numbuckets = gridwidth * gridheight;
+
+    jcv_site_locator tmp;
+    tmp.diagram = diagram;
+    tmp.rect = rect;
+    tmp.scale.x = width > 0 ? (jcv_real)gridwidth / width : 0;
+    tmp.scale.y = height > 0 ? (jcv_real)gridheight / height : 0;
+    tmp.width = gridwidth;
+    tmp.height = gridheight;
+
+    // First pass counts the candidates per bucket, so that everything fits in one allocation
+    size_t countsize = sizeof(int) * (size_t)(numbuckets + 1);
+    int* counts = (int*)internal->alloc(internal->memctx, countsize);
+    memset(counts, 0, countsize);
+    for( int i = 0; i < numsites; ++i )
+    {
+        if( !jcv_site_has_edges(internal, i) )
+            continue;
+        jcv_rect bounds = jcv_site_get_bounds(internal, i);
+        int x0 = jcv_site_locator_column(&tmp, bounds.min.x);
+        int x1 = jcv_site_locator_column(&tmp, bounds.max.x);
+        int y0 = jcv_site_locator_row(&tmp, bounds.min.y);
+        int y1 = jcv_site_locator_row(&tmp, bounds.max.y);
+        for( int y = y0; y <= y1; ++y )
+            for( int x = x0; x <= x1; ++x )
+                counts[y * gridwidth + x + 1]++;
+    }
+    for( int i = 0; i < numbuckets; ++i )
+        counts[i+1] += counts[i];
+    int numcandidates = counts[numbuckets];
+
+    size_t realssize = sizeof(jcv_real) * (size_t)numcandidates;
+    size_t indicessize = sizeof(int) * (size_t)numcandidates;
+    int numreals = internal->weights ? 3 : 2;
+    size_t memsize = sizeof(jcv_site_locator) + sizeof(void*) * 5 + realssize * (size_t)numreals + countsize + indicessize;
+    void* mem = internal->alloc(internal->memctx, memsize);
+    jcv_site_locator* locator = (jcv_site_locator*)mem;
+    *locator = tmp;
+    mem = jcv_align((char*)mem + sizeof(jcv_site_locator), sizeof(void*));
+    locator->x = (jcv_real*)mem;
+    mem = jcv_align((char*)mem + realssize, sizeof(void*));
+    locator->y = (jcv_real*)mem;
+    mem = jcv_align((char*)mem + realssize, sizeof(void*));
+    locator->w = 0;
+    if( internal->weights )
+    {
+        locator->w = (jcv_real*)mem;
+        mem = jcv_align((char*)mem + realssize, sizeof(void*));
+    }
+    locator->offsets = (int*)mem;
+    mem = jcv_align((char*)mem + countsize, sizeof(void*));
+    locator->indices = (int*)mem;
+
+    memcpy(locator->offsets, counts, countsize);
+    for( int i = 0; i < numsites; ++i )
     {
-        e->a = dx / dy;
-        e->b = (jcv_real)1;
-        e->c /= dy;
+        if( !jcv_site_has_edges(internal, i) )
+            continue;
+        jcv_rect bounds = jcv_site_get_bounds(internal, i);
+        int x0 = jcv_site_locator_column(locator, bounds.min.x);
+        int x1 = jcv_site_locator_column(locator, bounds.max.x);
+        int y0 = jcv_site_locator_row(locator, bounds.min.y);
+        int y1 = jcv_site_locator_row(locator, bounds.max.y);
+        for( int y = y0; y <= y1; ++y )
+        {
+            for( int x = x0; x <= x1; ++x )
+            {
+                int slot = counts[y * gridwidth + x]++;
+                locator->indices[slot] = i;
+                locator->x[slot] = internal->sites[i].p.x;
+                locator->y[slot] = internal->sites[i].p.y;
+                if( locator->w )
+                    locator->w[slot] = internal->weights[internal->sites[i].index];
+            }
+        }
     }
+    FJCVFreeFn freefn = internal->free;
+    freefn(internal->memctx, counts);
+    return locator;
 }
 
-// CLIPPING
-int jcv_boxshape_test(const jcv_clipper* clipper, const jcv_point p)
+void jcv_site_locator_free( jcv_site_locator* locator )
 {
-    return p.x >= clipper->min.x && p.x <= clipper->max.x &&
-           p.y >= clipper->min.y && p.y <= clipper->max.y;
+    if( !locator )
+        return;
+    const jcv_context_internal* internal = locator->diagram->internal;
+    FJCVFreeFn freefn = internal->free;
+    freefn(internal->memctx, locator);
 }
 
-// The line equation: ax + by + c = 0
-// see jcv_edge_create
-int jcv_boxshape_clip(const jcv_clipper* clipper, jcv_edge* e)
+// Returns the candidate slot nearest to (px, py). Four independent lanes keep the
+// loop free of serial dependencies, so that compilers can vectorize it.
+// The weights (if any) are subtracted from the squared distances.
+static int jcv_site_locator_nearest(const jcv_real* xs, const jcv_real* ys, const jcv_real* ws, int begin, int end, jcv_real px, jcv_real py)
 {
-    jcv_real pxmin = clipper->min.x;
-    jcv_real pxmax = clipper->max.x;
-    jcv_real pymin = clipper->min.y;
-    jcv_real pymax = clipper->max.y;
-
-    jcv_real x1, y1, x2, y2;
-    jcv_point* s1;
-    jcv_point* s2;
-    if (e->a == (jcv_real)1 && e->b >= (jcv_real)0)
+    jcv_real best[4] = { JCV_FLT_MAX, JCV_FLT_MAX, JCV_FLT_MAX, JCV_FLT_MAX };
+    int bestslot[4] = { begin, begin, begin, begin };
+    int i = begin;
+    if( ws )
     {
-        s1 = jcv_is_valid(&e->pos[1]) ? &e->pos[1] : 0;
-        s2 = jcv_is_valid(&e->pos[0]) ? &e->pos[0] : 0;
+        for( ; i + 4 <= end; i += 4 )
+        {
+            for( int lane = 0; lane < 4; ++lane )
+            {
+                jcv_real dx = xs[i + lane] - px;
+                jcv_real dy = ys[i + lane] - py;
+                jcv_real dist = dx*dx + dy*dy - ws[i + lane];
+                int closer = dist < best[lane];
+                best[lane] = closer ? dist : best[lane];
+                bestslot[lane] = closer ? i + lane : bestslot[lane];
+            }
+        }
     }
     else
     {
-        s1 = jcv_is_valid(&e->pos[0]) ? &e->pos[0] : 0;
-        s2 = jcv_is_valid(&e->pos[1]) ? &e->pos[1] : 0;
+        for( ; i + 4 <= end; i += 4 )
+        {
+            for( int lane = 0; lane < 4; ++lane )
+            {
+                jcv_real dx = xs[i + lane] - px;
+                jcv_real dy = ys[i + lane] - py;
+                jcv_real dist = dx*dx + dy*dy;
+                int closer = dist < best[lane];
+                best[lane] = closer ? dist : best[lane];
+                bestslot[lane] = closer ? i + lane : bestslot[lane];
+            }
+        }
     }
-    int s1_inside = s1 != 0 && jcv_boxshape_test(clipper, *s1);
-    int s2_inside = s2 != 0 && jcv_boxshape_test(clipper, *s2);
-
-    if (e->a == (jcv_real)1) // delta x is larger
+    for( int lane = 0; i < end; ++i, ++lane )
     {
-        y1 = pymin;
-        if (s1 != 0 && s1->y > pymin)
+        jcv_real dx = xs[i] - px;
+        jcv_real dy = ys[i] - py;
+        jcv_real dist = dx*dx + dy*dy - (ws ? ws[i] : 0);
+        if( dist < best[lane] )
         {
-            y1 = s1->y;
+            best[lane] = dist;
+            bestslot[lane] = i;
         }
-        if( y1 > pymax )
+    }
+    int slot = bestslot[0];
+    jcv_real dist = best[0];
+    for( int lane = 1; lane < 4; ++lane )
+    {
+        if( best[lane] < dist || (best[lane] == dist && bestslot[lane] < slot) )
         {
-            y1 = pymax;
+            dist = best[lane];
+            slot = bestslot[lane];
         }
-        x1 = e->c - e->b * y1;
-        y2 = pymax;
-        if (s2 != 0 && s2->y < pymax)
-            y2 = s2->y;
+    }
+    return slot;
+}
 
-        if( y2 < pymin )
-        {
-            y2 = pymin;
-        }
-        x2 = (e->c) - (e->b) * y2;
-        // Never occurs according to lcov
-        // if( ((x1 > pxmax) & (x2 > pxmax)) | ((x1 < pxmin) & (x2 < pxmin)) )
-        // {
-        //     return 0;
-        // }
-        if (x1 > pxmax)
-        {
-            x1 = pxmax;
-            y1 = (e->c - x1) / e->b;
-        }
-        else if (x1 < pxmin)
+void jcv_site_locator_find( const jcv_site_locator* locator, int num_points, const jcv_real* x, const jcv_real* y, int* site_indices )
+{
+    const jcv_context_internal* internal = locator->diagram->internal;
+    const jcv_rect* rect = &locator->rect;
+    // Every site is listed in at least one bucket, so scanning all candidates covers points outside the rect
+    int numcandidates = locator->offsets[locator->width * locator->height];
+    for( int i = 0; i < num_points; ++i )
+    {
+        jcv_real px = x[i];
+        jcv_real py = y[i];
+        if( internal->site_sources )
         {
-            x1 = pxmin;
-            y1 = (e->c - x1) / e->b;
+            px = jcv_periodic_wrap(px, rect->min.x, rect->max.x);
+            py = jcv_periodic_wrap(py, rect->min.y, rect->max.y);
         }
-        if (x2 > pxmax)
+        int begin = 0;
+        int end = numcandidates;
+        int inside = px >= rect->min.x && px <= rect->max.x && py >= rect->min.y && py <= rect->max.y;
+        // The buckets only cover the clipped cells, so a point outside a custom shape isn't in its nearest site's buckets
+        if( inside && internal->clipper.test_fn && internal->clipper.test_fn != jcv_boxshape_test )
         {
-            x2 = pxmax;
-            y2 = (e->c - x2) / e->b;
+            jcv_point p = { px, py };
+            inside = internal->clipper.test_fn(&internal->clipper, p);
         }
-        else if (x2 < pxmin)
+        if( inside )
         {
-            x2 = pxmin;
-            y2 = (e->c - x2) / e->b;
+            int bucket = jcv_site_locator_row(locator, py) * locator->width + jcv_site_locator_column(locator, px);
+            begin = locator->offsets[bucket];
+            end = locator->offsets[bucket+1];
         }
+        site_indices[i] = begin == end ? -1 : jcv_site_source(internal, locator->indices[jcv_site_locator_nearest(locator->x, locator->y, locator->w, begin, end, px, py)]);
     }
-    else // delta y is larger
+}
+
+static inline jcv_real jcv_raster_center(jcv_real origin, jcv_real scale, int i)
+{
+    return origin + ((jcv_real)i + (jcv_real)0.5) * scale;
+}
+
+// Returns the first pixel, in [0, count], whose centre is >= v. The estimate is corrected
+// using the exact centre positions, so that cells sharing an edge coordinate never overlap or leave a gap.
+static int jcv_raster_first(jcv_real origin, jcv_real scale, int count, jcv_real v)
+{
+    jcv_real f = jcv_ceil((v - origin) / scale - (jcv_real)0.5);
+    int i = !(f > 0) ? 0 : (f > (jcv_real)count ? count : (int)f);
+    while( i > 0 && jcv_raster_center(origin, scale, i - 1) >= v )
+        --i;
+    while( i < count && jcv_raster_center(origin, scale, i) < v )
+        ++i;
+    return i;
+}
+
+void jcv_diagram_rasterize_labels( const jcv_diagram* diagram, const jcv_rect* area, int width, int height, int row_begin, int row_end, uint32_t* labels )
+{
+    jcv_context_internal* internal = diagram->internal;
+    row_begin = row_begin < 0 ? 0 : row_begin;
+    row_end = row_end > height ? height : row_end;
+    if( !internal || !internal->site_edge_offsets || width <= 0 || row_begin >= row_end )
+        return;
+
+    jcv_point origin = area ? area->min : diagram->min;
+    jcv_point extent = area ? area->max : diagram->max;
+    jcv_point scale;
+    scale.x = (extent.x - origin.x) / (jcv_real)width;
+    scale.y = (extent.y - origin.y) / (jcv_real)height;
+    if( !(scale.x > 0) || !(scale.y > 0) )
+        return;
+
+    // The left and right span ends of each row in the band, for the current cell
+    int numrows = row_end - row_begin;
+    jcv_real* spans = (jcv_real*)internal->alloc(internal->memctx, sizeof(jcv_real) * 2 * (size_t)numrows);
+
+    for( int i = 0; i < internal->numsites; ++i )
     {
-        x1 = pxmin;
-        if( s1 != 0 && s1->x > pxmin )
-            x1 = s1->x;
-        if( x1 > pxmax )
+        jcv_rect bounds = jcv_site_get_bounds(internal, i);
+        int r0 = jcv_raster_first(origin.y, scale.y, height, bounds.min.y);
+        int r1 = jcv_raster_first(origin.y, scale.y, height, bounds.max.y);
+        r0 = r0 < row_begin ? row_begin : r0;
+        r1 = r1 > row_end ? row_end : r1;
+        if( r0 >= r1 )
+            continue;
+
+        jcv_real* rowspans = spans + 2 * (r0 - row_begin);
+        for( int r = 0; r < r1 - r0; ++r )
         {
-            x1 = pxmax;
+            rowspans[r*2+0] = JCV_FLT_MAX;
+            rowspans[r*2+1] = -JCV_FLT_MAX;
         }
-        y1 = e->c - e->a * x1;
-        x2 = pxmax;
-        if( s2 != 0 && s2->x < pxmax )
-            x2 = s2->x;
-        if( x2 < pxmin )
+
+        // Walk each edge over the rows whose centres it crosses (half open in y, so that
+        // a shared vertex is counted once). The endpoints are ordered the same way for both
+        // cells of an edge, which then compute bit identical crossings.
+        jcv_edge_internal* const* end;
+        jcv_edge_internal* const* current = jcv_site_cell_edges(internal, i, &end);
+        for( ; current != end; ++current )
         {
-            x2 = pxmin;
+            const jcv_point* a = &(*current)->pos[0];
+            const jcv_point* b = &(*current)->pos[1];
+            if( a->y == b->y )
+                continue;
+            if( a->y > b->y )
+            {
+                const jcv_point* tmp = a;
+                a = b;
+                b = tmp;
+            }
+            int e0 = jcv_raster_first(origin.y, scale.y, height, a->y);
+            int e1 = jcv_raster_first(origin.y, scale.y, height, b->y);
+            e0 = e0 < r0 ? r0 : e0;
+            e1 = e1 > r1 ? r1 : e1;
+            jcv_real dxdy = (b->x - a->x) / (b->y - a->y);
+            for( int r = e0; r < e1; ++r )
+            {
+                jcv_real x = a->x + (jcv_raster_center(origin.y, scale.y, r) - a->y) * dxdy;
+                jcv_real* span = &rowspans[(r - r0) * 2];
+                span[0] = jcv_min(span[0], x);
+                span[1] = jcv_max(span[1], x);
+            }
         }
-        y2 = e->c - e->a * x2;
-        // Never occurs according to lcov
-        // if( ((y1 > pymax) & (y2 > pymax)) | ((y1 < pymin) & (y2 < pymin)) )
-        // {
-        //     return 0;
-        // }
-        if( y1 > pymax )
+
+        for( int r = r0; r < r1; ++r )
         {
-            y1 = pymax;
-            x1 = (e->c - y1) / e->a;
+            const jcv_real* span = &rowspans[(r - r0) * 2];
+            if( span[0] > span[1] )
+                continue;
+            int c0 = jcv_raster_first(origin.x, scale.x, width, span[0]);
+            int c1 = jcv_raster_first(origin.x, scale.x, width, span[1]);
+            uint32_t* row = labels + (size_t)r * (size_t)width;
+            for( int c = c0; c < c1; ++c )
+                row[c] = (uint32_t)jcv_site_source(internal, i);
         }
-        else if( y1 < pymin )
+    }
+    FJCVFreeFn freefn = internal->free;
+    freefn(internal->memctx, spans);
+}
+
+// The most sites that are visited (natural neighbours and the ones just outside of them) for one point.
+// Only degenerate configurations get close to this, and the interpolation then uses the neighbours found so far.
+#define JCV_INTERPOLATE_MAX_CANDIDATES 128
+
+// Returns twice the area of the site's cell that is closer to q than to the site
+static jcv_real jcv_cell_stolen_area(jcv_context_internal* internal, int index, const jcv_point* q)
+{
+    const jcv_point* s = &internal->sites[index].p;
+    jcv_point n;
+    n.x = q->x - s->x;
+    n.y = q->y - s->y;
+    // The reference point is on the bisector, so the chord that closes the clipped cell adds
+    // nothing to the area sum. In a power diagram, the site's weight moves the bisector away from it.
+    jcv_real offset = (jcv_real)0.5;
+    if( internal->weights )
+        offset += (jcv_real)0.5 * internal->weights[internal->sites[index].index] / (n.x*n.x + n.y*n.y);
+    jcv_point c;
+    c.x = s->x + n.x * offset;
+    c.y = s->y + n.y * offset;
+
+    jcv_real area = 0;
+    jcv_edge_internal* const* end;
+    jcv_edge_internal* const* current = jcv_site_cell_edges(internal, index, &end);
+    for( ; current != end; ++current )
+    {
+        jcv_point a = (*current)->pos[0];
+        jcv_point b = (*current)->pos[1];
+        // Orient the edge counter clockwise around the site
+        if( (b.x - a.x) * (s->y - a.y) - (b.y - a.y) * (s->x - a.x) < 0 )
         {
-            y1 = pymin;
-            x1 = (e->c - y1) / e->a;
+            jcv_point tmp = a;
+            a = b;
+            b = tmp;
         }
-        if( y2 > pymax )
+        a.x -= c.x; a.y -= c.y;
+        b.x -= c.x; b.y -= c.y;
+        jcv_real ha = a.x * n.x + a.y * n.y;
+        jcv_real hb = b.x * n.x + b.y * n.y;
+        if( ha <= 0 && hb <= 0 )
+            continue;
+        if( ha < 0 )
         {
-            y2 = pymax;
-            x2 = (e->c - y2) / e->a;
+            jcv_real t = ha / (ha - hb);
+            a.x += (b.x - a.x) * t;
+            a.y += (b.y - a.y) * t;
         }
-        else if( y2 < pymin )
+        else if( hb < 0 )
         {
-            y2 = pymin;
-            x2 = (e->c - y2) / e->a;
+            jcv_real t = ha / (ha - hb);
+            b.x = a.x + (b.x - a.x) * t;
+            b.y = a.y + (b.y - a.y) * t;
         }
+        area += a.x * b.y - a.y * b.x;
     }
+    return area;
+}
 
-    // Circle events assign the same vertex to all incident edges. Preserve
-    // that exact point when it is already inside the clipping box instead of
-    // projecting it independently onto each edge's rounded line equation.
-    if( s1_inside )
+static jcv_real jcv_interpolate_point(jcv_context_internal* internal, const jcv_real* values, const jcv_site* owner, const jcv_point* q)
+{
+    jcv_real fallback = values[owner->index];
+    if( !(q->x >= internal->rect.min.x && q->x <= internal->rect.max.x && q->y >= internal->rect.min.y && q->y <= internal->rect.max.y) )
+        return fallback;
+
+    // Breadth first over the sites that lose area to q, which are connected through their neighbours
+    int candidates[JCV_INTERPOLATE_MAX_CANDIDATES];
+    int numcandidates = 1;
+    candidates[0] = (int)(owner - internal->sites);
+    jcv_real weightsum = 0;
+    jcv_real valuesum = 0;
+    for( int i = 0; i < numcandidates; ++i )
     {
-        x1 = s1->x;
-        y1 = s1->y;
+        int index = candidates[i];
+        jcv_real weight = jcv_cell_stolen_area(internal, index, q);
+        if( !(weight > 0) )
+            continue;
+        weightsum += weight;
+        valuesum += weight * values[internal->sites[index].index];
+
+        jcv_edge_internal* const* end;
+        jcv_edge_internal* const* current = jcv_site_cell_edges(internal, index, &end);
+        for( ; current != end && numcandidates < JCV_INTERPOLATE_MAX_CANDIDATES; ++current )
+        {
+            const jcv_edge_internal* e = *current;
+            const jcv_site* neighbor = e->sites[0] == &internal->sites[index] ? e->sites[1] : e->sites[0];
+            if( !neighbor )
+                continue;
+            int neighborindex = (int)(neighbor - internal->sites);
+            int visited = 0;
+            for( int j = 0; j < numcandidates && !visited; ++j )
+                visited = candidates[j] == neighborindex;
+            if( !visited )
+                candidates[numcandidates++] = neighborindex;
+        }
     }
-    if( s2_inside )
+    return weightsum > 0 ? valuesum / weightsum : fallback;
+}
+
+void jcv_diagram_interpolate( const jcv_diagram* diagram, const jcv_real* values, int num_points, const jcv_point* points, jcv_real* results )
+{
+    jcv_context_internal* internal = diagram->internal;
+    if( !internal || !internal->site_grid )
+        return;
+    const jcv_site* owner = 0;
+    for( int i = 0; i < num_points; ++i )
     {
-        x2 = s2->x;
-        y2 = s2->y;
+        jcv_point p = internal->site_sources ? jcv_periodic_wrap_point(internal, points[i]) : points[i];
+        owner = jcv_find_site_internal(internal, &p, owner);
+        results[i] = jcv_interpolate_point(internal, values, owner, &p);
     }
+}
 
-    e->pos[0].x = x1;
-    e->pos[0].y = y1;
-    e->pos[1].x = x2;
-    e->pos[1].y = y2;
-
-    // If the two points are equal, the result is invalid
-    return (x1 == x2 && y1 == y2) ? 0 : 1;
-}
-
-// The line equation: ax + by + c = 0
-// see jcv_edge_create
-static int jcv_edge_clipline(jcv_context_internal* internal, jcv_edge_internal* e)
+void jcv_diagram_interpolate_image( const jcv_diagram* diagram, const jcv_real* values, const jcv_rect* area, int width, int height, int row_begin, int row_end, jcv_real* image )
 {
-    jcv_point previous_pos[2] = {e->pos[0], e->pos[1]};
-    int previous_vertices[2] = {e->vertices[0], e->vertices[1]};
-    jcv_edge clipped;
-    jcv_edge_copy(e, &clipped);
-    if( !internal->clipper.clip_fn(&internal->clipper, &clipped) )
-        return 0;
-    e->pos[0] = clipped.pos[0];
-    e->pos[1] = clipped.pos[1];
+    jcv_context_internal* internal = diagram->internal;
+    row_begin = row_begin < 0 ? 0 : row_begin;
+    row_end = row_end > height ? height : row_end;
+    if( !internal || !internal->site_grid || width <= 0 )
+        return;
 
-    for( int i = 0; i < 2; ++i )
+    jcv_point origin = area ? area->min : diagram->min;
+    jcv_point extent = area ? area->max : diagram->max;
+    jcv_point scale;
+    scale.x = (extent.x - origin.x) / (jcv_real)width;
+    scale.y = (extent.y - origin.y) / (jcv_real)height;
+
+    const jcv_site* owner = 0;
+    for( int r = row_begin; r < row_end; ++r )
     {
-        e->vertices[i] = JCV_INVALID_VERTEX;
-        for( int j = 0; j < 2; ++j )
+        jcv_real* row = image + (size_t)r * (size_t)width;
+        jcv_point p;
+        p.y = jcv_raster_center(origin.y, scale.y, r);
+        for( int c = 0; c < width; ++c )
         {
-            // Clipping may retain or reorder an existing endpoint. Only carry
-            // its identity across when the point itself was copied exactly.
-            if( previous_vertices[j] >= 0 &&
-                e->pos[i].x == previous_pos[j].x && e->pos[i].y == previous_pos[j].y )
-            {
-                e->vertices[i] = previous_vertices[j];
-                break;
-            }
+            p.x = jcv_raster_center(origin.x, scale.x, c);
+            jcv_point q = internal->site_sources ? jcv_periodic_wrap_point(internal, p) : p;
+            owner = jcv_find_site_internal(internal, &q, owner);
+            row[c] = jcv_interpolate_point(internal, values, owner, &q);
         }
-        if( e->vertices[i] < 0 )
-            e->vertices[i] = internal->numvertices++;
     }
-    return 1;
-}
-
-static jcv_edge_internal* jcv_edge_new(jcv_context_internal* internal, jcv_site* s1, jcv_site* s2)
-{
-    jcv_edge_internal* e = jcv_alloc_edge(internal);
-    jcv_edge_create(e, s1, s2);
-    return e;
-}
-
-
-// jcv_halfedge
-
-static void jcv_halfedge_link(jcv_halfedge* edge, jcv_halfedge* newedge)
-{
-    newedge->left = edge;
-    newedge->right = edge->right;
-    edge->right->left = newedge;
-    edge->right = newedge;
-}
-
-static inline void jcv_halfedge_unlink(jcv_halfedge* he)
-{
-    he->left->right = he->right;
-    he->right->left = he->left;
-    he->left  = 0;
-    he->right = 0;
 }
 
-static inline jcv_halfedge* jcv_halfedge_new(jcv_context_internal* internal, jcv_edge_internal* e, int direction)
+// The two sites of a Delaunay edge (with copies mapped to the sites inside the rect), or 0
+static inline int jcv_delaunay_edge_sites(const jcv_context_internal* internal, const jcv_edge_internal* e, int* a, int* b)
 {
-    jcv_halfedge* he = jcv_alloc_halfedge(internal);
-    he->edge        = e;
-    he->left        = 0;
-    he->right       = 0;
-    he->tree_parent = &internal->beachline_nil;
-    he->tree_left   = &internal->beachline_nil;
-    he->tree_right  = &internal->beachline_nil;
-    he->direction   = (uint32_t)direction;
-    he->tree_rank   = 0;
-    he->pqpos       = 0;
-    // These are set outside
-    //he->y
-    //he->vertex
-    return he;
+    if( !e->sites[0] || !e->sites[1] )
+        return 0;
+    if( !(internal->options & JCV_OPTION_DELAUNAY_ONLY) && jcv_point_eq(&e->pos[0], &e->pos[1]) )
+        return 0;
+    *a = jcv_site_source(internal, (int)(e->sites[0] - internal->sites));
+    *b = jcv_site_source(internal, (int)(e->sites[1] - internal->sites));
+    return *a != *b;
 }
 
-static void jcv_halfedge_delete(jcv_context_internal* internal, jcv_halfedge* he)
+// The squared distance between two sites, or between their nearest copies in a periodic diagram
+static inline jcv_real jcv_site_dist_sq(const jcv_context_internal* internal, const jcv_point* a, const jcv_point* b)
 {
-    he->right = internal->halfedgepool;
-    internal->halfedgepool = he;
+    jcv_real dx = b->x - a->x;
+    jcv_real dy = b->y - a->y;
+    if( internal->site_sources )
+    {
+        jcv_real width = internal->rect.max.x - internal->rect.min.x;
+        jcv_real height = internal->rect.max.y - internal->rect.min.y;
+        dx -= jcv_floor(dx / width + (jcv_real)0.5) * width;
+        dy -= jcv_floor(dy / height + (jcv_real)0.5) * height;
+    }
+    return dx*dx + dy*dy;
 }
 
-static inline jcv_site* jcv_halfedge_leftsite(const jcv_halfedge* he)
+// Sorts the values by their keys, 8 bits per pass, skipping the passes where all keys agree.
+// The passes swap between the buffers, and the one holding the result is returned.
+static int* jcv_radix_sort(uint64_t* keys, int* values, uint64_t* tmpkeys, int* tmpvalues, int count, int numbytes)
 {
-    return he->edge->sites[he->direction];
+    for( int shift = 0; shift < numbytes * 8; shift += 8 )
+    {
+        int offsets[256] = {0};
+        for( int i = 0; i < count; ++i )
+            ++offsets[(keys[i] >> shift) & 0xFF];
+        if( offsets[(keys[0] >> shift) & 0xFF] == count )
+            continue;
+        for( int i = 0, total = 0; i < 256; ++i )
+        {
+            int n = offsets[i];
+            offsets[i] = total;
+            total += n;
+        }
+        for( int i = 0; i < count; ++i )
+        {
+            int slot = offsets[(keys[i] >> shift) & 0xFF]++;
+            tmpkeys[slot] = keys[i];
+            tmpvalues[slot] = values[i];
+        }
+        uint64_t* swapkeys = keys;
+        keys = tmpkeys;
+        tmpkeys = swapkeys;
+        int* swapvalues = values;
+        values = tmpvalues;
+        tmpvalues = swapvalues;
+    }
+    return values;
 }
 
-static inline jcv_site* jcv_halfedge_rightsite(const jcv_halfedge* he)
+static int jcv_union_find_root(int* parents, int i)
 {
-    return he->edge ? he->edge->sites[1 - he->direction] : 0;
+    while( parents[i] != i )
+    {
+        parents[i] = parents[parents[i]];
+        i = parents[i];
+    }
+    return i;
 }
 
-static int jcv_halfedge_rightof(const jcv_halfedge* he, const jcv_point* p)
+int jcv_diagram_get_emst( const jcv_diagram* diagram, int* edges )
 {
-    const jcv_edge_internal* e = he->edge;
-    const jcv_site* topsite = e->sites[1];
-
-    int right_of_site = (p->x > topsite->p.x) ? 1 : 0;
-    if (right_of_site && he->direction == JCV_DIRECTION_LEFT)
-        return 1;
-    if (!right_of_site && he->direction == JCV_DIRECTION_RIGHT)
+    const jcv_context_internal* internal = diagram->internal;
+    int numsites = diagram->numsites;
+    int count = 0;
+    for( const jcv_edge_internal* e = internal->edges; e; e = e->next )
+    {
+        int a, b;
+        count += jcv_delaunay_edge_sites(internal, e, &a, &b);
+    }
+    if( count == 0 )
         return 0;
 
-    jcv_real dxp, dyp, dxs, t1, t2, t3, yl;
-
-    int above;
-    if (e->a == (jcv_real)1)
+    uint64_t* keys = (uint64_t*)internal->alloc(internal->memctx, sizeof(uint64_t) * 2 * (size_t)count);
+    int* pairs = (int*)internal->alloc(internal->memctx, sizeof(int) * (4 * (size_t)count + (size_t)numsites));
+    int* order = pairs + 2 * count;
+    int* parents = order + 2 * count;
+    int n = 0;
+    for( const jcv_edge_internal* e = internal->edges; e; e = e->next )
     {
-        dyp = p->y - topsite->p.y;
-        dxp = p->x - topsite->p.x;
-        int fast = 0;
-        if( (!right_of_site & (e->b < (jcv_real)0)) | (right_of_site & (e->b >= (jcv_real)0)) )
+        int a, b;
+        if( !jcv_delaunay_edge_sites(internal, e, &a, &b) )
+            continue;
+        // The squared lengths are non negative, so their bit patterns sort like the values
+        jcv_real length = jcv_point_dist_sq(&e->sites[0]->p, &e->sites[1]->p);
+        if( sizeof(jcv_real) == sizeof(uint32_t) )
         {
-            above = dyp >= e->b * dxp;
-            fast = above;
+            uint32_t bits;
+            memcpy(&bits, &length, sizeof(bits));
+            keys[n] = bits;
         }
         else
         {
-            above = (p->x + p->y * e->b) > e->c;
-            if (e->b < (jcv_real)0)
-                above = !above;
-            if (!above)
-                fast = 1;
+            memcpy(&keys[n], &length, sizeof(keys[n]));
         }
-        if (!fast)
+        pairs[n*2+0] = a;
+        pairs[n*2+1] = b;
+        order[n] = n;
+        ++n;
+    }
+    const int* sorted = jcv_radix_sort(keys, order, keys + count, order + count, count, (int)sizeof(jcv_real));
+
+    for( int i = 0; i < numsites; ++i )
+        parents[i] = i;
+    int numtree = 0;
+    for( int i = 0; i < count && numtree < numsites - 1; ++i )
+    {
+        int a = pairs[sorted[i]*2+0];
+        int b = pairs[sorted[i]*2+1];
+        int ra = jcv_union_find_root(parents, a);
+        int rb = jcv_union_find_root(parents, b);
+        if( ra == rb )
+            continue;
+        parents[ra] = rb;
+        edges[numtree*2+0] = a;
+        edges[numtree*2+1] = b;
+        ++numtree;
+    }
+    FJCVFreeFn freefn = internal->free;
+    freefn(internal->memctx, pairs);
+    freefn(internal->memctx, keys);
+    return numtree;
+}
+
+typedef struct jcv_knn_candidate_
+{
+    jcv_real    dist;
+    int         index;
+} jcv_knn_candidate;
+
+void jcv_diagram_get_knn( const jcv_diagram* diagram, int k, int* neighbors )
+{
+    const jcv_context_internal* internal = diagram->internal;
+    int numsites = diagram->numsites;
+    if( k <= 0 || numsites <= 0 )
+        return;
+
+    // The Delaunay neighbours of each site, as CSR arrays
+    int* offsets = (int*)internal->alloc(internal->memctx, sizeof(int) * (size_t)(numsites + 1) * 2);
+    int* stamps = offsets + numsites + 1;
+    memset(offsets, 0, sizeof(int) * (size_t)(numsites + 1));
+    int count = 0;
+    for( const jcv_edge_internal* e = internal->edges; e; e = e->next )
+    {
+        int a, b;
+        if( !jcv_delaunay_edge_sites(internal, e, &a, &b) )
+            continue;
+        ++offsets[a];
+        ++offsets[b];
+        count += 2;
+    }
+    for( int i = 0, total = 0; i <= numsites; ++i )
+    {
+        int n = offsets[i];
+        offsets[i] = total;
+        total += n;
+    }
+    int* adjacency = (int*)internal->alloc(internal->memctx, sizeof(int) * (size_t)(count > 0 ? count : 1));
+    for( const jcv_edge_internal* e = internal->edges; e; e = e->next )
+    {
+        int a, b;
+        if( !jcv_delaunay_edge_sites(internal, e, &a, &b) )
+            continue;
+        adjacency[offsets[a]++] = b;
+        adjacency[offsets[b]++] = a;
+    }
+    for( int i = numsites; i > 0; --i )
+        offsets[i] = offsets[i-1];
+    offsets[0] = 0;
+
+    // Each site's next nearest neighbour is a Delaunay neighbour of the site or of one of its
+    // nearer neighbours, so the search pops the nearest candidate and pushes its neighbours
+    jcv_knn_candidate* heap = (jcv_knn_candidate*)internal->alloc(internal->memctx, sizeof(jcv_knn_candidate) * (size_t)numsites);
+    for( int i = 0; i < numsites; ++i )
+        stamps[i] = -1;
+    const jcv_site* sites = internal->sites;
+    for( int i = 0; i < numsites; ++i )
+    {
+        int* out = neighbors + (size_t)i * (size_t)k;
+        int numout = 0;
+        int numheap = 0;
+        int current = i;
+        stamps[i] = i;
+        while( numout < k )
         {
-            dxs = topsite->p.x - e->sites[0]->p.x;
-            above = e->b * (dxp * dxp - dyp * dyp)
-                    < dxs * dyp * ((jcv_real)1 + (jcv_real)2 * dxp / dxs + e->b * e->b);
-            if (e->b < (jcv_real)0)
-                above = !above;
+            for( int n = offsets[current]; n < offsets[current+1]; ++n )
+            {
+                int neighbor = adjacency[n];
+                if( stamps[neighbor] == i )
+                    continue;
+                stamps[neighbor] = i;
+                jcv_knn_candidate candidate;
+                candidate.dist = jcv_site_dist_sq(internal, &sites[i].p, &sites[neighbor].p);
+                candidate.index = neighbor;
+                int pos = numheap++;
+                while( pos > 0 && heap[(pos - 1) / 2].dist > candidate.dist )
+                {
+                    heap[pos] = heap[(pos - 1) / 2];
+                    pos = (pos - 1) / 2;
+                }
+                heap[pos] = candidate;
+            }
+            if( numheap == 0 )
+                break;
+
+            current = heap[0].index;
+            out[numout++] = current;
+            jcv_knn_candidate last = heap[--numheap];
+            int pos = 0;
+            for(;;)
+            {
+                int child = pos * 2 + 1;
+                if( child >= numheap )
+                    break;
+                if( child + 1 < numheap && heap[child + 1].dist < heap[child].dist )
+                    ++child;
+                if( !(heap[child].dist < last.dist) )
+                    break;
+                heap[pos] = heap[child];
+                pos = child;
+            }
+            if( numheap > 0 )
+                heap[pos] = last;
         }
+        for( ; numout < k; ++numout )
+            out[numout] = -1;
     }
-    else // e->b == 1
+    FJCVFreeFn freefn = internal->free;
+    freefn(internal->memctx, heap);
+    freefn(internal->memctx, adjacency);
+    freefn(internal->memctx, offsets);
+}
+
+static void* jcv_alloc(jcv_context_internal* internal, size_t size)
+{
+    if( !internal->memblocks || internal->memblocks->sizefree < (size+sizeof(void*)) )
     {
-        yl = e->c - e->a * p->x;
-        t1 = p->y - yl;
-        t2 = p->x - topsite->p.x;
-        t3 = yl - topsite->p.y;
-        above = t1 * t1 > (t2 * t2 + t3 * t3);
+        size_t blocksize = 16 * 1024;
+        size_t required = sizeof(jcv_memoryblock) + size + sizeof(void*);
+        if( blocksize < required )
+            blocksize = required;
+        jcv_memoryblock* block = (jcv_memoryblock*)internal->alloc( internal->memctx, blocksize );
+        size_t offset = sizeof(jcv_memoryblock);
+        block->sizefree = blocksize - offset;
+        block->next = internal->memblocks;
+        block->memory = ((char*)block) + offset;
+        internal->memblocks = block;
     }
-    return (he->direction == JCV_DIRECTION_LEFT ? above : !above);
+    void* p_raw = internal->memblocks->memory;
+    void* p_aligned = jcv_align(p_raw, sizeof(void*));
+    size += (uintptr_t)p_aligned - (uintptr_t)p_raw;
+    internal->memblocks->memory += size;
+    internal->memblocks->sizefree -= size;
+    return p_aligned;
 }
 
-// The linked beachline provides constant-time neighboring halfedges. The
-// rank-balanced RAVL tree indexes that order so a site's predecessor can
-// be found in logarithmic time.
-static void jcv_beachline_init(jcv_context_internal* internal)
+static jcv_edge_internal* jcv_alloc_edge(jcv_context_internal* internal)
 {
-    jcv_halfedge* sentinel = &internal->beachline_nil;
-    memset(sentinel, 0, sizeof(*sentinel));
-    sentinel->tree_parent = sentinel;
-    sentinel->tree_left = sentinel;
-    sentinel->tree_right = sentinel;
-    sentinel->tree_rank = 0;
-    internal->beachline_root = sentinel;
+    return (jcv_edge_internal*)jcv_alloc(internal, sizeof(jcv_edge_internal));
 }
 
-static void jcv_tree_rotate_left(jcv_context_internal* internal, jcv_halfedge* node)
+// The free half edges are linked through tree_parent
+static jcv_halfedge* jcv_alloc_halfedge(jcv_context_internal* internal)
 {
-    jcv_halfedge* sentinel = &internal->beachline_nil;
-    jcv_halfedge* child = node->tree_right;
-    node->tree_right = child->tree_left;
-    if (child->tree_left != sentinel)
-        child->tree_left->tree_parent = node;
-    child->tree_parent = node->tree_parent;
-    if (node->tree_parent == sentinel)
-        internal->beachline_root = child;
-    else if (node == node->tree_parent->tree_left)
-        node->tree_parent->tree_left = child;
-    else
-        node->tree_parent->tree_right = child;
-    child->tree_left = node;
-    node->tree_parent = child;
+    if( !internal->halfedgepool )
+    {
+        // Aligned to a cache line, which a node fits in on 64 bit platforms
+        char* mem = (char*)jcv_alloc(internal, sizeof(jcv_halfedge) * JCV_HALFEDGE_POOL_CHUNK + 64);
+        jcv_halfedge* hot = (jcv_halfedge*)jcv_align(mem, 64);
+        jcv_halfedge_event* cold = (jcv_halfedge_event*)jcv_alloc(internal, sizeof(jcv_halfedge_event) * JCV_HALFEDGE_POOL_CHUNK);
+        for( int i = 0; i < JCV_HALFEDGE_POOL_CHUNK; ++i )
+        {
+            hot[i].event = &cold[i];
+            cold[i].he = &hot[i];
+            hot[i].tree_parent = i + 1 < JCV_HALFEDGE_POOL_CHUNK ? &hot[i + 1] : 0;
+        }
+        internal->halfedgepool = hot;
+    }
+
+    jcv_halfedge* edge = internal->halfedgepool;
+    internal->halfedgepool = edge->tree_parent;
+    return edge;
 }
 
-static void jcv_tree_rotate_right(jcv_context_internal* internal, jcv_halfedge* node)
+static void* jcv_temp_alloc(jcv_context_internal* internal, size_t size)
 {
-    jcv_halfedge* sentinel = &internal->beachline_nil;
-    jcv_halfedge* child = node->tree_left;
-    node->tree_left = child->tree_right;
-    if (child->tree_right != sentinel)
-        child->tree_right->tree_parent = node;
-    child->tree_parent = node->tree_parent;
-    if (node->tree_parent == sentinel)
-        internal->beachline_root = child;
-    else if (node == node->tree_parent->tree_right)
-        node->tree_parent->tree_right = child;
-    else
-        node->tree_parent->tree_left = child;
-    child->tree_right = node;
-    node->tree_parent = child;
+    if( !internal->tempmemblocks || internal->tempmemblocks->sizefree < (size+sizeof(void*)) )
+    {
+        size_t blocksize = 16 * 1024;
+        size_t required = sizeof(jcv_memoryblock) + size + sizeof(void*);
+        if( blocksize < required )
+            blocksize = required;
+        jcv_memoryblock* block = (jcv_memoryblock*)internal->alloc(internal->memctx, blocksize);
+        size_t offset = sizeof(jcv_memoryblock);
+        block->sizefree = blocksize - offset;
+        block->next = internal->tempmemblocks;
+        block->memory = ((char*)block) + offset;
+        internal->tempmemblocks = block;
+    }
+    void* p_raw = internal->tempmemblocks->memory;
+    void* p_aligned = jcv_align(p_raw, sizeof(void*));
+    size += (uintptr_t)p_aligned - (uintptr_t)p_raw;
+    internal->tempmemblocks->memory += size;
+    internal->tempmemblocks->sizefree -= size;
+    return p_aligned;
 }
 
-static jcv_halfedge* jcv_tree_minimum(jcv_context_internal* internal, jcv_halfedge* node)
+static jcv_graphedge* jcv_alloc_graphedge(jcv_context_internal* internal)
 {
-    jcv_halfedge* sentinel = &internal->beachline_nil;
-    while (node->tree_left != sentinel)
-        node = node->tree_left;
-    return node;
+    return (jcv_graphedge*)jcv_temp_alloc(internal, sizeof(jcv_graphedge));
 }
 
-static void jcv_tree_transplant(jcv_context_internal* internal, jcv_halfedge* oldnode, jcv_halfedge* newnode)
+static void jcv_temp_free_all(jcv_context_internal* internal)
 {
-    jcv_halfedge* sentinel = &internal->beachline_nil;
-    if (oldnode->tree_parent == sentinel)
-        internal->beachline_root = newnode;
-    else if (oldnode == oldnode->tree_parent->tree_left)
-        oldnode->tree_parent->tree_left = newnode;
-    else
-        oldnode->tree_parent->tree_right = newnode;
-    newnode->tree_parent = oldnode->tree_parent;
+    FJCVFreeFn freefn = internal->free;
+    while( internal->tempmemblocks )
+    {
+        jcv_memoryblock* block = internal->tempmemblocks;
+        internal->tempmemblocks = block->next;
+        freefn(internal->memctx, block);
+    }
 }
 
-static int jcv_ravl_rank(const jcv_halfedge* node, const jcv_halfedge* sentinel)
+static void jcv_reserve_vertices(jcv_context_internal* internal, int capacity)
 {
-    return node == sentinel ? -1 : (int)node->tree_rank;
+    if( capacity <= internal->vertexcapacity )
+        return;
+    jcv_point* vertices = (jcv_point*)internal->alloc(internal->memctx, sizeof(jcv_point) * (size_t)capacity);
+    if( internal->vertices )
+    {
+        memcpy(vertices, internal->vertices, sizeof(jcv_point) * (size_t)internal->numvertices);
+        FJCVFreeFn freefn = internal->free;
+        freefn(internal->memctx, internal->vertices);
+    }
+    internal->vertices = vertices;
+    internal->vertexcapacity = capacity;
 }
 
-// RAVL insertion is rank-balanced like AVL insertion, but deletion is relaxed.
+// Stores the position of a new unique vertex, and returns its index
+static inline int jcv_add_vertex(jcv_context_internal* internal, const jcv_point* p)
+{
+    if( internal->numvertices == internal->vertexcapacity )
+        jcv_reserve_vertices(internal, internal->vertexcapacity > 0 ? internal->vertexcapacity * 2 : 64);
+    internal->vertices[internal->numvertices] = *p;
+    return internal->numvertices++;
+}
+
+static void* jcv_alloc_fn(void* memctx, size_t size)
+{
+    (void)memctx;
+    return malloc(size);
+}
+
+static void jcv_free_fn(void* memctx, void* p)
+{
+    (void)memctx;
+    free(p);
+}
+
+// jcv_edge
+
+static inline int jcv_is_valid(const jcv_point* p)
+{
+    return (p->x != JCV_INVALID_VALUE || p->y != JCV_INVALID_VALUE) ? 1 : 0;
+}
+
+// The bisector of the two sites, as the line a * x + b * y = c (stored as {a, b, c}), where a or b is 1
+static void jcv_bisector(const jcv_site* s1, const jcv_site* s2, jcv_calc_real* line)
+{
+    // Create line equation between S1 and S2:
+    // jcv_real a = -1 * (s2->p.y - s1->p.y);
+    // jcv_real b = s2->p.x - s1->p.x;
+    // //jcv_real c = -1 * (s2->p.x - s1->p.x) * s1->p.y + (s2->p.y - s1->p.y) * s1->p.x;
+    //
+    // // create perpendicular line
+    // jcv_real pa = b;
+    // jcv_real pb = -a;
+    // //jcv_real pc = pa * s1->p.x + pb * s1->p.y;
+    //
+    // // Move to the mid point
+    // jcv_real mx = s1->p.x + dx * jcv_real(0.5);
+    // jcv_real my = s1->p.y + dy * jcv_real(0.5);
+    // jcv_real pc = ( pa * mx + pb * my );
+
+    jcv_calc_real dx = (jcv_calc_real)s2->p.x - (jcv_calc_real)s1->p.x;
+    jcv_calc_real dy = (jcv_calc_real)s2->p.y - (jcv_calc_real)s1->p.y;
+    int dx_is_larger = (dx*dx) > (dy*dy); // instead of fabs
+
+    // Simplify it, using dx and dy
+    line[2] = dx * ((jcv_calc_real)s1->p.x + dx * (jcv_calc_real)0.5) + dy * ((jcv_calc_real)s1->p.y + dy * (jcv_calc_real)0.5);
+
+    if( dx_is_larger )
+    {
+        line[0] = (jcv_calc_real)1;
+        line[1] = dy / dx;
+        line[2] /= dx;
+    }
+    else
+    {
+        line[0] = dx / dy;
+        line[1] = (jcv_calc_real)1;
+        line[2] /= dy;
+    }
+}
+
+static void jcv_edge_create(jcv_edge_internal* e, jcv_site* s1, jcv_site* s2)
+{
+    e->next = 0;
+    e->sites[0] = s1;
+    e->sites[1] = s2;
+    e->pos[0].x = JCV_INVALID_VALUE;
+    e->pos[0].y = JCV_INVALID_VALUE;
+    e->pos[1].x = JCV_INVALID_VALUE;
+    e->pos[1].y = JCV_INVALID_VALUE;
+    e->vertices[0] = JCV_INVALID_VERTEX;
+    e->vertices[1] = JCV_INVALID_VERTEX;
+
+    jcv_calc_real line[3];
+    jcv_bisector(s1, s2, line);
+    e->a = (jcv_real)line[0];
+    e->b = (jcv_real)line[1];
+    e->c = (jcv_real)line[2];
+}
+
+// CLIPPING
+int jcv_boxshape_test(const jcv_clipper* clipper, const jcv_point p)
+{
+    return p.x >= clipper->min.x && p.x <= clipper->max.x &&
+           p.y >= clipper->min.y && p.y <= clipper->max.y;
+}
+
+// The line equation: ax + by + c = 0
+// see jcv_edge_create
+int jcv_boxshape_clip(const jcv_clipper* clipper, jcv_edge* e)
+{
+    jcv_real pxmin = clipper->min.x;
+    jcv_real pxmax = clipper->max.x;
+    jcv_real pymin = clipper->min.y;
+    jcv_real pymax = clipper->max.y;
+
+    jcv_real x1, y1, x2, y2;
+    jcv_point* s1;
+    jcv_point* s2;
+    if (e->a == (jcv_real)1 && e->b >= (jcv_real)0)
+    {
+        s1 = jcv_is_valid(&e->pos[1]) ? &e->pos[1] : 0;
+        s2 = jcv_is_valid(&e->pos[0]) ? &e->pos[0] : 0;
+    }
+    else
+    {
+        s1 = jcv_is_valid(&e->pos[0]) ? &e->pos[0] : 0;
+        s2 = jcv_is_valid(&e->pos[1]) ? &e->pos[1] : 0;
+    }
+    int s1_inside = s1 != 0 && jcv_boxshape_test(clipper, *s1);
+    int s2_inside = s2 != 0 && jcv_boxshape_test(clipper, *s2);
+
+    if (e->a == (jcv_real)1) // delta x is larger
+    {
+        y1 = pymin;
+        if (s1 != 0 && s1->y > pymin)
+        {
+            y1 = s1->y;
+        }
+        if( y1 > pymax )
+        {
+            y1 = pymax;
+        }
+        x1 = e->c - e->b * y1;
+        y2 = pymax;
+        if (s2 != 0 && s2->y < pymax)
+            y2 = s2->y;
+
+        if( y2 < pymin )
+        {
+            y2 = pymin;
+        }
+        x2 = (e->c) - (e->b) * y2;
+        // Never occurs according to lcov
+        // if( ((x1 > pxmax) & (x2 > pxmax)) | ((x1 < pxmin) & (x2 < pxmin)) )
+        // {
+        //     return 0;
+        // }
+        if (x1 > pxmax)
+        {
+            x1 = pxmax;
+            y1 = (e->c - x1) / e->b;
+        }
+        else if (x1 < pxmin)
+        {
+            x1 = pxmin;
+            y1 = (e->c - x1) / e->b;
+        }
+        if (x2 > pxmax)
+        {
+            x2 = pxmax;
+            y2 = (e->c - x2) / e->b;
+        }
+        else if (x2 < pxmin)
+        {
+            x2 = pxmin;
+            y2 = (e->c - x2) / e->b;
+        }
+    }
+    else // delta y is larger
+    {
+        x1 = pxmin;
+        if( s1 != 0 && s1->x > pxmin )
+            x1 = s1->x;
+        if( x1 > pxmax )
+        {
+            x1 = pxmax;
+        }
+        y1 = e->c - e->a * x1;
+        x2 = pxmax;
+        if( s2 != 0 && s2->x < pxmax )
+            x2 = s2->x;
+        if( x2 < pxmin )
+        {
+            x2 = pxmin;
+        }
+        y2 = e->c - e->a * x2;
+        // Never occurs according to lcov
+        // if( ((y1 > pymax) & (y2 > pymax)) | ((y1 < pymin) & (y2 < pymin)) )
+        // {
+        //     return 0;
+        // }
+        if( y1 > pymax )
+        {
+            y1 = pymax;
+            x1 = (e->c - y1) / e->a;
+        }
+        else if( y1 < pymin )
+        {
+            y1 = pymin;
+            x1 = (e->c - y1) / e->a;
+        }
+        if( y2 > pymax )
+        {
+            y2 = pymax;
+            x2 = (e->c - y2) / e->a;
+        }
+        else if( y2 < pymin )
+        {
+            y2 = pymin;
+            x2 = (e->c - y2) / e->a;
+        }
+    }
+
+    // Circle events assign the same vertex to all incident edges. Preserve
+    // that exact point when it is already inside the clipping box instead of
+    // projecting it independently onto each edge's rounded line equation.
+    if( s1_inside )
+    {
+        x1 = s1->x;
+        y1 = s1->y;
+    }
+    if( s2_inside )
+    {
+        x2 = s2->x;
+        y2 = s2->y;
+    }
+
+    e->pos[0].x = x1;
+    e->pos[0].y = y1;
+    e->pos[1].x = x2;
+    e->pos[1].y = y2;
+
+    // If the two points are equal, the result is invalid
+    return (x1 == x2 && y1 == y2) ? 0 : 1;
+}
+
+// The line equation: ax + by + c = 0
+// see jcv_edge_create
+static int jcv_edge_clipline(jcv_context_internal* internal, jcv_edge_internal* e)
+{
+    jcv_point previous_pos[2] = {e->pos[0], e->pos[1]};
+    int previous_vertices[2] = {e->vertices[0], e->vertices[1]};
+    jcv_edge clipped;
+    jcv_edge_copy(e, &clipped);
+    if( !internal->clipper.clip_fn(&internal->clipper, &clipped) )
+        return 0;
+    e->pos[0] = clipped.pos[0];
+    e->pos[1] = clipped.pos[1];
+
+    for( int i = 0; i < 2; ++i )
+    {
+        e->vertices[i] = JCV_INVALID_VERTEX;
+        for( int j = 0; j < 2; ++j )
+        {
+            // Clipping may retain or reorder an existing endpoint. Only carry
+            // its identity across when the point itself was copied exactly.
+            if( previous_vertices[j] >= 0 &&
+                e->pos[i].x == previous_pos[j].x && e->pos[i].y == previous_pos[j].y )
+            {
+                e->vertices[i] = previous_vertices[j];
+                break;
+            }
+        }
+        if( e->vertices[i] < 0 )
+            e->vertices[i] = jcv_add_vertex(internal, &e->pos[i]);
+    }
+    return 1;
+}
+
+static jcv_edge_internal* jcv_edge_new(jcv_context_internal* internal, jcv_site* s1, jcv_site* s2)
+{
+    jcv_edge_internal* e = jcv_alloc_edge(internal);
+    jcv_edge_create(e, s1, s2);
+    return e;
+}
+
+
+// jcv_halfedge
+
+static void jcv_halfedge_link(jcv_halfedge* edge, jcv_halfedge* newedge)
+{
+    newedge->left = edge;
+    newedge->right = edge->right;
+    edge->right->left = newedge;
+    edge->right = newedge;
+}
+
+static inline void jcv_halfedge_unlink(jcv_halfedge* he)
+{
+    he->left->right = he->right;
+    he->right->left = he->left;
+    he->left  = 0;
+    he->right = 0;
+}
+
+static inline jcv_halfedge* jcv_halfedge_new(jcv_context_internal* internal, jcv_edge_internal* e, int direction)
+{
+    jcv_halfedge* he = jcv_alloc_halfedge(internal);
+    he->edge        = e;
+    he->left        = 0;
+    he->right       = 0;
+    he->tree_parent = &internal->beachline_nil;
+    he->tree_left   = &internal->beachline_nil;
+    he->tree_right  = &internal->beachline_nil;
+    he->direction   = (uint32_t)direction;
+    he->tree_rank   = 0;
+    he->event->pqpos = 0;
+    // These are set outside
+    //he->event->y
+    //he->event->vertex
+    return he;
+}
+
+static void jcv_halfedge_delete(jcv_context_internal* internal, jcv_halfedge* he)
+{
+    if( internal->beachline_hint == he )
+        internal->beachline_hint = 0;
+    he->tree_parent = internal->halfedgepool;
+    internal->halfedgepool = he;
+}
+
+// Geometric predicates
+//
+// The sweep decides where a site enters the beachline and which arcs collapse from the input sites alone,
+// so that rounding in the constructed edges and vertices cannot change those decisions.
+// Each predicate is first evaluated in double precision and its sign is used when it is larger than
+// the rounding error bound. Otherwise it is evaluated exactly, with floating point expansions
+// (J. R. Shewchuk, "Adaptive Precision Floating-Point Arithmetic and Fast Robust Geometric Predicates").
+
+// Bounds on the relative rounding error of the double precision evaluations, with e = 2^-53.
+// Orientation: Shewchuk's (3 + 16e)e. Tangent circles: the differences, the squares, their sum, the product
+// with dy and the final difference each round once, which is at most 7e (7.8e-16) relative to |ta| + |tb|,
+// and 1.0e-15 leaves room for the higher order terms
+#define JCV_ORIENT_ERRBOUND     3.3306690738754716e-16
+#define JCV_RIGHTOF_ERRBOUND    1.0e-15
+
+static inline void jcv_exact_two_sum(double a, double b, double* x, double* y)
+{
+    *x = a + b;
+    double bv = *x - a;
+    double av = *x - bv;
+    *y = (a - av) + (b - bv);
+}
+
+// Splits a into two halves of 26 bits, whose products are exact (Dekker)
+static inline void jcv_exact_split(double a, double* hi, double* lo)
+{
+    double c = 134217729.0 * a; // 2^27 + 1
+    double big = c - a;
+    *hi = c - big;
+    *lo = a - *hi;
+}
+
+static inline void jcv_exact_two_product(double a, double b, double* x, double* y)
+{
+    *x = a * b;
+#if defined(FP_FAST_FMA)
+    // The compiler may contract the split's expressions where fma is fast, so it's used directly
+    *y = JCV_FMA(a, b, -*x);
+#else
+    double ahi, alo, bhi, blo;
+    jcv_exact_split(a, &ahi, &alo);
+    jcv_exact_split(b, &bhi, &blo);
+    double err = *x - ahi * bhi;
+    err -= alo * bhi;
+    err -= ahi * blo;
+    *y = alo * blo - err;
+#endif
+}
+
+// Stores the exact difference a - b as an expansion of two components, and returns its length
+static inline int jcv_exact_diff(double a, double b, double* h)
+{
+    jcv_exact_two_sum(a, -b, &h[1], &h[0]);
+    return 2;
+}
+
+// h = e + b. The expansions hold nonoverlapping components of increasing magnitude, and zeros are left out.
+// h may be the same array as e
+static int jcv_exact_grow(int elen, const double* e, double b, double* h)
+{
+    int hlen = 0;
+    double q = b;
+    for( int i = 0; i < elen; ++i )
+    {
+        double err;
+        jcv_exact_two_sum(q, e[i], &q, &err);
+        if( err != 0 )
+            h[hlen++] = err;
+    }
+    if( q != 0 || hlen == 0 )
+        h[hlen++] = q;
+    return hlen;
+}
+
+// h = e + f, where h may be the same array as e, and has room for elen + flen components
+static int jcv_exact_sum(int elen, const double* e, int flen, const double* f, double* h)
+{
+    for( int i = 0; i < elen; ++i )
+        h[i] = e[i];
+    int hlen = elen;
+    for( int i = 0; i < flen; ++i )
+        hlen = jcv_exact_grow(hlen, h, f[i], h);
+    return hlen;
+}
+
+// h = e * b, where h has room for 2 * elen components
+static int jcv_exact_scale(int elen, const double* e, double b, double* h)
+{
+    int hlen = 0;
+    double q, err;
+    jcv_exact_two_product(e[0], b, &q, &err);
+    if( err != 0 )
+        h[hlen++] = err;
+    for( int i = 1; i < elen; ++i )
+    {
+        double product, product_err, sum;
+        jcv_exact_two_product(e[i], b, &product, &product_err);
+        jcv_exact_two_sum(q, product_err, &sum, &err);
+        if( err != 0 )
+            h[hlen++] = err;
+        jcv_exact_two_sum(product, sum, &q, &err);
+        if( err != 0 )
+            h[hlen++] = err;
+    }
+    if( q != 0 || hlen == 0 )
+        h[hlen++] = q;
+    return hlen;
+}
+
+// h = e * f, where h has room for 2 * elen * flen components
+static int jcv_exact_mul(int elen, const double* e, int flen, const double* f, double* h)
+{
+    double scaled[32];
+    int hlen = jcv_exact_scale(elen, e, f[0], h);
+    for( int i = 1; i < flen; ++i )
+    {
+        int scaledlen = jcv_exact_scale(elen, e, f[i], scaled);
+        hlen = jcv_exact_sum(hlen, h, scaledlen, scaled, h);
+    }
+    return hlen;
+}
+
+// The largest component has the sign of the expansion, and is within one ulp of its value
+static inline double jcv_exact_estimate(int elen, const double* e)
+{
+    return e[elen - 1];
+}
+
+// Twice the signed area of the triangle abc (positive if counter clockwise)
+static double jcv_orient(const jcv_point* a, const jcv_point* b, const jcv_point* c)
+{
+    double detleft  = ((double)b->x - (double)a->x) * ((double)c->y - (double)a->y);
+    double detright = ((double)b->y - (double)a->y) * ((double)c->x - (double)a->x);
+    double det = detleft - detright;
+    if( jcv_abs_double(det) > JCV_ORIENT_ERRBOUND * (jcv_abs_double(detleft) + jcv_abs_double(detright)) )
+        return det;
+
+    double bax[2], cay[2], bay[2], cax[2], left[8], right[8], h[16];
+    jcv_exact_diff(b->x, a->x, bax);
+    jcv_exact_diff(c->y, a->y, cay);
+    jcv_exact_diff(b->y, a->y, bay);
+    jcv_exact_diff(c->x, a->x, cax);
+    int leftlen = jcv_exact_mul(2, bax, 2, cay, left);
+    int rightlen = jcv_exact_mul(2, bay, 2, cax, right);
+    for( int i = 0; i < rightlen; ++i )
+        right[i] = -right[i];
+    return jcv_exact_estimate(jcv_exact_sum(leftlen, left, rightlen, right, h), h);
+}
+
+// Stores |p - s|^2 * (p.y - t.y) exactly in h (with room for 64 components), or |p - s|^2 if t is 0
+static int jcv_exact_tangent_circle(const jcv_point* p, const jcv_point* s, const jcv_point* t, double* h)
+{
+    double dx[2], dy[2], dyt[2], dx2[8], dy2[8], dist[16];
+    jcv_exact_diff(p->x, s->x, dx);
+    jcv_exact_diff(p->y, s->y, dy);
+    int dx2len = jcv_exact_mul(2, dx, 2, dx, dx2);
+    int dy2len = jcv_exact_mul(2, dy, 2, dy, dy2);
+    if( !t )
+        return jcv_exact_sum(dx2len, dx2, dy2len, dy2, h);
+    int distlen = jcv_exact_sum(dx2len, dx2, dy2len, dy2, dist);
+    jcv_exact_diff(p->y, t->y, dyt);
+    return jcv_exact_mul(distlen, dist, 2, dyt, h);
+}
+
+// The circle through site s that touches the sweepline at p (with p.y >= s.y) has the diameter
+// |p - s|^2 / (p.y - s.y). The site with the smaller circle owns the beachline at p.
+// Returns a negative value if that is site a, positive if it is site b, and zero if p is on their breakpoint.
+static double jcv_compare_tangent_circles(const jcv_point* p, const jcv_point* a, const jcv_point* b)
+{
+    double dxa = (double)p->x - (double)a->x;
+    double dya = (double)p->y - (double)a->y;
+    double dxb = (double)p->x - (double)b->x;
+    double dyb = (double)p->y - (double)b->y;
+    // Both circles are infinite if the sites are on the sweepline, and then the closer site owns p
+    int onsweepline = dya == 0 && dyb == 0;
+    double ta = (dxa * dxa + dya * dya) * (onsweepline ? 1 : dyb);
+    double tb = (dxb * dxb + dyb * dyb) * (onsweepline ? 1 : dya);
+    double det = ta - tb;
+    if( jcv_abs_double(det) > JCV_RIGHTOF_ERRBOUND * (jcv_abs_double(ta) + jcv_abs_double(tb)) )
+        return det;
+
+    double left[64], right[64], h[128];
+    int leftlen = jcv_exact_tangent_circle(p, a, onsweepline ? 0 : b, left);
+    int rightlen = jcv_exact_tangent_circle(p, b, onsweepline ? 0 : a, right);
+    for( int i = 0; i < rightlen; ++i )
+        right[i] = -right[i];
+    return jcv_exact_estimate(jcv_exact_sum(leftlen, left, rightlen, right, h), h);
+}
+
+// Returns n / d rounded to the nearest double, with halfway cases rounded upwards. d must be positive.
+// The quotient of the estimates is within a few ulps, and is moved until it is between the midpoints to its neighbours.
+static double jcv_exact_divide(int nlen, const double* n, int dlen, const double* d)
+{
+    double q = jcv_exact_estimate(nlen, n) / jcv_exact_estimate(dlen, d);
+    double scaled[32], r[192], h[224];
+    while( q != 0 && q - q == 0 )
+    {
+        double up = nextafter(q, HUGE_VAL);
+        double down = nextafter(q, -HUGE_VAL);
+        int rlen = jcv_exact_sum(nlen, n, jcv_exact_scale(dlen, d, -q, scaled), scaled, r);
+        // The residual n - m * d at the midpoint m towards each neighbour
+        int hlen = jcv_exact_sum(rlen, r, jcv_exact_scale(dlen, d, (q - up) * 0.5, scaled), scaled, h);
+        if( jcv_exact_estimate(hlen, h) >= 0 )
+        {
+            q = up;
+            continue;
+        }
+        hlen = jcv_exact_sum(rlen, r, jcv_exact_scale(dlen, d, (q - down) * 0.5, scaled), scaled, h);
+        if( jcv_exact_estimate(hlen, h) < 0 )
+        {
+            q = down;
+            continue;
+        }
+        break;
+    }
+    return q;
+}
+
+// Returns ax + (e * f - g * k) / d, where e and g have 16 components, f and k have 2, and d has 16
+static double jcv_exact_center_coord(double ax, const double* e, int elen, const double* f, const double* g, int glen, const double* k, int dlen, const double* d)
+{
+    double left[64], right[64], offset[32], n[160];
+    int leftlen = jcv_exact_mul(elen, e, 2, f, left);
+    int rightlen = jcv_exact_mul(glen, g, 2, k, right);
+    for( int i = 0; i < rightlen; ++i )
+        right[i] = -right[i];
+    int nlen = jcv_exact_sum(leftlen, left, rightlen, right, n);
+    nlen = jcv_exact_sum(nlen, n, jcv_exact_scale(dlen, d, ax, offset), offset, n);
+    return jcv_exact_divide(nlen, n, dlen, d);
+}
+
+// The circumcentre of the counter clockwise sites a, b and c, computed exactly and rounded to the nearest double.
+// Every triple of sites on the same circle gives the same centre
+static void jcv_exact_circumcenter(const jcv_point* a, const jcv_point* b, const jcv_point* c, double* out)
+{
+    double bx[2], by[2], cx[2], cy[2], t0[8], t1[8], b2[16], c2[16], d[16];
+    jcv_exact_diff(b->x, a->x, bx);
+    jcv_exact_diff(b->y, a->y, by);
+    jcv_exact_diff(c->x, a->x, cx);
+    jcv_exact_diff(c->y, a->y, cy);
+    int b2len = jcv_exact_sum(jcv_exact_mul(2, bx, 2, bx, t0), t0, jcv_exact_mul(2, by, 2, by, t1), t1, b2);
+    int c2len = jcv_exact_sum(jcv_exact_mul(2, cx, 2, cx, t0), t0, jcv_exact_mul(2, cy, 2, cy, t1), t1, c2);
+
+    // d = 2 * orient(a, b, c), which is positive
+    int t0len = jcv_exact_mul(2, bx, 2, cy, t0);
+    int t1len = jcv_exact_mul(2, by, 2, cx, t1);
+    for( int i = 0; i < t1len; ++i )
+        t1[i] = -t1[i];
+    int dlen = jcv_exact_sum(t0len, t0, t1len, t1, d);
+    for( int i = 0; i < dlen; ++i )
+        d[i] *= 2;
+
+    out[0] = jcv_exact_center_coord(a->x, b2, b2len, cy, c2, c2len, by, dlen, d);
+    out[1] = jcv_exact_center_coord(a->y, c2, c2len, bx, b2, b2len, cx, dlen, d);
+}
+
+static inline jcv_site* jcv_halfedge_leftsite(const jcv_halfedge* he)
+{
+    return he->edge->sites[he->direction];
+}
+
+static inline jcv_site* jcv_halfedge_rightsite(const jcv_halfedge* he)
+{
+    return he->edge ? he->edge->sites[1 - he->direction] : 0;
+}
+
+static int jcv_halfedge_rightof(const jcv_halfedge* he, const jcv_point* p)
+{
+    const jcv_edge_internal* e = he->edge;
+    const jcv_site* topsite = e->sites[1];
+
+    int right_of_site = (p->x > topsite->p.x) ? 1 : 0;
+    if (right_of_site && he->direction == JCV_DIRECTION_LEFT)
+        return 1;
+    if (!right_of_site && he->direction == JCV_DIRECTION_RIGHT)
+        return 0;
+
+    // The breakpoint is on the same side of the top site as p, so p is right of it if the site
+    // on the right of the halfedge owns the beachline at p. A p on the breakpoint is left of it.
+    double owner = jcv_compare_tangent_circles(p, &topsite->p, &e->sites[0]->p);
+    return (he->direction == JCV_DIRECTION_LEFT ? owner < 0 : owner > 0);
+}
+
+// The linked beachline provides constant-time neighboring halfedges. The
+// rank-balanced RAVL tree indexes that order so a site's predecessor can
+// be found in logarithmic time.
+static void jcv_beachline_init(jcv_context_internal* internal)
+{
+    jcv_halfedge* sentinel = &internal->beachline_nil;
+    memset(sentinel, 0, sizeof(*sentinel));
+    sentinel->tree_parent = sentinel;
+    sentinel->tree_left = sentinel;
+    sentinel->tree_right = sentinel;
+    sentinel->tree_rank = 0;
+    internal->beachline_root = sentinel;
+    internal->beachline_hint = 0;
+}
+
+static void jcv_tree_rotate_left(jcv_context_internal* internal, jcv_halfedge* node)
+{
+    jcv_halfedge* sentinel = &internal->beachline_nil;
+    jcv_halfedge* child = node->tree_right;
+    node->tree_right = child->tree_left;
+    if (child->tree_left != sentinel)
+        child->tree_left->tree_parent = node;
+    child->tree_parent = node->tree_parent;
+    if (node->tree_parent == sentinel)
+        internal->beachline_root = child;
+    else if (node == node->tree_parent->tree_left)
+        node->tree_parent->tree_left = child;
+    else
+        node->tree_parent->tree_right = child;
+    child->tree_left = node;
+    node->tree_parent = child;
+}
+
+static void jcv_tree_rotate_right(jcv_context_internal* internal, jcv_halfedge* node)
+{
+    jcv_halfedge* sentinel = &internal->beachline_nil;
+    jcv_halfedge* child = node->tree_left;
+    node->tree_left = child->tree_right;
+    if (child->tree_right != sentinel)
+        child->tree_right->tree_parent = node;
+    child->tree_parent = node->tree_parent;
+    if (node->tree_parent == sentinel)
+        internal->beachline_root = child;
+    else if (node == node->tree_parent->tree_right)
+        node->tree_parent->tree_right = child;
+    else
+        node->tree_parent->tree_left = child;
+    child->tree_right = node;
+    node->tree_parent = child;
+}
+
+static jcv_halfedge* jcv_tree_minimum(jcv_context_internal* internal, jcv_halfedge* node)
+{
+    jcv_halfedge* sentinel = &internal->beachline_nil;
+    while (node->tree_left != sentinel)
+        node = node->tree_left;
+    return node;
+}
+
+static void jcv_tree_transplant(jcv_context_internal* internal, jcv_halfedge* oldnode, jcv_halfedge* newnode)
+{
+    jcv_halfedge* sentinel = &internal->beachline_nil;
+    if (oldnode->tree_parent == sentinel)
+        internal->beachline_root = newnode;
+    else if (oldnode == oldnode->tree_parent->tree_left)
+        oldnode->tree_parent->tree_left = newnode;
+    else
+        oldnode->tree_parent->tree_right = newnode;
+    newnode->tree_parent = oldnode->tree_parent;
+}
+
+static int jcv_ravl_rank(const jcv_halfedge* node, const jcv_halfedge* sentinel)
+{
+    return node == sentinel ? -1 : (int)node->tree_rank;
+}
+
+// RAVL insertion is rank-balanced like AVL insertion, but deletion is relaxed.
 // A node's rank must remain greater than both child ranks; stale excess rank
 // left by deletion is allowed and is repaired only when a later insertion
 // reaches that path.
 static void jcv_ravl_insert_fixup(jcv_context_internal* internal, jcv_halfedge* node)
 {
     jcv_halfedge* sentinel = &internal->beachline_nil;
-    jcv_halfedge* parent = node->tree_parent;
+    jcv_halfedge* parent = node->tree_parent;
+
+    // A 0-child rank difference is fixed by promotion while the sibling has
+    // rank difference 1. This propagates the violation toward the root without
+    // rotating.
+    while (parent != sentinel && parent->tree_rank == node->tree_rank)
+    {
+        int node_is_right = parent->tree_right == node;
+        jcv_halfedge* sibling = node_is_right ? parent->tree_left : parent->tree_right;
+        int sibling_difference = (int)parent->tree_rank - jcv_ravl_rank(sibling, sentinel);
+        if (sibling_difference != 1)
+            break;
+        ++parent->tree_rank;
+        node = parent;
+        parent = node->tree_parent;
+    }
+    if (parent == sentinel || parent->tree_rank != node->tree_rank)
+        return;
+
+    // Promotion stopped at a 0,2 violation. Use a single outer rotation when
+    // the inserted path is straight, otherwise a double inner rotation.
+    int node_is_right = parent->tree_right == node;
+    jcv_halfedge* inner = node_is_right ? node->tree_left : node->tree_right;
+    int inner_difference = (int)node->tree_rank - jcv_ravl_rank(inner, sentinel);
+    if (inner_difference >= 2)
+    {
+        if (node_is_right)
+            jcv_tree_rotate_left(internal, parent);
+        else
+            jcv_tree_rotate_right(internal, parent);
+        --parent->tree_rank;
+    }
+    else
+    {
+        assert(inner_difference == 1);
+        if (node_is_right)
+            jcv_tree_rotate_right(internal, node);
+        else
+            jcv_tree_rotate_left(internal, node);
+        if (node_is_right)
+            jcv_tree_rotate_left(internal, parent);
+        else
+            jcv_tree_rotate_right(internal, parent);
+        ++inner->tree_rank;
+        --node->tree_rank;
+        --parent->tree_rank;
+    }
+}
+
+static void jcv_ravl_remove(jcv_context_internal* internal, jcv_halfedge* node)
+{
+    jcv_halfedge* sentinel = &internal->beachline_nil;
+    if (node->tree_left == sentinel)
+    {
+        jcv_tree_transplant(internal, node, node->tree_right);
+    }
+    else if (node->tree_right == sentinel)
+    {
+        jcv_tree_transplant(internal, node, node->tree_left);
+    }
+    else
+    {
+        jcv_halfedge* replacement = jcv_tree_minimum(internal, node->tree_right);
+        if (replacement->tree_parent != node)
+        {
+            jcv_tree_transplant(internal, replacement, replacement->tree_right);
+            replacement->tree_right = node->tree_right;
+            replacement->tree_right->tree_parent = replacement;
+        }
+        jcv_tree_transplant(internal, node, replacement);
+        replacement->tree_left = node->tree_left;
+        replacement->tree_left->tree_parent = replacement;
+        replacement->tree_rank = node->tree_rank;
+    }
+
+    // RAVL deliberately performs no deletion rotations. Resetting detached
+    // nodes catches accidental reuse and keeps the sentinel self-contained.
+    node->tree_parent = sentinel;
+    node->tree_left = sentinel;
+    node->tree_right = sentinel;
+    node->tree_rank = 0;
+    sentinel->tree_parent = sentinel;
+}
+
+static void jcv_beachline_insert_after(jcv_context_internal* internal, jcv_halfedge* after, jcv_halfedge* node)
+{
+    jcv_halfedge* sentinel = &internal->beachline_nil;
+    jcv_halfedge* parent = sentinel;
+
+    node->tree_left = sentinel;
+    node->tree_right = sentinel;
+    node->tree_rank = 0;
+
+    if (internal->beachline_root == sentinel)
+    {
+        internal->beachline_root = node;
+    }
+    else if (after == internal->beachline_start)
+    {
+        parent = jcv_tree_minimum(internal, internal->beachline_root);
+        assert(parent->tree_left == sentinel);
+        parent->tree_left = node;
+    }
+    else if (after->tree_right == sentinel)
+    {
+        parent = after;
+        parent->tree_right = node;
+    }
+    else
+    {
+        parent = jcv_tree_minimum(internal, after->tree_right);
+        assert(parent->tree_left == sentinel);
+        parent->tree_left = node;
+    }
+
+    node->tree_parent = parent;
+    jcv_halfedge_link(after, node);
+    jcv_ravl_insert_fixup(internal, node);
+}
+
+static void jcv_beachline_remove(jcv_context_internal* internal, jcv_halfedge* node)
+{
+    jcv_ravl_remove(internal, node);
+    jcv_halfedge_unlink(node);
+}
+
+// Keeps the priority queue sorted with events sorted in ascending order
+// Return 1 if the edges needs to be swapped
+static inline int jcv_halfedge_compare( const jcv_halfedge_event* he1, const jcv_halfedge_event* he2 )
+{
+	return  (he1->y == he2->y) ? he1->vertex.x > he2->vertex.x : he1->y > he2->y;
+}
+
+static inline void jcv_edge_line(const jcv_edge_internal* e, jcv_calc_real* line)
+{
+#if defined(JCV_USE_MIXED_PRECISION)
+    // The stored line is rounded to jcv_real
+    jcv_bisector(e->sites[0], e->sites[1], line);
+#else
+    line[0] = e->a;
+    line[1] = e->b;
+    line[2] = e->c;
+#endif
+}
+
+// The breakpoints on either side of the arc of b converge if the sites a, b, c turn counter clockwise.
+// The vertex (stored as {x, y}) is then where the two bisectors intersect.
+static int jcv_halfedge_intersect(const jcv_halfedge* he1, const jcv_halfedge* he2, jcv_calc_real* out)
+{
+    const jcv_point* a = &jcv_halfedge_leftsite(he1)->p;
+    const jcv_point* b = &jcv_halfedge_rightsite(he1)->p;
+    const jcv_point* c = &jcv_halfedge_rightsite(he2)->p;
+    if( !(jcv_orient(a, b, c) > 0) )
+    {
+        return 0;
+    }
+
+    jcv_calc_real l1[3], l2[3];
+    jcv_edge_line(he1->edge, l1);
+    jcv_edge_line(he2->edge, l2);
+    jcv_calc_real d = l1[0] * l2[1] - l1[1] * l2[0];
+    out[0] = (l1[2] * l2[1] - l1[1] * l2[2]) / d;
+    out[1] = (l1[0] * l2[2] - l1[2] * l2[0]) / d;
+    return 1;
+}
+
+
+// Priority queue
+
+static inline int jcv_pq_moveup(jcv_priorityqueue* pq, int pos)
+{
+    jcv_halfedge_event** items = pq->items;
+    jcv_halfedge_event* node = items[pos];
+
+    for( int parent = (pos >> 1);
+         pos > 1 && jcv_halfedge_compare(items[parent], node);
+         pos = parent, parent = parent >> 1)
+    {
+        items[pos] = items[parent];
+        items[pos]->pqpos = pos;
+    }
+
+    node->pqpos = pos;
+    items[pos] = node;
+    return pos;
+}
+
+static inline int jcv_pq_minchild(jcv_priorityqueue* pq, int pos)
+{
+    int child = pos << 1;
+    if( child >= pq->numitems )
+        return 0;
+    jcv_halfedge_event** items = pq->items;
+    if( (child + 1) < pq->numitems && jcv_halfedge_compare(items[child], items[child+1]) )
+        return child+1;
+    return child;
+}
+
+static inline int jcv_pq_movedown(jcv_priorityqueue* pq, int pos)
+{
+    jcv_halfedge_event** items = pq->items;
+    jcv_halfedge_event* node = items[pos];
+
+    int child = jcv_pq_minchild(pq, pos);
+    while( child && jcv_halfedge_compare(node, items[child]) )
+    {
+        items[pos] = items[child];
+        items[pos]->pqpos = pos;
+        pos = child;
+        child = jcv_pq_minchild(pq, pos);
+    }
+
+    items[pos] = node;
+    node->pqpos = pos;
+    return pos;
+}
+
+static void jcv_pq_create(jcv_priorityqueue* pq, int capacity, jcv_halfedge_event** buffer)
+{
+    pq->maxnumitems = capacity;
+    pq->numitems    = 1;
+    pq->items       = buffer;
+}
+
+static int jcv_pq_empty(jcv_priorityqueue* pq)
+{
+    return pq->numitems == 1 ? 1 : 0;
+}
+
+static int jcv_pq_push(jcv_priorityqueue* pq, jcv_halfedge_event* node)
+{
+    assert(pq->numitems < pq->maxnumitems);
+    int n = pq->numitems++;
+    pq->items[n] = node;
+    return jcv_pq_moveup(pq, n);
+}
+
+static jcv_halfedge_event* jcv_pq_pop(jcv_priorityqueue* pq)
+{
+    jcv_halfedge_event* node = pq->items[1];
+    --pq->numitems;
+    node->pqpos = 0;
+    if (pq->numitems > 1)
+    {
+        pq->items[1] = pq->items[pq->numitems];
+        jcv_pq_movedown(pq, 1);
+    }
+    return node;
+}
+
+// Sites and circle events are processed in ascending y, then x (like jcv_point_less)
+static inline int jcv_site_before_event(const jcv_site* site, const jcv_halfedge_event* event)
+{
+    return (site->p.y == event->y) ? site->p.x < event->vertex.x : site->p.y < event->y;
+}
+
+static jcv_halfedge_event* jcv_pq_top(jcv_priorityqueue* pq)
+{
+    return pq->items[1];
+}
+
+static void jcv_pq_remove(jcv_priorityqueue* pq, jcv_halfedge_event* node)
+{
+    if( pq->numitems == 1 )
+        return;
+    int pos = node->pqpos;
+    if( pos == 0 )
+        return;
+
+    jcv_halfedge_event** items = pq->items;
+    int last = --pq->numitems;
+    node->pqpos = 0;
+    if (pos == last)
+        return;
+
+    items[pos] = items[last];
+    if( pos > 1 && jcv_halfedge_compare(items[pos >> 1], items[pos]) )
+        jcv_pq_moveup(pq, pos);
+    else
+        jcv_pq_movedown(pq, pos);
+}
+
+// internal functions
+
+static inline jcv_site* jcv_nextsite(jcv_context_internal* internal)
+{
+    return (internal->currentsite < internal->numsites) ? &internal->sites[internal->currentsite++] : 0;
+}
+
+// The most half edges walked from the previous site, before searching the tree instead
+#define JCV_BEACHLINE_WALK_MAX_STEPS 16
+
+static jcv_halfedge* jcv_get_edge_above_x(jcv_context_internal* internal, const jcv_point* p)
+{
+    // Sites with the same y (e.g. integer coordinates) come in order of x, so the arc above a site is usually
+    // a few steps to the right of the previous one. The half edges left of p are the ones p is right of.
+    jcv_halfedge* hint = internal->beachline_hint;
+    if( hint && p->y == internal->beachline_hint_y && jcv_halfedge_rightof(hint, p) )
+    {
+        for( int steps = 0; steps < JCV_BEACHLINE_WALK_MAX_STEPS; ++steps )
+        {
+            jcv_halfedge* next = hint->right;
+            if( next == internal->beachline_end || !jcv_halfedge_rightof(next, p) )
+                return hint;
+            hint = next;
+        }
+    }
+
+    // Gets the arc on the beach line at the x coordinate (i.e. right above the new site event)
+    jcv_halfedge* sentinel = &internal->beachline_nil;
+    jcv_halfedge* node = internal->beachline_root;
+    jcv_halfedge* predecessor = internal->beachline_start;
+    while (node != sentinel)
+    {
+        if (jcv_halfedge_rightof(node, p))
+        {
+            predecessor = node;
+            node = node->tree_right;
+        }
+        else
+        {
+            node = node->tree_left;
+        }
+    }
+    return predecessor;
+}
+
+// Computes center.y + radius without catastrophic cancellation when the
+// circumcenter is far below the site. This is algebraically equivalent to
+// radius - dy = dx^2 / (radius + dy), where dy = site.y - center.y.
+static jcv_calc_real jcv_calc_circle_event_y(const jcv_site* site, const jcv_calc_real* center)
+{
+    jcv_calc_real dx = (jcv_calc_real)site->p.x - center[0];
+    jcv_calc_real dy = (jcv_calc_real)site->p.y - center[1];
+    jcv_calc_real radius = JCV_CALC_SQRT(dx * dx + dy * dy);
+    if( dy > (jcv_calc_real)0 )
+        return (jcv_calc_real)site->p.y + (dx * dx) / (radius + dy);
+    return center[1] + radius;
+}
+
+// Like jcv_check_circle_event, with the exactly computed circumcentre. The event y is computed in double,
+// with an explicit fma, so that it doesn't depend on the compiler's contraction of floating point expressions
+static int jcv_check_exact_circle_event(const jcv_halfedge* he1, const jcv_halfedge* he2, const jcv_site* site, jcv_point* vertex, jcv_calc_real* y)
+{
+    const jcv_point* a = &jcv_halfedge_leftsite(he1)->p;
+    const jcv_point* b = &jcv_halfedge_rightsite(he1)->p;
+    const jcv_point* c = &jcv_halfedge_rightsite(he2)->p;
+    if( !(jcv_orient(a, b, c) > 0) )
+    {
+        return 0;
+    }
+
+    double center[2];
+    jcv_exact_circumcenter(a, b, c, center);
+    vertex->x = (jcv_real)center[0];
+    vertex->y = (jcv_real)center[1];
+    if( !(vertex->x - vertex->x == 0 && vertex->y - vertex->y == 0) )
+    {
+        return 0;
+    }
+    double dx = (double)site->p.x - center[0];
+    double dy = (double)site->p.y - center[1];
+    double radius = sqrt(JCV_FMA(dx, dx, dy * dy));
+    *y = (jcv_calc_real)(dy > 0 ? (double)site->p.y + (dx * dx) / (radius + dy) : center[1] + radius);
+    return 1;
+}
+
+// Finds the vertex and the sweepline position (y) of the circle event of the arc between the half edges.
+// The site is one of the arc's sites
+static int jcv_check_circle_event(const jcv_context_internal* internal, const jcv_halfedge* he1, const jcv_halfedge* he2, const jcv_site* site, jcv_point* vertex, jcv_calc_real* y)
+{
+    jcv_edge_internal* e1 = he1->edge;
+    jcv_edge_internal* e2 = he2->edge;
+    if( e1 == 0 || e2 == 0 || e1->sites[1] == e2->sites[1] )
+    {
+        return 0;
+    }
+    if( internal->options & JCV_OPTION_EXACT_VERTICES )
+    {
+        return jcv_check_exact_circle_event(he1, he2, site, vertex, y);
+    }
+
+    jcv_calc_real center[2];
+    if( !jcv_halfedge_intersect(he1, he2, center) )
+    {
+        return 0;
+    }
+    vertex->x = (jcv_real)center[0];
+    vertex->y = (jcv_real)center[1];
+    // Nearly collinear sites can put the vertex beyond the range of jcv_real
+    if( !(vertex->x - vertex->x == 0 && vertex->y - vertex->y == 0) )
+    {
+        return 0;
+    }
+    *y = jcv_calc_circle_event_y(site, center);
+    return 1;
+}
+
+static void jcv_site_event(jcv_context_internal* internal, jcv_site* site)
+{
+    jcv_halfedge* left   = jcv_get_edge_above_x(internal, &site->p);
+    jcv_halfedge* right  = left->right;
+    jcv_site*     bottom = jcv_halfedge_rightsite(left);
+    if( !bottom )
+        bottom = internal->bottomsite;
+
+    jcv_edge_internal* edge = jcv_edge_new(internal, bottom, site);
+    edge->next = internal->edges;
+    internal->edges = edge;
+    ++internal->numedges;
+    ++internal->numdelaunayedges;
+
+    jcv_halfedge* edge1 = jcv_halfedge_new(internal, edge, JCV_DIRECTION_LEFT);
+    jcv_halfedge* edge2 = jcv_halfedge_new(internal, edge, JCV_DIRECTION_RIGHT);
+
+    jcv_beachline_insert_after(internal, left, edge1);
+    jcv_beachline_insert_after(internal, edge1, edge2);
+    internal->beachline_hint = edge2;
+    internal->beachline_hint_y = site->p.y;
+
+    jcv_point p;
+    jcv_calc_real y;
+    if( jcv_check_circle_event( internal, left, edge1, site, &p, &y ) )
+    {
+        jcv_pq_remove(internal->eventqueue, left->event);
+        left->event->vertex = p;
+        left->event->y      = y;
+        jcv_pq_push(internal->eventqueue, left->event);
+    }
+    if( jcv_check_circle_event( internal, edge2, right, site, &p, &y ) )
+    {
+        edge2->event->vertex    = p;
+        edge2->event->y         = y;
+        jcv_pq_push(internal->eventqueue, edge2->event);
+    }
+}
+
+// https://cp-algorithms.com/geometry/oriented-triangle-area.html
+static inline jcv_real jcv_determinant(const jcv_point* a, const jcv_point* b, const jcv_point* c)
+{
+    return (b->x - a->x)*(c->y - a->y) - (b->y - a->y)*(c->x - a->x);
+}
+
+static void jcv_graphedge_copy(const jcv_graphedge* source, jcv_edge* target)
+{
+    const jcv_edge_internal* edge = source->edge;
+    int site_index = source->site_index;
+    if( edge->sites[1] == 0 )
+    {
+        jcv_edge_copy(edge, target);
+        return;
+    }
+    int flip = source->flip;
+    target->sites[0] = edge->sites[site_index];
+    target->sites[1] = edge->sites[1-site_index];
+    target->pos[flip] = edge->pos[site_index];
+    target->pos[1-flip] = edge->pos[1-site_index];
+    target->vertices[flip] = edge->vertices[site_index];
+    target->vertices[1-flip] = edge->vertices[1-site_index];
+    target->a = edge->a;
+    target->b = edge->b;
+    target->c = edge->c;
+}
+
+static inline const jcv_point* jcv_graphedge_pos(const jcv_graphedge* edge, int endpoint)
+{
+    int source_index = endpoint == edge->flip ? edge->site_index : 1 - edge->site_index;
+    return &edge->edge->pos[source_index];
+}
+
+// A monotonic mapping of [0, 2*pi) to [0, 4). It preserves polar ordering
+// without the cost of atan2. The scaled fallback avoids overflowing the
+// denominator for very large, finite coordinates.
+static inline jcv_real jcv_pseudo_angle(jcv_real x, jcv_real y)
+{
+    jcv_real absx = jcv_abs(x);
+    jcv_real absy = jcv_abs(y);
+    jcv_real denominator = absx + absy;
+    if( denominator == (jcv_real)0 )
+        return (jcv_real)0;
+
+    jcv_real angle;
+    if( denominator <= (jcv_real)JCV_FLT_MAX )
+    {
+        angle = y / denominator;
+    }
+    else
+    {
+        jcv_real scale = jcv_max(absx, absy);
+        angle = (y / scale) / (absx / scale + absy / scale);
+    }
+
+    if( x < (jcv_real)0 )
+        angle = (jcv_real)2 - angle;
+    else if( y < (jcv_real)0 )
+        angle = (jcv_real)4 + angle;
+    return angle;
+}
+
+static inline jcv_real jcv_calc_sort_metric(const jcv_site* site, const jcv_graphedge* edge)
+{
+    const jcv_point* pos0 = jcv_graphedge_pos(edge, 0);
+    const jcv_point* pos1 = jcv_graphedge_pos(edge, 1);
+    jcv_real half = 1/(jcv_real)2;
+    jcv_real x = (pos0->x + pos1->x) * half;
+    jcv_real y = (pos0->y + pos1->y) * half;
+    return jcv_pseudo_angle(x - site->p.x, y - site->p.y);
+}
+
+static inline int jcv_graphedge_eq(jcv_graphedge* a, jcv_graphedge* b)
+{
+    return jcv_real_eq(a->angle, b->angle) &&
+        jcv_point_eq(jcv_graphedge_pos(a, 0), jcv_graphedge_pos(b, 0)) &&
+        jcv_point_eq(jcv_graphedge_pos(a, 1), jcv_graphedge_pos(b, 1));
+}
+
+static void jcv_sortedges_insert(jcv_context_internal* internal, jcv_site* site, jcv_graphedge* edge)
+{
+    int site_index = (int)(site - internal->sites);
+    ++internal->build_site_counts[site_index];
+    jcv_graphedge** head = &internal->build_site_edges[site_index];
+    jcv_graphedge* prev = 0;
+    jcv_graphedge* first = *head;
+    if( first == 0 || first->angle >= edge->angle )
+    {
+        edge->next = first;
+        *head = edge;
+    }
+    else
+    {
+        jcv_graphedge* current = first;
+        while( current->next != 0 && current->next->angle < edge->angle )
+            current = current->next;
+        prev = current;
+        edge->next = current->next;
+        current->next = edge;
+    }
+    if( prev && jcv_graphedge_eq(prev, edge) )
+    {
+        prev->next = edge->next;
+        --internal->build_site_counts[site_index];
+    }
+    else if( edge->next && jcv_graphedge_eq(edge, edge->next) )
+    {
+        edge->next = edge->next->next;
+        --internal->build_site_counts[site_index];
+    }
+}
+
+static void jcv_create_graphedge(jcv_context_internal* internal, jcv_edge_internal* e, int site_index, jcv_graphedge* ge)
+{
+    ge->edge = e;
+    ge->next = 0;
+    ge->site_index = (unsigned char)site_index;
+    ge->flip = (unsigned char)jcv_edge_flip(e);
+    if( internal->weights )
+    {
+        // A power cell needn't contain its site, but the outward normals of a convex cell are in CCW order too
+        const jcv_point* inner = &e->sites[site_index]->p;
+        const jcv_point* outer = &e->sites[1-site_index]->p;
+        ge->angle = jcv_pseudo_angle(outer->x - inner->x, outer->y - inner->y);
+    }
+    else
+    {
+        ge->angle = jcv_calc_sort_metric(e->sites[site_index], ge);
+    }
+    jcv_sortedges_insert(internal, e->sites[site_index], ge);
+}
+
+static void jcv_build_graph_edges(jcv_context_internal* internal)
+{
+    memset(internal->build_site_counts, 0, sizeof(int) * (size_t)internal->numsites);
+    int numgraphedges = 0;
+    for( jcv_edge_internal* e = internal->edges; e; e = e->next )
+    {
+        if( !jcv_edge_clipline(internal, e) || jcv_point_eq(&e->pos[0], &e->pos[1]) )
+        {
+            e->pos[1] = e->pos[0];
+            e->a = JCV_INVALID_VALUE;
+            --internal->numedges;
+            --internal->numdelaunayedges;
+            continue;
+        }
+        if( internal->clipper.fill_fn == jcv_boxshape_fillgaps &&
+            (jcv_point_on_box_edge(&e->pos[0], &internal->clipper.min, &internal->clipper.max) ||
+             jcv_point_on_box_edge(&e->pos[1], &internal->clipper.min, &internal->clipper.max)) )
+        {
+            e->sites[0]->boundary = 1;
+            e->sites[1]->boundary = 1;
+        }
+        numgraphedges += 2;
+    }
+    if( numgraphedges == 0 || (internal->options & JCV_OPTION_LAZY_CELLS) )
+        return;
 
-    // A 0-child rank difference is fixed by promotion while the sibling has
-    // rank difference 1. This propagates the violation toward the root without
-    // rotating.
-    while (parent != sentinel && parent->tree_rank == node->tree_rank)
+    jcv_graphedge* graphedges = (jcv_graphedge*)jcv_temp_alloc(internal, sizeof(jcv_graphedge) * (size_t)numgraphedges);
+    int cursor = 0;
+    for( jcv_edge_internal* e = internal->edges; e; e = e->next )
     {
-        int node_is_right = parent->tree_right == node;
-        jcv_halfedge* sibling = node_is_right ? parent->tree_left : parent->tree_right;
-        int sibling_difference = (int)parent->tree_rank - jcv_ravl_rank(sibling, sentinel);
-        if (sibling_difference != 1)
-            break;
-        ++parent->tree_rank;
-        node = parent;
-        parent = node->tree_parent;
+        if( e->a == JCV_INVALID_VALUE )
+            continue;
+        jcv_create_graphedge(internal, e, 0, &graphedges[cursor++]);
+        jcv_create_graphedge(internal, e, 1, &graphedges[cursor++]);
     }
-    if (parent == sentinel || parent->tree_rank != node->tree_rank)
-        return;
+}
 
-    // Promotion stopped at a 0,2 violation. Use a single outer rotation when
-    // the inserted path is straight, otherwise a double inner rotation.
-    int node_is_right = parent->tree_right == node;
-    jcv_halfedge* inner = node_is_right ? node->tree_left : node->tree_right;
-    int inner_difference = (int)node->tree_rank - jcv_ravl_rank(inner, sentinel);
-    if (inner_difference >= 2)
+static void jcv_endpos(jcv_edge_internal* e, const jcv_point* p, int direction, int vertex)
+{
+    e->pos[direction] = *p;
+    e->vertices[direction] = vertex;
+}
+
+static jcv_edge_internal* jcv_create_gap_edge(jcv_context_internal* internal, jcv_site* site,
+    const jcv_point* pos0, const jcv_point* pos1, int vertex0, int vertex1)
+{
+    jcv_edge_internal* edge  = jcv_alloc_edge(internal);
+    edge->pos[0] = *pos0;
+    edge->pos[1] = *pos1;
+    edge->vertices[0] = vertex0;
+    edge->vertices[1] = vertex1;
+    edge->sites[0]  = site;
+    edge->sites[1]  = 0;
+    edge->a = edge->b = edge->c = 0;
+    edge->next      = internal->edges;
+    internal->edges = edge;
+    if( !jcv_point_eq(pos0, pos1) )
+        ++internal->numedges;
+    return edge;
+}
+
+static jcv_graphedge* jcv_insert_gap_after(jcv_context_internal* internal, jcv_site* site,
+    jcv_graphedge* current, const jcv_point* pos0, const jcv_point* pos1, int vertex0, int vertex1)
+{
+    int site_index = (int)(site - internal->sites);
+    jcv_edge_internal* edge = jcv_create_gap_edge(internal, site, pos0, pos1, vertex0, vertex1);
+    jcv_graphedge* gap = jcv_alloc_graphedge(internal);
+    gap->edge = edge;
+    gap->site_index = 0;
+    gap->flip = 0;
+    gap->angle = jcv_calc_sort_metric(site, gap);
+    if( current )
     {
-        if (node_is_right)
-            jcv_tree_rotate_left(internal, parent);
-        else
-            jcv_tree_rotate_right(internal, parent);
-        --parent->tree_rank;
+        gap->next = current->next;
+        current->next = gap;
     }
     else
     {
-        assert(inner_difference == 1);
-        if (node_is_right)
-            jcv_tree_rotate_right(internal, node);
-        else
-            jcv_tree_rotate_left(internal, node);
-        if (node_is_right)
-            jcv_tree_rotate_left(internal, parent);
-        else
-            jcv_tree_rotate_right(internal, parent);
-        ++inner->tree_rank;
-        --node->tree_rank;
-        --parent->tree_rank;
+        gap->next = internal->build_site_edges[site_index];
+        internal->build_site_edges[site_index] = gap;
     }
+    ++internal->build_site_counts[site_index];
+    return gap;
 }
 
-static void jcv_ravl_remove(jcv_context_internal* internal, jcv_halfedge* node)
+// Construction helpers used by optional clippers. The handles are deliberately
+// opaque so a clipper never depends on the internal edge representation.
+static void* jcv_clip_site_edge_head(jcv_context_internal* internal, const jcv_site* site)
 {
-    jcv_halfedge* sentinel = &internal->beachline_nil;
-    if (node->tree_left == sentinel)
+    return internal->build_site_edges[site - internal->sites];
+}
+
+static void* jcv_clip_site_edge_next(void* edge)
+{
+    return edge ? ((jcv_graphedge*)edge)->next : 0;
+}
+
+static void jcv_clip_site_edge_copy(const void* edge, jcv_edge* output)
+{
+    jcv_graphedge_copy((const jcv_graphedge*)edge, output);
+}
+
+static void* jcv_clip_site_insert_gap(jcv_context_internal* internal, jcv_site* site, void* current,
+    const jcv_point* pos0, const jcv_point* pos1, int vertex0, int vertex1)
+{
+    return jcv_insert_gap_after(internal, site, (jcv_graphedge*)current, pos0, pos1, vertex0, vertex1);
+}
+
+void jcv_boxshape_fillgaps(const jcv_clipper* clipper, jcv_context_internal* allocator, jcv_site* site)
+{
+    // They're sorted CCW, so if the current->pos[1] != next->pos[0], then we have a gap
+    int site_index = (int)(site - allocator->sites);
+    jcv_graphedge* current = allocator->build_site_edges[site_index];
+    if( !current )
     {
-        jcv_tree_transplant(internal, node, node->tree_right);
+        assert( allocator->numsites == 1 || allocator->weights );
+        jcv_point end = {clipper->max.x, clipper->min.y};
+        int vertex0 = jcv_add_vertex(allocator, &clipper->min);
+        int vertex1 = jcv_add_vertex(allocator, &end);
+        current = jcv_insert_gap_after(allocator, site, 0, &clipper->min, &end, vertex0, vertex1);
     }
-    else if (node->tree_right == sentinel)
+
+    jcv_graphedge* next = current->next;
+    if( !next )
     {
-        jcv_tree_transplant(internal, node, node->tree_left);
+        jcv_edge current_edge;
+        jcv_graphedge_copy(current, &current_edge);
+        jcv_point corner;
+        if( current_edge.pos[1].x < allocator->rect.max.x && current_edge.pos[1].y == allocator->rect.min.y )
+        {
+            corner.x = allocator->rect.max.x;
+            corner.y = allocator->rect.min.y;
+        }
+        else if( current_edge.pos[1].x > allocator->rect.min.x && current_edge.pos[1].y == allocator->rect.max.y )
+        {
+            corner.x = allocator->rect.min.x;
+            corner.y = allocator->rect.max.y;
+        }
+        else if( current_edge.pos[1].y > allocator->rect.min.y && current_edge.pos[1].x == allocator->rect.min.x )
+        {
+            corner.x = allocator->rect.min.x;
+            corner.y = allocator->rect.min.y;
+        }
+        else
+        {
+            corner.x = allocator->rect.max.x;
+            corner.y = allocator->rect.max.y;
+        }
+        current = jcv_insert_gap_after(allocator, site, current, &current_edge.pos[1], &corner,
+            current_edge.vertices[1], jcv_add_vertex(allocator, &corner));
+        next = allocator->build_site_edges[site_index];
     }
-    else
+
+    while( current && next )
     {
-        jcv_halfedge* replacement = jcv_tree_minimum(internal, node->tree_right);
-        if (replacement->tree_parent != node)
+        jcv_edge current_edge;
+        jcv_edge next_edge;
+        jcv_graphedge_copy(current, &current_edge);
+        jcv_graphedge_copy(next, &next_edge);
+        int current_edge_flags = jcv_get_edge_flags(&current_edge.pos[1], &clipper->min, &clipper->max);
+        if( current_edge_flags && !jcv_point_eq(&current_edge.pos[1], &next_edge.pos[0]))
         {
-            jcv_tree_transplant(internal, replacement, replacement->tree_right);
-            replacement->tree_right = node->tree_right;
-            replacement->tree_right->tree_parent = replacement;
+            int next_edge_flags = jcv_get_edge_flags(&next_edge.pos[0], &clipper->min, &clipper->max);
+            if( !next_edge_flags )
+                return;
+            if( current_edge_flags & next_edge_flags )
+            {
+                jcv_insert_gap_after(allocator, site, current, &current_edge.pos[1], &next_edge.pos[0],
+                    current_edge.vertices[1], next_edge.vertices[0]);
+            }
+            else
+            {
+                int corner_flag = jcv_edge_flags_to_corner(current_edge_flags);
+                if (corner_flag)
+                    corner_flag = jcv_corner_rotate_90(corner_flag);
+                else
+                {
+                    if      (current_edge_flags == JCV_EDGE_TOP)    { corner_flag = JCV_CORNER_TOP_LEFT; }
+                    else if (current_edge_flags == JCV_EDGE_LEFT)   { corner_flag = JCV_CORNER_BOTTOM_LEFT; }
+                    else if (current_edge_flags == JCV_EDGE_BOTTOM) { corner_flag = JCV_CORNER_BOTTOM_RIGHT; }
+                    else if (current_edge_flags == JCV_EDGE_RIGHT)  { corner_flag = JCV_CORNER_TOP_RIGHT; }
+                }
+                jcv_point corner = jcv_corner_to_point(corner_flag, &clipper->min, &clipper->max);
+                jcv_insert_gap_after(allocator, site, current, &current_edge.pos[1], &corner,
+                    current_edge.vertices[1], jcv_add_vertex(allocator, &corner));
+            }
+        }
+        current = current->next;
+        if( current )
+        {
+            next = current->next;
+            if( !next )
+                next = allocator->build_site_edges[site_index];
         }
-        jcv_tree_transplant(internal, node, replacement);
-        replacement->tree_left = node->tree_left;
-        replacement->tree_left->tree_parent = replacement;
-        replacement->tree_rank = node->tree_rank;
     }
-
-    // RAVL deliberately performs no deletion rotations. Resetting detached
-    // nodes catches accidental reuse and keeps the sentinel self-contained.
-    node->tree_parent = sentinel;
-    node->tree_left = sentinel;
-    node->tree_right = sentinel;
-    node->tree_rank = 0;
-    sentinel->tree_parent = sentinel;
 }
 
-static void jcv_beachline_insert_after(jcv_context_internal* internal, jcv_halfedge* after, jcv_halfedge* node)
+
+// Since the algorithm leaves gaps at the borders/corner, we want to fill them
+static void jcv_fillgaps(jcv_diagram* diagram)
 {
-    jcv_halfedge* sentinel = &internal->beachline_nil;
-    jcv_halfedge* parent = sentinel;
+    jcv_context_internal* internal = diagram->internal;
+    if (!internal->clipper.fill_fn)
+        return;
 
-    node->tree_left = sentinel;
-    node->tree_right = sentinel;
-    node->tree_rank = 0;
+    int skip_interior_sites = internal->numsites > 1 &&
+        internal->clipper.fill_fn == jcv_boxshape_fillgaps;
+    for( int i = 0; i < internal->numsites; ++i )
+    {
+        jcv_site* site = &internal->sites[i];
+        if( skip_interior_sites && !site->boundary )
+            continue;
+        // Empty power cells stay empty, unless the cell is the whole rect
+        if( internal->weights && !internal->build_site_edges[i] && !site->boundary )
+            continue;
+        internal->clipper.fill_fn(&internal->clipper, internal, site);
+    }
+}
 
-    if (internal->beachline_root == sentinel)
+static void jcv_finalize_site_edges(jcv_context_internal* internal)
+{
+    int total = 0;
+    internal->site_edge_offsets = (int*)jcv_alloc(internal, sizeof(int) * (size_t)(internal->numsites + 1));
+    for( int i = 0; i < internal->numsites; ++i )
     {
-        internal->beachline_root = node;
+        internal->site_edge_offsets[i] = total;
+        total += internal->build_site_counts[i];
     }
-    else if (after == internal->beachline_start)
+    internal->site_edge_offsets[internal->numsites] = total;
+    internal->site_edge_refs = (jcv_edge_internal**)jcv_alloc(internal, sizeof(jcv_edge_internal*) * (size_t)total);
+    int cursor = 0;
+    for( int i = 0; i < internal->numsites; ++i )
     {
-        parent = jcv_tree_minimum(internal, internal->beachline_root);
-        assert(parent->tree_left == sentinel);
-        parent->tree_left = node;
+        for( jcv_graphedge* graph = internal->build_site_edges[i]; graph; graph = graph->next )
+            internal->site_edge_refs[cursor++] = graph->edge;
+    }
+}
+
+// For lazy cells: indexes each site's clipped edges, unordered and without the gaps along the clipping boundary
+static void jcv_index_site_edges(jcv_context_internal* internal)
+{
+    int numsites = internal->numsites;
+    int* offsets = (int*)jcv_alloc(internal, sizeof(int) * (size_t)(numsites + 1));
+    memset(offsets, 0, sizeof(int) * (size_t)(numsites + 1));
+    for( jcv_edge_internal* e = internal->edges; e; e = e->next )
+    {
+        if( e->a == JCV_INVALID_VALUE )
+            continue;
+        ++offsets[e->sites[0] - internal->sites];
+        ++offsets[e->sites[1] - internal->sites];
     }
-    else if (after->tree_right == sentinel)
+    for( int i = 0, total = 0; i <= numsites; ++i )
     {
-        parent = after;
-        parent->tree_right = node;
+        int n = offsets[i];
+        offsets[i] = total;
+        total += n;
     }
-    else
+    jcv_edge_internal** refs = (jcv_edge_internal**)jcv_alloc(internal, sizeof(jcv_edge_internal*) * (size_t)(offsets[numsites] + 1));
+    for( jcv_edge_internal* e = internal->edges; e; e = e->next )
     {
-        parent = jcv_tree_minimum(internal, after->tree_right);
-        assert(parent->tree_left == sentinel);
-        parent->tree_left = node;
+        if( e->a == JCV_INVALID_VALUE )
+            continue;
+        refs[offsets[e->sites[0] - internal->sites]++] = e;
+        refs[offsets[e->sites[1] - internal->sites]++] = e;
     }
-
-    node->tree_parent = parent;
-    jcv_halfedge_link(after, node);
-    jcv_ravl_insert_fixup(internal, node);
+    for( int i = numsites; i > 0; --i )
+        offsets[i] = offsets[i-1];
+    offsets[0] = 0;
+    internal->site_edge_offsets = offsets;
+    internal->site_edge_refs = refs;
+
+    internal->cell_refs = (jcv_edge_internal***)jcv_alloc(internal, sizeof(jcv_edge_internal**) * (size_t)numsites);
+    internal->cell_counts = (int*)jcv_alloc(internal, sizeof(int) * (size_t)numsites);
+    for( int i = 0; i < numsites; ++i )
+        internal->cell_counts[i] = -1;
 }
 
-static void jcv_beachline_remove(jcv_context_internal* internal, jcv_halfedge* node)
+// Orders one site's edges and fills its gaps, as jcv_build_graph_edges and jcv_fillgaps do for all sites
+static void jcv_build_cell(jcv_context_internal* internal, int index)
 {
-    jcv_ravl_remove(internal, node);
-    jcv_halfedge_unlink(node);
-}
+    jcv_site* site = &internal->sites[index];
+    jcv_edge_internal* const* edges = internal->site_edge_refs + internal->site_edge_offsets[index];
+    int count = internal->site_edge_offsets[index+1] - internal->site_edge_offsets[index];
+    internal->build_site_edges[index] = 0;
+    internal->build_site_counts[index] = 0;
+    if( count > 0 )
+    {
+        jcv_graphedge* graphedges = (jcv_graphedge*)jcv_temp_alloc(internal, sizeof(jcv_graphedge) * (size_t)count);
+        for( int i = 0; i < count; ++i )
+            jcv_create_graphedge(internal, edges[i], edges[i]->sites[0] == site ? 0 : 1, &graphedges[i]);
+    }
+    if( internal->clipper.fill_fn &&
+        (site->boundary || internal->numsites == 1 || internal->clipper.fill_fn != jcv_boxshape_fillgaps) )
+        internal->clipper.fill_fn(&internal->clipper, internal, site);
 
-// Keeps the priority queue sorted with events sorted in ascending order
-// Return 1 if the edges needs to be swapped
-static inline int jcv_halfedge_compare( const jcv_halfedge* he1, const jcv_halfedge* he2 )
-{
-	return  (he1->y == he2->y) ? he1->vertex.x > he2->vertex.x : he1->y > he2->y;
+    count = internal->build_site_counts[index];
+    jcv_edge_internal** cell = (jcv_edge_internal**)jcv_alloc(internal, sizeof(jcv_edge_internal*) * (size_t)(count > 0 ? count : 1));
+    int cursor = 0;
+    for( jcv_graphedge* graph = internal->build_site_edges[index]; graph; graph = graph->next )
+        cell[cursor++] = graph->edge;
+    internal->cell_refs[index] = cell;
+    internal->cell_counts[index] = cursor;
+    internal->build_site_edges[index] = 0;
+    jcv_temp_free_all(internal);
 }
 
-static int jcv_halfedge_intersect(const jcv_halfedge* he1, const jcv_halfedge* he2, jcv_point* out)
+// Andrew's monotone chain over the sorted sites: up the right side from the lowest site, then down the left side.
+// Sites on a straight side are kept, and the exact orientation keeps the result independent of rounding
+static void jcv_build_hull(jcv_context_internal* internal)
 {
-    const jcv_edge_internal* e1 = he1->edge;
-    const jcv_edge_internal* e2 = he2->edge;
-
-    jcv_real d = e1->a * e2->b - e1->b * e2->a;
-    if( ((jcv_real)-JCV_EDGE_INTERSECT_THRESHOLD < d && d < (jcv_real)JCV_EDGE_INTERSECT_THRESHOLD) )
+    int numsites = internal->numsites;
+    if( numsites == 0 )
+        return;
+    const jcv_site* sites = internal->sites;
+    int collinear = 1;
+    for( int i = 1; i < numsites - 1 && collinear; ++i )
+        collinear = jcv_orient(&sites[0].p, &sites[numsites-1].p, &sites[i].p) == 0;
+    if( collinear )
     {
-        return 0;
+        // The sorted sites are in order along the line
+        internal->hull = (int*)jcv_alloc(internal, sizeof(int) * (size_t)numsites);
+        for( int i = 0; i < numsites; ++i )
+            internal->hull[i] = i;
+        internal->numhull = numsites;
+        return;
     }
-    out->x = (e1->c * e2->b - e1->b * e2->c) / d;
-    out->y = (e1->a * e2->c - e1->c * e2->a) / d;
 
-    const jcv_edge_internal* e;
-    const jcv_halfedge* he;
-    if( jcv_point_less( &e1->sites[1]->p, &e2->sites[1]->p) )
-    {
-        he = he1;
-        e = e1;
-    }
-    else
+    int* chain = (int*)jcv_temp_alloc(internal, sizeof(int) * (size_t)numsites * 2);
+    int count = 0;
+    for( int i = 0; i < numsites; ++i )
     {
-        he = he2;
-        e = e2;
+        while( count >= 2 && jcv_orient(&sites[chain[count-2]].p, &sites[chain[count-1]].p, &sites[i].p) < 0 )
+            --count;
+        chain[count++] = i;
     }
-
-    int right_of_site = out->x >= e->sites[1]->p.x;
-    if ((right_of_site && he->direction == JCV_DIRECTION_LEFT) || (!right_of_site && he->direction == JCV_DIRECTION_RIGHT))
+    int right = count;
+    for( int i = numsites - 2; i >= 0; --i )
     {
-        return 0;
+        while( count > right && jcv_orient(&sites[chain[count-2]].p, &sites[chain[count-1]].p, &sites[i].p) < 0 )
+            --count;
+        chain[count++] = i;
     }
-
-    return 1;
+    --count; // The lowest site closes the loop
+    internal->hull = (int*)jcv_alloc(internal, sizeof(int) * (size_t)count);
+    memcpy(internal->hull, chain, sizeof(int) * (size_t)count);
+    internal->numhull = count;
 }
 
+// About four sites per cell: close enough that a query walk starts near its answer
+static const int JCV_SITE_GRID_SITES_PER_CELL = 4;
 
-// Priority queue
-
-static inline int jcv_pq_moveup(jcv_priorityqueue* pq, int pos)
+static void jcv_build_site_grid(jcv_context_internal* internal)
 {
-    jcv_halfedge** items = pq->items;
-    jcv_halfedge* node = items[pos];
+    int numsites = internal->numsites;
+    if( numsites == 0 )
+        return;
 
-    for( int parent = (pos >> 1);
-         pos > 1 && jcv_halfedge_compare(items[parent], node);
-         pos = parent, parent = parent >> 1)
+    jcv_real width = internal->rect.max.x - internal->rect.min.x;
+    jcv_real height = internal->rect.max.y - internal->rect.min.y;
+    int numcells = numsites / JCV_SITE_GRID_SITES_PER_CELL + 1;
+    int gridwidth = 1;
+    if( width > 0 && height > 0 )
     {
-        items[pos] = items[parent];
-        items[pos]->pqpos = pos;
+        jcv_real columns = jcv_ceil(JCV_SQRT((jcv_real)numcells * (width / height)));
+        gridwidth = columns < 1 ? 1 : (columns > (jcv_real)numcells ? numcells : (int)columns);
+    }
+    else if( width > 0 )
+    {
+        gridwidth = numcells;
+    }
+    int gridheight = (numcells + gridwidth - 1) / gridwidth;
+
+    internal->site_grid_width = gridwidth;
+    internal->site_grid_height = gridheight;
+    internal->site_grid_scale.x = width > 0 ? (jcv_real)gridwidth / width : 0;
+    internal->site_grid_scale.y = height > 0 ? (jcv_real)gridheight / height : 0;
+
+    int count = gridwidth * gridheight;
+    int* grid = (int*)jcv_alloc(internal, sizeof(int) * (size_t)count);
+    for( int i = 0; i < count; ++i )
+        grid[i] = -1;
+    for( int i = 0; i < numsites; ++i )
+    {
+        // An empty power cell has no neighbours to walk from
+        if( jcv_site_has_edges(internal, i) )
+            grid[jcv_site_grid_cell(internal, &internal->sites[i].p)] = i;
     }
 
-    node->pqpos = pos;
-    items[pos] = node;
-    return pos;
+    // Empty cells borrow a seed from the previous non-empty cell (or the first, at the start)
+    int seed = -1;
+    for( int i = 0; i < count; ++i )
+    {
+        if( grid[i] < 0 )
+            grid[i] = seed;
+        else
+            seed = grid[i];
+    }
+    if( seed < 0 )
+        return;
+    for( int i = 0; i < count && grid[i] < 0; ++i )
+        grid[i] = seed;
+    internal->site_grid = grid;
 }
 
-static inline int jcv_pq_minchild(jcv_priorityqueue* pq, int pos)
+static void jcv_circle_event(jcv_context_internal* internal)
 {
-    int child = pos << 1;
-    if( child >= pq->numitems )
-        return 0;
-    jcv_halfedge** items = pq->items;
-    if( (child + 1) < pq->numitems && jcv_halfedge_compare(items[child], items[child+1]) )
-        return child+1;
-    return child;
-}
+    jcv_halfedge* left      = jcv_pq_pop(internal->eventqueue)->he;
 
-static inline int jcv_pq_movedown(jcv_priorityqueue* pq, int pos)
-{
-    jcv_halfedge** items = pq->items;
-    jcv_halfedge* node = items[pos];
+    jcv_halfedge* leftleft  = left->left;
+    jcv_halfedge* right     = left->right;
+    jcv_halfedge* rightright= right->right;
+    jcv_site* bottom = jcv_halfedge_leftsite(left);
+    jcv_site* top    = jcv_halfedge_rightsite(right);
 
-    int child = jcv_pq_minchild(pq, pos);
-    while( child && jcv_halfedge_compare(node, items[child]) )
+    jcv_point vertex = left->event->vertex;
+    int vertex_index = JCV_INVALID_VERTEX;
+    if( !(internal->options & JCV_OPTION_DELAUNAY_ONLY) )
     {
-        items[pos] = items[child];
-        items[pos]->pqpos = pos;
-        pos = child;
-        child = jcv_pq_minchild(pq, pos);
+        jcv_edge_internal* incident_edges[2] = {left->edge, right->edge};
+        // Four or more cocircular sites can report the same vertex in consecutive
+        // circle events. In that case one incident edge already carries its index.
+        for( int i = 0; i < 2 && vertex_index == JCV_INVALID_VERTEX; ++i )
+        {
+            for( int endpoint = 0; endpoint < 2; ++endpoint )
+            {
+                if( incident_edges[i]->vertices[endpoint] >= 0 &&
+                    incident_edges[i]->pos[endpoint].x == vertex.x &&
+                    incident_edges[i]->pos[endpoint].y == vertex.y )
+                {
+                    vertex_index = incident_edges[i]->vertices[endpoint];
+                    break;
+                }
+            }
+        }
+        // Exact vertices of cocircular sites are bit identical, and their events are consecutive,
+        // but they needn't collapse adjacent arcs
+        int last = internal->lastcirclevertex;
+        if( (internal->options & JCV_OPTION_EXACT_VERTICES) && vertex_index == JCV_INVALID_VERTEX &&
+            last != JCV_INVALID_VERTEX && internal->vertices[last].x == vertex.x && internal->vertices[last].y == vertex.y )
+        {
+            vertex_index = last;
+        }
+        if( vertex_index == JCV_INVALID_VERTEX &&
+            (!internal->clipper.test_fn || internal->clipper.test_fn(&internal->clipper, vertex)) )
+        {
+            vertex_index = jcv_add_vertex(internal, &vertex);
+        }
+        internal->lastcirclevertex = vertex_index;
+        jcv_endpos(left->edge, &vertex, left->direction, vertex_index);
+        jcv_endpos(right->edge, &vertex, right->direction, vertex_index);
     }
 
-    items[pos] = node;
-    node->pqpos = pos;
-    return pos;
-}
+    jcv_pq_remove(internal->eventqueue, right->event);
+    jcv_beachline_remove(internal, left);
+    jcv_beachline_remove(internal, right);
+    jcv_halfedge_delete(internal, left);
+    jcv_halfedge_delete(internal, right);
 
-static void jcv_pq_create(jcv_priorityqueue* pq, int capacity, jcv_halfedge** buffer)
-{
-    pq->maxnumitems = capacity;
-    pq->numitems    = 1;
-    pq->items       = buffer;
+    int direction = JCV_DIRECTION_LEFT;
+    if( bottom->p.y > top->p.y )
+    {
+        jcv_site* temp = bottom;
+        bottom = top;
+        top = temp;
+        direction = JCV_DIRECTION_RIGHT;
+    }
+
+    jcv_edge_internal* edge = jcv_edge_new(internal, bottom, top);
+    edge->next = internal->edges;
+    internal->edges = edge;
+    ++internal->numedges;
+    ++internal->numdelaunayedges;
+
+    jcv_halfedge* he = jcv_halfedge_new(internal, edge, direction);
+    jcv_beachline_insert_after(internal, leftleft, he);
+    if( !(internal->options & JCV_OPTION_DELAUNAY_ONLY) )
+        jcv_endpos(edge, &vertex, JCV_DIRECTION_RIGHT - direction, vertex_index);
+
+    jcv_point p;
+    jcv_calc_real y;
+    if( jcv_check_circle_event( internal, leftleft, he, bottom, &p, &y ) )
+    {
+        jcv_pq_remove(internal->eventqueue, leftleft->event);
+        leftleft->event->vertex = p;
+        leftleft->event->y      = y;
+        jcv_pq_push(internal->eventqueue, leftleft->event);
+    }
+    if( jcv_check_circle_event( internal, he, rightright, bottom, &p, &y ) )
+    {
+        he->event->vertex   = p;
+        he->event->y        = y;
+        jcv_pq_push(internal->eventqueue, he->event);
+    }
 }
 
-static int jcv_pq_empty(jcv_priorityqueue* pq)
+// The input coordinates, read in place: point i is at x + i * stride and y + i * stride (in bytes)
+typedef struct jcv_point_input_
 {
-    return pq->numitems == 1 ? 1 : 0;
-}
+    const char* x;
+    const char* y;
+    size_t      stride;
+    int         is_int32;   // The coordinates are int32_t instead of jcv_real
+} jcv_point_input;
 
-static int jcv_pq_push(jcv_priorityqueue* pq, jcv_halfedge* node)
+static inline jcv_point_input jcv_point_input_strided(const jcv_point* points, size_t stride)
 {
-    assert(pq->numitems < pq->maxnumitems);
-    int n = pq->numitems++;
-    pq->items[n] = node;
-    return jcv_pq_moveup(pq, n);
+    jcv_point_input input;
+    input.x = (const char*)points + offsetof(jcv_point, x);
+    input.y = (const char*)points + offsetof(jcv_point, y);
+    input.stride = stride;
+    input.is_int32 = 0;
+    return input;
 }
 
-static jcv_halfedge* jcv_pq_pop(jcv_priorityqueue* pq)
+// The coordinates are copied out, as a stride needn't keep them aligned
+static inline jcv_point jcv_point_input_get(const jcv_point_input* input, int i)
 {
-    jcv_halfedge* node = pq->items[1];
-    --pq->numitems;
-    node->pqpos = 0;
-    if (pq->numitems > 1)
+    jcv_point p;
+    size_t offset = (size_t)i * input->stride;
+    if( input->is_int32 )
     {
-        pq->items[1] = pq->items[pq->numitems];
-        jcv_pq_movedown(pq, 1);
+        int32_t v[2];
+        memcpy(&v[0], input->x + offset, sizeof(int32_t));
+        memcpy(&v[1], input->y + offset, sizeof(int32_t));
+        p.x = (jcv_real)v[0];
+        p.y = (jcv_real)v[1];
+        return p;
     }
-    return node;
+    memcpy(&p.x, input->x + offset, sizeof(jcv_real));
+    memcpy(&p.y, input->y + offset, sizeof(jcv_real));
+    return p;
 }
 
-static jcv_halfedge* jcv_pq_top(jcv_priorityqueue* pq)
-{
-    return pq->items[1];
-}
 
-static void jcv_pq_remove(jcv_priorityqueue* pq, jcv_halfedge* node)
-{
-    if( pq->numitems == 1 )
-        return;
-    int pos = node->pqpos;
-    if( pos == 0 )
-        return;
+#if defined(JCV_HAS_SIMD)
+
+// The lanes, loads, min/max, and a mask of the finite lanes: x - x is 0 for a finite x, and NaN
+// (which an ordered compare rejects) for NaN and infinity
+#if defined(JCV_SIMD_AVX2)
+    #define JCV_SIMD_F32_LANES                  8
+    typedef __m256                              jcv_simd_f32;
+    typedef __m256                              jcv_simd_mask_f32;
+    #define jcv_simd_load_f32(_P_)              _mm256_loadu_ps(_P_)
+    #define jcv_simd_store_f32(_P_, _V_)        _mm256_storeu_ps(_P_, _V_)
+    #define jcv_simd_set1_f32(_X_)              _mm256_set1_ps(_X_)
+    #define jcv_simd_min_f32(_A_, _B_)          _mm256_min_ps(_A_, _B_)
+    #define jcv_simd_max_f32(_A_, _B_)          _mm256_max_ps(_A_, _B_)
+    #define jcv_simd_finite_f32(_V_)            _mm256_cmp_ps(_mm256_sub_ps(_V_, _V_), _mm256_setzero_ps(), _CMP_EQ_OQ)
+    #define jcv_simd_and_f32(_A_, _B_)          _mm256_and_ps(_A_, _B_)
+    #define jcv_simd_all_f32(_M_)               (_mm256_movemask_ps(_M_) == 0xff)
+
+    #define JCV_SIMD_F64_LANES                  4
+    typedef __m256d                             jcv_simd_f64;
+    typedef __m256d                             jcv_simd_mask_f64;
+    #define jcv_simd_load_f64(_P_)              _mm256_loadu_pd(_P_)
+    #define jcv_simd_store_f64(_P_, _V_)        _mm256_storeu_pd(_P_, _V_)
+    #define jcv_simd_set1_f64(_X_)              _mm256_set1_pd(_X_)
+    #define jcv_simd_min_f64(_A_, _B_)          _mm256_min_pd(_A_, _B_)
+    #define jcv_simd_max_f64(_A_, _B_)          _mm256_max_pd(_A_, _B_)
+    #define jcv_simd_finite_f64(_V_)            _mm256_cmp_pd(_mm256_sub_pd(_V_, _V_), _mm256_setzero_pd(), _CMP_EQ_OQ)
+    #define jcv_simd_and_f64(_A_, _B_)          _mm256_and_pd(_A_, _B_)
+    #define jcv_simd_all_f64(_M_)               (_mm256_movemask_pd(_M_) == 0xf)
+#elif defined(JCV_SIMD_SSE2)
+    #define JCV_SIMD_F32_LANES                  4
+    typedef __m128                              jcv_simd_f32;
+    typedef __m128                              jcv_simd_mask_f32;
+    #define jcv_simd_load_f32(_P_)              _mm_loadu_ps(_P_)
+    #define jcv_simd_store_f32(_P_, _V_)        _mm_storeu_ps(_P_, _V_)
+    #define jcv_simd_set1_f32(_X_)              _mm_set1_ps(_X_)
+    #define jcv_simd_min_f32(_A_, _B_)          _mm_min_ps(_A_, _B_)
+    #define jcv_simd_max_f32(_A_, _B_)          _mm_max_ps(_A_, _B_)
+    #define jcv_simd_finite_f32(_V_)            _mm_cmpeq_ps(_mm_sub_ps(_V_, _V_), _mm_setzero_ps())
+    #define jcv_simd_and_f32(_A_, _B_)          _mm_and_ps(_A_, _B_)
+    #define jcv_simd_all_f32(_M_)               (_mm_movemask_ps(_M_) == 0xf)
+
+    #define JCV_SIMD_F64_LANES                  2
+    typedef __m128d                             jcv_simd_f64;
+    typedef __m128d                             jcv_simd_mask_f64;
+    #define jcv_simd_load_f64(_P_)              _mm_loadu_pd(_P_)
+    #define jcv_simd_store_f64(_P_, _V_)        _mm_storeu_pd(_P_, _V_)
+    #define jcv_simd_set1_f64(_X_)              _mm_set1_pd(_X_)
+    #define jcv_simd_min_f64(_A_, _B_)          _mm_min_pd(_A_, _B_)
+    #define jcv_simd_max_f64(_A_, _B_)          _mm_max_pd(_A_, _B_)
+    #define jcv_simd_finite_f64(_V_)            _mm_cmpeq_pd(_mm_sub_pd(_V_, _V_), _mm_setzero_pd())
+    #define jcv_simd_and_f64(_A_, _B_)          _mm_and_pd(_A_, _B_)
+    #define jcv_simd_all_f64(_M_)               (_mm_movemask_pd(_M_) == 0x3)
+#elif defined(JCV_SIMD_NEON)
+    #define JCV_SIMD_F32_LANES                  4
+    typedef float32x4_t                         jcv_simd_f32;
+    typedef uint32x4_t                          jcv_simd_mask_f32;
+    #define jcv_simd_load_f32(_P_)              vld1q_f32(_P_)
+    #define jcv_simd_store_f32(_P_, _V_)        vst1q_f32(_P_, _V_)
+    #define jcv_simd_set1_f32(_X_)              vdupq_n_f32(_X_)
+    #define jcv_simd_min_f32(_A_, _B_)          vminq_f32(_A_, _B_)
+    #define jcv_simd_max_f32(_A_, _B_)          vmaxq_f32(_A_, _B_)
+    #define jcv_simd_finite_f32(_V_)            vceqq_f32(vsubq_f32(_V_, _V_), vdupq_n_f32(0))
+    #define jcv_simd_and_f32(_A_, _B_)          vandq_u32(_A_, _B_)
+    #define jcv_simd_all_f32(_M_)               (vminvq_u32(_M_) != 0)
+
+    #define JCV_SIMD_F64_LANES                  2
+    typedef float64x2_t                         jcv_simd_f64;
+    typedef uint64x2_t                          jcv_simd_mask_f64;
+    #define jcv_simd_load_f64(_P_)              vld1q_f64(_P_)
+    #define jcv_simd_store_f64(_P_, _V_)        vst1q_f64(_P_, _V_)
+    #define jcv_simd_set1_f64(_X_)              vdupq_n_f64(_X_)
+    #define jcv_simd_min_f64(_A_, _B_)          vminq_f64(_A_, _B_)
+    #define jcv_simd_max_f64(_A_, _B_)          vmaxq_f64(_A_, _B_)
+    #define jcv_simd_finite_f64(_V_)            vceqq_f64(vsubq_f64(_V_, _V_), vdupq_n_f64(0))
+    #define jcv_simd_and_f64(_A_, _B_)          vandq_u64(_A_, _B_)
+    #define jcv_simd_all_f64(_M_)               ((vgetq_lane_u64(_M_, 0) & vgetq_lane_u64(_M_, 1)) != 0)
+#elif defined(JCV_SIMD_WASM)
+    #define JCV_SIMD_F32_LANES                  4
+    typedef v128_t                              jcv_simd_f32;
+    typedef v128_t                              jcv_simd_mask_f32;
+    #define jcv_simd_load_f32(_P_)              wasm_v128_load(_P_)
+    #define jcv_simd_store_f32(_P_, _V_)        wasm_v128_store(_P_, _V_)
+    #define jcv_simd_set1_f32(_X_)              wasm_f32x4_splat(_X_)
+    #define jcv_simd_min_f32(_A_, _B_)          wasm_f32x4_min(_A_, _B_)
+    #define jcv_simd_max_f32(_A_, _B_)          wasm_f32x4_max(_A_, _B_)
+    #define jcv_simd_finite_f32(_V_)            wasm_f32x4_eq(wasm_f32x4_sub(_V_, _V_), wasm_f32x4_splat(0))
+    #define jcv_simd_and_f32(_A_, _B_)          wasm_v128_and(_A_, _B_)
+    #define jcv_simd_all_f32(_M_)               wasm_i32x4_all_true(_M_)
+
+    #define JCV_SIMD_F64_LANES                  2
+    typedef v128_t                              jcv_simd_f64;
+    typedef v128_t                              jcv_simd_mask_f64;
+    #define jcv_simd_load_f64(_P_)              wasm_v128_load(_P_)
+    #define jcv_simd_store_f64(_P_, _V_)        wasm_v128_store(_P_, _V_)
+    #define jcv_simd_set1_f64(_X_)              wasm_f64x2_splat(_X_)
+    #define jcv_simd_min_f64(_A_, _B_)          wasm_f64x2_min(_A_, _B_)
+    #define jcv_simd_max_f64(_A_, _B_)          wasm_f64x2_max(_A_, _B_)
+    #define jcv_simd_finite_f64(_V_)            wasm_f64x2_eq(wasm_f64x2_sub(_V_, _V_), wasm_f64x2_splat(0))
+    #define jcv_simd_and_f64(_A_, _B_)          wasm_v128_and(_A_, _B_)
+    #define jcv_simd_all_f64(_M_)               wasm_i64x2_all_true(_M_)
+#endif
 
-    jcv_halfedge** items = pq->items;
-    int last = --pq->numitems;
-    node->pqpos = 0;
-    if (pos == last)
-        return;
+// Finds the bounds (min x, min y, max x, max y) of packed points, x0 y0 x1 y1 ... The lanes alternate
+// between x and y, as the lane count is even. Returns 0 if any coordinate is NaN or infinite
+static int jcv_simd_bounds_f32(const float* values, int num_points, float* bounds)
+{
+    int count = num_points * 2;
+    int simdcount = count - count % JCV_SIMD_F32_LANES;
+    jcv_simd_f32 vmin = jcv_simd_set1_f32(FLT_MAX);
+    jcv_simd_f32 vmax = jcv_simd_set1_f32(-FLT_MAX);
+    jcv_simd_mask_f32 finite = jcv_simd_finite_f32(vmin);
+    for( int i = 0; i < simdcount; i += JCV_SIMD_F32_LANES )
+    {
+        jcv_simd_f32 v = jcv_simd_load_f32(values + i);
+        vmin = jcv_simd_min_f32(vmin, v);
+        vmax = jcv_simd_max_f32(vmax, v);
+        finite = jcv_simd_and_f32(finite, jcv_simd_finite_f32(v));
+    }
+    if( !jcv_simd_all_f32(finite) )
+        return 0;
 
-    items[pos] = items[last];
-    if( pos > 1 && jcv_halfedge_compare(items[pos >> 1], items[pos]) )
-        jcv_pq_moveup(pq, pos);
-    else
-        jcv_pq_movedown(pq, pos);
+    float lanes[2][JCV_SIMD_F32_LANES];
+    jcv_simd_store_f32(lanes[0], vmin);
+    jcv_simd_store_f32(lanes[1], vmax);
+    bounds[0] = bounds[1] = FLT_MAX;
+    bounds[2] = bounds[3] = -FLT_MAX;
+    for( int i = 0; i < JCV_SIMD_F32_LANES; ++i )
+    {
+        bounds[i & 1] = lanes[0][i] < bounds[i & 1] ? lanes[0][i] : bounds[i & 1];
+        bounds[2 + (i & 1)] = lanes[1][i] > bounds[2 + (i & 1)] ? lanes[1][i] : bounds[2 + (i & 1)];
+    }
+    for( int i = simdcount; i < count; ++i )
+    {
+        float v = values[i];
+        if( !(v - v == 0) )
+            return 0;
+        bounds[i & 1] = v < bounds[i & 1] ? v : bounds[i & 1];
+        bounds[2 + (i & 1)] = v > bounds[2 + (i & 1)] ? v : bounds[2 + (i & 1)];
+    }
+    return 1;
 }
 
-// internal functions
-
-static inline jcv_site* jcv_nextsite(jcv_context_internal* internal)
+static int jcv_simd_bounds_f64(const double* values, int num_points, double* bounds)
 {
-    return (internal->currentsite < internal->numsites) ? &internal->sites[internal->currentsite++] : 0;
-}
+    int count = num_points * 2;
+    int simdcount = count - count % JCV_SIMD_F64_LANES;
+    jcv_simd_f64 vmin = jcv_simd_set1_f64(DBL_MAX);
+    jcv_simd_f64 vmax = jcv_simd_set1_f64(-DBL_MAX);
+    jcv_simd_mask_f64 finite = jcv_simd_finite_f64(vmin);
+    for( int i = 0; i < simdcount; i += JCV_SIMD_F64_LANES )
+    {
+        jcv_simd_f64 v = jcv_simd_load_f64(values + i);
+        vmin = jcv_simd_min_f64(vmin, v);
+        vmax = jcv_simd_max_f64(vmax, v);
+        finite = jcv_simd_and_f64(finite, jcv_simd_finite_f64(v));
+    }
+    if( !jcv_simd_all_f64(finite) )
+        return 0;
 
-static jcv_halfedge* jcv_get_edge_above_x(jcv_context_internal* internal, const jcv_point* p)
-{
-    // Gets the arc on the beach line at the x coordinate (i.e. right above the new site event)
-    jcv_halfedge* sentinel = &internal->beachline_nil;
-    jcv_halfedge* node = internal->beachline_root;
-    jcv_halfedge* predecessor = internal->beachline_start;
-    while (node != sentinel)
+    double lanes[2][JCV_SIMD_F64_LANES];
+    jcv_simd_store_f64(lanes[0], vmin);
+    jcv_simd_store_f64(lanes[1], vmax);
+    bounds[0] = bounds[1] = DBL_MAX;
+    bounds[2] = bounds[3] = -DBL_MAX;
+    for( int i = 0; i < JCV_SIMD_F64_LANES; ++i )
     {
-        if (jcv_halfedge_rightof(node, p))
-        {
-            predecessor = node;
-            node = node->tree_right;
-        }
-        else
-        {
-            node = node->tree_left;
-        }
+        bounds[i & 1] = lanes[0][i] < bounds[i & 1] ? lanes[0][i] : bounds[i & 1];
+        bounds[2 + (i & 1)] = lanes[1][i] > bounds[2 + (i & 1)] ? lanes[1][i] : bounds[2 + (i & 1)];
     }
-    return predecessor;
+    for( int i = simdcount; i < count; ++i )
+    {
+        double v = values[i];
+        if( !(v - v == 0) )
+            return 0;
+        bounds[i & 1] = v < bounds[i & 1] ? v : bounds[i & 1];
+        bounds[2 + (i & 1)] = v > bounds[2 + (i & 1)] ? v : bounds[2 + (i & 1)];
+    }
+    return 1;
 }
 
-static int jcv_check_circle_event(const jcv_halfedge* he1, const jcv_halfedge* he2, jcv_point* vertex)
+#endif // JCV_HAS_SIMD
+
+// Finds the bounds of packed input (e.g. a jcv_point array) with SIMD. Returns 0 if there is no SIMD path
+// for the input (strided or int32 input, or no SIMD target), or if any point is NaN or infinite
+static int jcv_point_input_simd_bounds(const jcv_point_input* input, int num_points, jcv_rect* rect)
 {
-    jcv_edge_internal* e1 = he1->edge;
-    jcv_edge_internal* e2 = he2->edge;
-    if( e1 == 0 || e2 == 0 || e1->sites[1] == e2->sites[1] )
-    {
+#if defined(JCV_HAS_SIMD)
+    if( num_points <= 0 || input->is_int32 || input->stride != sizeof(jcv_point) || input->y != input->x + sizeof(jcv_real) )
         return 0;
+    const void* values = input->x;
+    if( sizeof(jcv_real) == sizeof(float) )
+    {
+        float bounds[4];
+        if( !jcv_simd_bounds_f32((const float*)values, num_points, bounds) )
+            return 0;
+        rect->min.x = (jcv_real)bounds[0];
+        rect->min.y = (jcv_real)bounds[1];
+        rect->max.x = (jcv_real)bounds[2];
+        rect->max.y = (jcv_real)bounds[3];
+        return 1;
     }
-
-    return jcv_halfedge_intersect(he1, he2, vertex);
+    if( sizeof(jcv_real) == sizeof(double) )
+    {
+        double bounds[4];
+        if( !jcv_simd_bounds_f64((const double*)values, num_points, bounds) )
+            return 0;
+        rect->min.x = (jcv_real)bounds[0];
+        rect->min.y = (jcv_real)bounds[1];
+        rect->max.x = (jcv_real)bounds[2];
+        rect->max.y = (jcv_real)bounds[3];
+        return 1;
+    }
+    return 0;
+#else
+    (void)input;
+    (void)num_points;
+    (void)rect;
+    return 0;
+#endif
 }
 
-// Computes center.y + radius without catastrophic cancellation when the
-// circumcenter is far below the site. This is algebraically equivalent to
-// radius - dy = dx^2 / (radius + dy), where dy = site.y - center.y.
-static jcv_real jcv_calc_circle_event_y(const jcv_site* site, const jcv_point* center)
+static int jcv_diagram_generate_internal(int num_points, const jcv_point_input* points, const jcv_real* weights,
+                                         const jcv_point* band, const jcv_rect* rect, const jcv_clipper* clipper,
+                                         void* userallocctx, FJCVAllocFn allocfn, FJCVFreeFn freefn,
+                                         unsigned int options, jcv_diagram* d);
+
+void jcv_diagram_generate( int num_points, const jcv_point* points, const jcv_rect* rect, const jcv_clipper* clipper, jcv_diagram* d )
 {
-    jcv_real dx = site->p.x - center->x;
-    jcv_real dy = site->p.y - center->y;
-    jcv_real radius = JCV_SQRT(dx * dx + dy * dy);
-    if( dy > (jcv_real)0 )
-        return site->p.y + (dx * dx) / (radius + dy);
-    return center->y + radius;
+    jcv_point_input input = jcv_point_input_strided(points, sizeof(jcv_point));
+    jcv_diagram_generate_internal(num_points, &input, 0, 0, rect, clipper, 0, jcv_alloc_fn, jcv_free_fn, JCV_OPTION_NONE, d);
 }
 
-static void jcv_site_event(jcv_context_internal* internal, jcv_site* site)
+void jcv_delaunay_generate( int num_points, const jcv_point* points, const jcv_rect* rect, const jcv_clipper* clipper, jcv_diagram* d )
 {
-    jcv_halfedge* left   = jcv_get_edge_above_x(internal, &site->p);
-    jcv_halfedge* right  = left->right;
-    jcv_site*     bottom = jcv_halfedge_rightsite(left);
-    if( !bottom )
-        bottom = internal->bottomsite;
-
-    jcv_edge_internal* edge = jcv_edge_new(internal, bottom, site);
-    edge->next = internal->edges;
-    internal->edges = edge;
-    ++internal->numedges;
-    ++internal->numdelaunayedges;
-
-    jcv_halfedge* edge1 = jcv_halfedge_new(internal, edge, JCV_DIRECTION_LEFT);
-    jcv_halfedge* edge2 = jcv_halfedge_new(internal, edge, JCV_DIRECTION_RIGHT);
-
-    jcv_beachline_insert_after(internal, left, edge1);
-    jcv_beachline_insert_after(internal, edge1, edge2);
+    jcv_point_input input = jcv_point_input_strided(points, sizeof(jcv_point));
+    jcv_diagram_generate_internal(num_points, &input, 0, 0, rect, clipper, 0, jcv_alloc_fn, jcv_free_fn, JCV_OPTION_DELAUNAY_ONLY, d);
+}
 
-    jcv_point p;
-    if( jcv_check_circle_event( left, edge1, &p ) )
-    {
-        jcv_pq_remove(internal->eventqueue, left);
-        left->vertex    = p;
-        left->y         = jcv_calc_circle_event_y(site, &p);
-        jcv_pq_push(internal->eventqueue, left);
-    }
-    if( jcv_check_circle_event( edge2, right, &p ) )
-    {
-        edge2->vertex   = p;
-        edge2->y        = jcv_calc_circle_event_y(site, &p);
-        jcv_pq_push(internal->eventqueue, edge2);
-    }
+void jcv_diagram_generate_lazy( int num_points, const jcv_point* points, const jcv_rect* rect, const jcv_clipper* clipper, jcv_diagram* d )
+{
+    jcv_point_input input = jcv_point_input_strided(points, sizeof(jcv_point));
+    jcv_diagram_generate_internal(num_points, &input, 0, 0, rect, clipper, 0, jcv_alloc_fn, jcv_free_fn, JCV_OPTION_LAZY_CELLS, d);
 }
 
-// https://cp-algorithms.com/geometry/oriented-triangle-area.html
-static inline jcv_real jcv_determinant(const jcv_point* a, const jcv_point* b, const jcv_point* c)
+void jcv_diagram_generate_weighted( int num_points, const jcv_point* points, const jcv_real* weights, const jcv_rect* rect, const jcv_clipper* clipper, jcv_diagram* d )
 {
-    return (b->x - a->x)*(c->y - a->y) - (b->y - a->y)*(c->x - a->x);
+    jcv_point_input input = jcv_point_input_strided(points, sizeof(jcv_point));
+    jcv_diagram_generate_internal(num_points, &input, weights, 0, rect, clipper, 0, jcv_alloc_fn, jcv_free_fn, JCV_OPTION_NONE, d);
 }
 
-static void jcv_graphedge_copy(const jcv_graphedge* source, jcv_edge* target)
+void jcv_diagram_generate_periodic( int num_points, const jcv_point* points, const jcv_rect* rect, jcv_diagram* d )
 {
-    const jcv_edge_internal* edge = source->edge;
-    int site_index = source->site_index;
-    if( edge->sites[1] == 0 )
+    jcv_point size;
+    size.x = rect ? rect->max.x - rect->min.x : 0;
+    size.y = rect ? rect->max.y - rect->min.y : 0;
+    if( !(size.x > 0 && size.y > 0) )
     {
-        jcv_edge_copy(edge, target);
+        jcv_diagram_generate(num_points, points, rect, 0, d);
         return;
     }
-    int flip = source->flip;
-    target->sites[0] = edge->sites[site_index];
-    target->sites[1] = edge->sites[1-site_index];
-    target->pos[flip] = edge->pos[site_index];
-    target->pos[1-flip] = edge->pos[1-site_index];
-    target->vertices[flip] = edge->vertices[site_index];
-    target->vertices[1-flip] = edge->vertices[1-site_index];
-    target->a = edge->a;
-    target->b = edge->b;
-    target->c = edge->c;
+    jcv_point_input input = jcv_point_input_strided(points, sizeof(jcv_point));
+    // A few times the average distance between sites covers the cells along the sides, nearly always
+    jcv_real band = 4 * JCV_SQRT(size.x * size.y / (jcv_real)(num_points > 0 ? num_points : 1));
+    for(;;)
+    {
+        jcv_point b;
+        b.x = jcv_min(band, size.x);
+        b.y = jcv_min(band, size.y);
+        if( jcv_diagram_generate_internal(num_points, &input, 0, &b, rect, 0, 0, jcv_alloc_fn, jcv_free_fn, JCV_OPTION_NONE, d) )
+            return;
+        band *= 2;
+    }
 }
 
-static inline const jcv_point* jcv_graphedge_pos(const jcv_graphedge* edge, int endpoint)
+void jcv_diagram_generate_strided( int num_points, const jcv_point* points, size_t stride, const jcv_rect* rect, const jcv_clipper* clipper, jcv_diagram* d )
 {
-    int source_index = endpoint == edge->flip ? edge->site_index : 1 - edge->site_index;
-    return &edge->edge->pos[source_index];
+    jcv_point_input input = jcv_point_input_strided(points, stride);
+    jcv_diagram_generate_internal(num_points, &input, 0, 0, rect, clipper, 0, jcv_alloc_fn, jcv_free_fn, JCV_OPTION_NONE, d);
 }
 
-// A monotonic mapping of [0, 2*pi) to [0, 4). It preserves polar ordering
-// without the cost of atan2. The scaled fallback avoids overflowing the
-// denominator for very large, finite coordinates.
-static inline jcv_real jcv_pseudo_angle(jcv_real x, jcv_real y)
+void jcv_diagram_generate_soa( int num_points, const jcv_real* x, const jcv_real* y, const jcv_rect* rect, const jcv_clipper* clipper, jcv_diagram* d )
 {
-    jcv_real absx = jcv_abs(x);
-    jcv_real absy = jcv_abs(y);
-    jcv_real denominator = absx + absy;
-    if( denominator == (jcv_real)0 )
-        return (jcv_real)0;
+    jcv_point_input input;
+    input.x = (const char*)x;
+    input.y = (const char*)y;
+    input.stride = sizeof(jcv_real);
+    input.is_int32 = 0;
+    jcv_diagram_generate_internal(num_points, &input, 0, 0, rect, clipper, 0, jcv_alloc_fn, jcv_free_fn, JCV_OPTION_NONE, d);
+}
 
-    jcv_real angle;
-    if( denominator <= (jcv_real)JCV_FLT_MAX )
-    {
-        angle = y / denominator;
-    }
-    else
-    {
-        jcv_real scale = jcv_max(absx, absy);
-        angle = (y / scale) / (absx / scale + absy / scale);
-    }
+void jcv_diagram_generate_int( int num_points, const int32_t* points, const jcv_rect* rect, const jcv_clipper* clipper, jcv_diagram* d )
+{
+    jcv_point_input input;
+    input.x = (const char*)points;
+    input.y = (const char*)(points + 1);
+    input.stride = 2 * sizeof(int32_t);
+    input.is_int32 = 1;
+    jcv_diagram_generate_internal(num_points, &input, 0, 0, rect, clipper, 0, jcv_alloc_fn, jcv_free_fn, JCV_OPTION_EXACT_VERTICES, d);
+}
 
-    if( x < (jcv_real)0 )
-        angle = (jcv_real)2 - angle;
-    else if( y < (jcv_real)0 )
-        angle = (jcv_real)4 + angle;
-    return angle;
+void jcv_diagram_generate_normalized( int num_points, const jcv_point* points, const jcv_rect* rect, jcv_diagram* d )
+{
+    jcv_point_input input = jcv_point_input_strided(points, sizeof(jcv_point));
+    jcv_diagram_generate_internal(num_points, &input, 0, 0, rect, 0, 0, jcv_alloc_fn, jcv_free_fn, JCV_OPTION_NORMALIZE, d);
 }
 
-static inline jcv_real jcv_calc_sort_metric(const jcv_site* site, const jcv_graphedge* edge)
+void jcv_diagram_generate_useralloc( int num_points, const jcv_point* points, const jcv_rect* rect, const jcv_clipper* clipper, void* userallocctx, FJCVAllocFn allocfn, FJCVFreeFn freefn, jcv_diagram* d )
 {
-    const jcv_point* pos0 = jcv_graphedge_pos(edge, 0);
-    const jcv_point* pos1 = jcv_graphedge_pos(edge, 1);
-    jcv_real half = 1/(jcv_real)2;
-    jcv_real x = (pos0->x + pos1->x) * half;
-    jcv_real y = (pos0->y + pos1->y) * half;
-    return jcv_pseudo_angle(x - site->p.x, y - site->p.y);
+    jcv_point_input input = jcv_point_input_strided(points, sizeof(jcv_point));
+    jcv_diagram_generate_internal(num_points, &input, 0, 0, rect, clipper, userallocctx, allocfn, freefn, JCV_OPTION_NONE, d);
 }
 
-static inline int jcv_graphedge_eq(jcv_graphedge* a, jcv_graphedge* b)
+typedef union jcv_cast_align_struct_
 {
-    return jcv_real_eq(a->angle, b->angle) &&
-        jcv_point_eq(jcv_graphedge_pos(a, 0), jcv_graphedge_pos(b, 0)) &&
-        jcv_point_eq(jcv_graphedge_pos(a, 1), jcv_graphedge_pos(b, 1));
+    char*                   charp;
+    jcv_halfedge_event**    halfedgeeventpp;
+    jcv_context_internal*   internalp;
+    jcv_site*               sitep;
+    jcv_priorityqueue*      priorityqueuep;
+} jcv_cast_align_struct;
+
+static inline void jcv_rect_union(jcv_rect* rect, const jcv_point* p)
+{
+    rect->min.x = jcv_min(rect->min.x, p->x);
+    rect->min.y = jcv_min(rect->min.y, p->y);
+    rect->max.x = jcv_max(rect->max.x, p->x);
+    rect->max.y = jcv_max(rect->max.y, p->y);
 }
 
-static void jcv_sortedges_insert(jcv_context_internal* internal, jcv_site* site, jcv_graphedge* edge)
+static inline void jcv_rect_round(jcv_rect* rect)
 {
-    int site_index = (int)(site - internal->sites);
-    ++internal->build_site_counts[site_index];
-    jcv_graphedge** head = &internal->build_site_edges[site_index];
-    jcv_graphedge* prev = 0;
-    jcv_graphedge* first = *head;
-    if( first == 0 || first->angle >= edge->angle )
-    {
-        edge->next = first;
-        *head = edge;
-    }
-    else
-    {
-        jcv_graphedge* current = first;
-        while( current->next != 0 && current->next->angle < edge->angle )
-            current = current->next;
-        prev = current;
-        edge->next = current->next;
-        current->next = edge;
-    }
-    if( prev && jcv_graphedge_eq(prev, edge) )
-    {
-        prev->next = edge->next;
-        --internal->build_site_counts[site_index];
-    }
-    else if( edge->next && jcv_graphedge_eq(edge, edge->next) )
-    {
-        edge->next = edge->next->next;
-        --internal->build_site_counts[site_index];
-    }
+    rect->min.x = jcv_floor(rect->min.x);
+    rect->min.y = jcv_floor(rect->min.y);
+    rect->max.x = jcv_ceil(rect->max.x);
+    rect->max.y = jcv_ceil(rect->max.y);
 }
 
-static void jcv_create_graphedge(jcv_context_internal* internal, jcv_edge_internal* e, int site_index, jcv_graphedge* ge)
+static inline void jcv_rect_inflate(jcv_rect* rect, jcv_real amount)
 {
-    ge->edge = e;
-    ge->next = 0;
-    ge->site_index = (unsigned char)site_index;
-    ge->flip = (unsigned char)(jcv_determinant(&e->sites[0]->p, &e->pos[0], &e->pos[1]) > (jcv_real)0 ? 0 : 1);
-    ge->angle = jcv_calc_sort_metric(e->sites[site_index], ge);
-    jcv_sortedges_insert(internal, e->sites[site_index], ge);
+    rect->min.x -= amount;
+    rect->min.y -= amount;
+    rect->max.x += amount;
+    rect->max.y += amount;
 }
 
-static void jcv_build_graph_edges(jcv_context_internal* internal)
+static int jcv_prune_duplicates(jcv_context_internal* internal, jcv_rect* rect)
 {
-    memset(internal->build_site_counts, 0, sizeof(int) * (size_t)internal->numsites);
-    int numgraphedges = 0;
-    for( jcv_edge_internal* e = internal->edges; e; e = e->next )
+    int num_sites = internal->numsites;
+    jcv_site* sites = internal->sites;
+
+    jcv_rect r;
+    r.min.x = r.min.y = JCV_FLT_MAX;
+    r.max.x = r.max.y = -JCV_FLT_MAX;
+
+    int offset = 0;
+    // Prune duplicates first
+    for (int i = 0; i < num_sites; i++)
     {
-        if( !jcv_edge_clipline(internal, e) || jcv_point_eq(&e->pos[0], &e->pos[1]) )
+        const jcv_site* s = &sites[i];
+        // Remove duplicates, to avoid anomalies
+        if( i > 0 && jcv_point_eq(&s->p, &sites[i - 1].p) )
         {
-            e->pos[1] = e->pos[0];
-            e->a = JCV_INVALID_VALUE;
-            --internal->numedges;
-            --internal->numdelaunayedges;
+            offset++;
             continue;
         }
-        if( internal->clipper.fill_fn == jcv_boxshape_fillgaps &&
-            (jcv_point_on_box_edge(&e->pos[0], &internal->clipper.min, &internal->clipper.max) ||
-             jcv_point_on_box_edge(&e->pos[1], &internal->clipper.min, &internal->clipper.max)) )
-        {
-            e->sites[0]->boundary = 1;
-            e->sites[1]->boundary = 1;
+
+        sites[i - offset] = sites[i];
+
+        if (rect) {
+            jcv_rect_union(&r, &s->p);
         }
-        numgraphedges += 2;
     }
-    if( numgraphedges == 0 )
-        return;
+    internal->numsites -= offset;
+    if (rect) {
+        *rect = r;
+    }
+    return offset;
+}
 
-    jcv_graphedge* graphedges = (jcv_graphedge*)jcv_temp_alloc(internal, sizeof(jcv_graphedge) * (size_t)numgraphedges);
-    int cursor = 0;
-    for( jcv_edge_internal* e = internal->edges; e; e = e->next )
+static int jcv_prune_not_in_shape(jcv_context_internal* internal, jcv_rect* rect)
+{
+    int num_sites = internal->numsites;
+    jcv_site* sites = internal->sites;
+
+    jcv_rect r;
+    r.min.x = r.min.y = JCV_FLT_MAX;
+    r.max.x = r.max.y = -JCV_FLT_MAX;
+
+    int offset = 0;
+    for (int i = 0; i < num_sites; i++)
     {
-        if( e->a == JCV_INVALID_VALUE )
+        const jcv_site* s = &sites[i];
+
+        if (!internal->clipper.test_fn(&internal->clipper, s->p))
+        {
+            offset++;
             continue;
-        jcv_create_graphedge(internal, e, 0, &graphedges[cursor++]);
-        jcv_create_graphedge(internal, e, 1, &graphedges[cursor++]);
+        }
+
+        sites[i - offset] = sites[i];
+
+        jcv_rect_union(&r, &s->p);
+    }
+    internal->numsites -= offset;
+    if (rect) {
+        *rect = r;
     }
+    return offset;
 }
 
-static void jcv_endpos(jcv_edge_internal* e, const jcv_point* p, int direction, int vertex)
+static jcv_context_internal* jcv_alloc_internal(int num_points, void* userallocctx, FJCVAllocFn allocfn, FJCVFreeFn freefn)
+{
+    // Interesting limits from Euler's equation
+    // Slide 81: https://courses.cs.washington.edu/courses/csep521/01au/lectures/lecture10slides.pdf
+    // Page 3: https://sites.cs.ucsb.edu/~suri/cs235/Voronoi.pdf
+    size_t eventssize = (size_t)(num_points*2) * sizeof(jcv_halfedge*); // beachline can have max 2*n-5 parabolas
+    size_t sitessize = (size_t)num_points * sizeof(jcv_site);
+    size_t memsize = sizeof(jcv_priorityqueue) + eventssize + sitessize + sizeof(jcv_context_internal) + 16u; // 16 bytes padding for alignment
+
+    char* originalmem = (char*)allocfn(userallocctx, memsize);
+    memset(originalmem, 0, memsize);
+
+    // align memory
+    char* mem = (char*)jcv_align(originalmem, sizeof(void*));
+
+    jcv_cast_align_struct aligned;
+    aligned.charp = mem;
+    jcv_context_internal* internal = aligned.internalp;
+    mem += sizeof(jcv_context_internal);
+    internal->mem    = originalmem;
+    internal->memctx = userallocctx;
+    internal->alloc  = allocfn;
+    internal->free   = freefn;
+
+    mem = (char*)jcv_align(mem, sizeof(void*));
+    aligned.charp = mem;
+    internal->sites = aligned.sitep;
+    mem += sitessize;
+
+    mem = (char*)jcv_align(mem, sizeof(void*));
+    aligned.charp = mem;
+    internal->eventqueue = aligned.priorityqueuep;
+    mem += sizeof(jcv_priorityqueue);
+    assert( ((uintptr_t)mem & (sizeof(void*)-1)) == 0 );
+
+    jcv_cast_align_struct tmp;
+    tmp.charp = mem;
+    internal->eventmem = tmp.halfedgeeventpp;
+
+    assert((mem+eventssize) <= (originalmem+memsize));
+
+    return internal;
+}
+
+// Power diagrams
+//
+// A site's power cell can be empty, or not contain the site at all, so the weighted
+// diagram can't be swept with the beachline. Instead it's built from the dual regular
+// triangulation (incremental Bowyer-Watson with power tests), whose edges are then
+// turned into power bisector segments and finished like the swept edges.
+
+typedef struct jcv_power_triangle_
+{
+    int v[3];   // Counter clockwise vertices. v[0] < 0 marks a free triangle
+    int n[3];   // The neighbour opposite of each vertex, or -1
+} jcv_power_triangle;
+
+typedef struct jcv_power_context_
+{
+    double*             x;          // Vertex positions, relative to the center of the bounds
+    double*             y;
+    double*             w;
+    jcv_power_triangle* triangles;
+    int*                stamps;     // Per triangle: 2*k if in the k:th cavity, 2*k+1 if tested and outside
+    int*                freelist;
+    int*                stack;
+    int*                boundary;   // Cavity boundary as triplets of (a, b, outside neighbour)
+    int*                slots;      // Per vertex: the new triangle starting at, and ending at, that vertex
+    int                 numtriangles;
+    int                 numfree;
+} jcv_power_context;
+
+static inline double jcv_power_orient(const jcv_power_context* ctx, int a, int b, int c)
+{
+    return (ctx->x[b] - ctx->x[a]) * (ctx->y[c] - ctx->y[a]) - (ctx->y[b] - ctx->y[a]) * (ctx->x[c] - ctx->x[a]);
+}
+
+// Positive if p is closer, in the power distance, to the orthocircle of the counter clockwise
+// triangle than to its vertices, i.e. if the triangle isn't regular with p inserted
+static double jcv_power_test(const jcv_power_context* ctx, const jcv_power_triangle* t, int p)
+{
+    double px = ctx->x[p];
+    double py = ctx->y[p];
+    double pw = ctx->w[p];
+    double adx = ctx->x[t->v[0]] - px, ady = ctx->y[t->v[0]] - py;
+    double bdx = ctx->x[t->v[1]] - px, bdy = ctx->y[t->v[1]] - py;
+    double cdx = ctx->x[t->v[2]] - px, cdy = ctx->y[t->v[2]] - py;
+    double alift = adx*adx + ady*ady - ctx->w[t->v[0]] + pw;
+    double blift = bdx*bdx + bdy*bdy - ctx->w[t->v[1]] + pw;
+    double clift = cdx*cdx + cdy*cdy - ctx->w[t->v[2]] + pw;
+    return alift * (bdx*cdy - bdy*cdx) + blift * (cdx*ady - cdy*adx) + clift * (adx*bdy - ady*bdx);
+}
+
+static int jcv_power_new_triangle(jcv_power_context* ctx, int a, int b, int c)
 {
-    e->pos[direction] = *p;
-    e->vertices[direction] = vertex;
+    int index = ctx->numfree > 0 ? ctx->freelist[--ctx->numfree] : ctx->numtriangles++;
+    jcv_power_triangle* t = &ctx->triangles[index];
+    t->v[0] = a;
+    t->v[1] = b;
+    t->v[2] = c;
+    t->n[0] = t->n[1] = t->n[2] = -1;
+    ctx->stamps[index] = -1;
+    return index;
 }
 
-static jcv_edge_internal* jcv_create_gap_edge(jcv_context_internal* internal, jcv_site* site,
-    const jcv_point* pos0, const jcv_point* pos1, int vertex0, int vertex1)
+static int jcv_power_locate(const jcv_power_context* ctx, int start, int p)
 {
-    jcv_edge_internal* edge  = jcv_alloc_edge(internal);
-    edge->pos[0] = *pos0;
-    edge->pos[1] = *pos1;
-    edge->vertices[0] = vertex0;
-    edge->vertices[1] = vertex1;
-    edge->sites[0]  = site;
-    edge->sites[1]  = 0;
-    edge->a = edge->b = edge->c = 0;
-    edge->next      = internal->edges;
-    internal->edges = edge;
-    if( !jcv_point_eq(pos0, pos1) )
-        ++internal->numedges;
-    return edge;
+    int t = start;
+    unsigned int seed = (unsigned int)p;
+    for(;;)
+    {
+        // A varying first edge keeps the walk from cycling on degenerate input
+        seed = seed * 1103515245u + 12345u;
+        int first = (int)((seed >> 16) % 3u);
+        int next = -1;
+        for( int k = 0; k < 3 && next < 0; ++k )
+        {
+            int i = (first + k) % 3;
+            const jcv_power_triangle* tri = &ctx->triangles[t];
+            if( tri->n[i] >= 0 && jcv_power_orient(ctx, tri->v[(i+1)%3], tri->v[(i+2)%3], p) < 0 )
+                next = tri->n[i];
+        }
+        if( next < 0 )
+            return t;
+        t = next;
+    }
 }
 
-static jcv_graphedge* jcv_insert_gap_after(jcv_context_internal* internal, jcv_site* site,
-    jcv_graphedge* current, const jcv_point* pos0, const jcv_point* pos1, int vertex0, int vertex1)
+// Inserts the vertex p, and returns a triangle incident to it, or -1 if p is redundant
+static int jcv_power_insert(jcv_power_context* ctx, int start, int p)
 {
-    int site_index = (int)(site - internal->sites);
-    jcv_edge_internal* edge = jcv_create_gap_edge(internal, site, pos0, pos1, vertex0, vertex1);
-    jcv_graphedge* gap = jcv_alloc_graphedge(internal);
-    gap->edge = edge;
-    gap->site_index = 0;
-    gap->flip = 0;
-    gap->angle = jcv_calc_sort_metric(site, gap);
-    if( current )
+    int t0 = jcv_power_locate(ctx, start, p);
+    if( !(jcv_power_test(ctx, &ctx->triangles[t0], p) > 0) )
+        return -1;
+
+    int incavity = 2 * p;
+    int outside = 2 * p + 1;
+    int numstack = 0;
+    int numboundary = 0;
+    ctx->stamps[t0] = incavity;
+    ctx->stack[numstack++] = t0;
+    int numcavity = 0;
+    while( numcavity < numstack )
     {
-        gap->next = current->next;
-        current->next = gap;
+        int t = ctx->stack[numcavity++];
+        for( int i = 0; i < 3; ++i )
+        {
+            const jcv_power_triangle* tri = &ctx->triangles[t];
+            int a = tri->v[(i+1)%3];
+            int b = tri->v[(i+2)%3];
+            int u = tri->n[i];
+            if( u >= 0 && ctx->stamps[u] == incavity )
+                continue;
+            // The new triangles must all be counter clockwise, so an edge that p doesn't
+            // strictly see (possible through rounding) takes its neighbour into the cavity
+            if( u >= 0 && ctx->stamps[u] != outside &&
+                (jcv_power_test(ctx, &ctx->triangles[u], p) > 0 || !(jcv_power_orient(ctx, a, b, p) > 0)) )
+            {
+                ctx->stamps[u] = incavity;
+                ctx->stack[numstack++] = u;
+                continue;
+            }
+            if( u >= 0 )
+                ctx->stamps[u] = outside;
+            ctx->boundary[numboundary*3+0] = a;
+            ctx->boundary[numboundary*3+1] = b;
+            ctx->boundary[numboundary*3+2] = u;
+            ++numboundary;
+        }
     }
-    else
+
+    for( int i = 0; i < numstack; ++i )
     {
-        gap->next = internal->build_site_edges[site_index];
-        internal->build_site_edges[site_index] = gap;
+        ctx->triangles[ctx->stack[i]].v[0] = -1;
+        ctx->freelist[ctx->numfree++] = ctx->stack[i];
     }
-    ++internal->build_site_counts[site_index];
-    return gap;
+
+    int first = -1;
+    for( int i = 0; i < numboundary; ++i )
+    {
+        int a = ctx->boundary[i*3+0];
+        int b = ctx->boundary[i*3+1];
+        int u = ctx->boundary[i*3+2];
+        int t = jcv_power_new_triangle(ctx, p, a, b);
+        ctx->triangles[t].n[0] = u;
+        if( u >= 0 )
+        {
+            jcv_power_triangle* outer = &ctx->triangles[u];
+            for( int j = 0; j < 3; ++j )
+            {
+                if( outer->v[(j+1)%3] == b && outer->v[(j+2)%3] == a )
+                    outer->n[j] = t;
+            }
+            ctx->stamps[u] = -1;
+        }
+        ctx->slots[a*2+0] = t;
+        ctx->slots[b*2+1] = t;
+        first = t;
+    }
+    // Link the fan around p: the edge (b, p) is shared with the triangle starting at b
+    for( int i = 0; i < numboundary; ++i )
+    {
+        int a = ctx->boundary[i*3+0];
+        int b = ctx->boundary[i*3+1];
+        int t = ctx->slots[a*2+0];
+        ctx->triangles[t].n[1] = ctx->slots[b*2+0];
+        ctx->triangles[t].n[2] = ctx->slots[a*2+1];
+    }
+    return first;
 }
 
-// Construction helpers used by optional clippers. The handles are deliberately
-// opaque so a clipper never depends on the internal edge representation.
-static void* jcv_clip_site_edge_head(jcv_context_internal* internal, const jcv_site* site)
+static inline uint32_t jcv_morton_spread(uint32_t v)
 {
-    return internal->build_site_edges[site - internal->sites];
+    v &= 0xFFFF;
+    v = (v | (v << 8)) & 0x00FF00FF;
+    v = (v | (v << 4)) & 0x0F0F0F0F;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
 }
 
-static void* jcv_clip_site_edge_next(void* edge)
+// Returns the vertices in Morton order, which keeps each point location walk short
+static int* jcv_power_insertion_order(jcv_context_internal* internal, const jcv_power_context* ctx, int numsites, double extent)
 {
-    return edge ? ((jcv_graphedge*)edge)->next : 0;
+    uint32_t* keys = (uint32_t*)jcv_temp_alloc(internal, sizeof(uint32_t) * (size_t)numsites * 2);
+    int* order = (int*)jcv_temp_alloc(internal, sizeof(int) * (size_t)numsites * 2);
+    uint32_t* tmpkeys = keys + numsites;
+    int* tmporder = order + numsites;
+    double scale = extent > 0 ? 65535.0 / (2 * extent) : 0;
+    for( int i = 0; i < numsites; ++i )
+    {
+        uint32_t qx = (uint32_t)((ctx->x[i] + extent) * scale);
+        uint32_t qy = (uint32_t)((ctx->y[i] + extent) * scale);
+        keys[i] = jcv_morton_spread(qx) | (jcv_morton_spread(qy) << 1);
+        order[i] = i;
+    }
+
+    // LSD radix sort, a byte per pass
+    for( int shift = 0; shift < 32; shift += 8 )
+    {
+        int counts[257] = {0};
+        for( int i = 0; i < numsites; ++i )
+            counts[((keys[i] >> shift) & 0xFF) + 1]++;
+        for( int i = 0; i < 256; ++i )
+            counts[i+1] += counts[i];
+        for( int i = 0; i < numsites; ++i )
+        {
+            int slot = counts[(keys[i] >> shift) & 0xFF]++;
+            tmpkeys[slot] = keys[i];
+            tmporder[slot] = order[i];
+        }
+        uint32_t* swapkeys = keys; keys = tmpkeys; tmpkeys = swapkeys;
+        int* swaporder = order; order = tmporder; tmporder = swaporder;
+    }
+    return order;
 }
 
-static void jcv_clip_site_edge_copy(const void* edge, jcv_edge* output)
+static void jcv_power_center(const jcv_power_context* ctx, const jcv_power_triangle* t, double* outx, double* outy)
 {
-    jcv_graphedge_copy((const jcv_graphedge*)edge, output);
+    int a = t->v[0];
+    double bx = ctx->x[t->v[1]] - ctx->x[a], by = ctx->y[t->v[1]] - ctx->y[a];
+    double cx = ctx->x[t->v[2]] - ctx->x[a], cy = ctx->y[t->v[2]] - ctx->y[a];
+    double b2 = bx*bx + by*by - (ctx->w[t->v[1]] - ctx->w[a]);
+    double c2 = cx*cx + cy*cy - (ctx->w[t->v[2]] - ctx->w[a]);
+    double d = 2 * (bx*cy - by*cx);
+    *outx = ctx->x[a] + (b2*cy - c2*by) / d;
+    *outy = ctx->y[a] + (c2*bx - b2*cx) / d;
 }
 
-static void* jcv_clip_site_insert_gap(jcv_context_internal* internal, jcv_site* site, void* current,
-    const jcv_point* pos0, const jcv_point* pos1, int vertex0, int vertex1)
+// The power bisector: points with equal power distance to both sites
+static void jcv_power_edge_create(jcv_edge_internal* e, jcv_site* s1, jcv_site* s2, jcv_real w1, jcv_real w2)
 {
-    return jcv_insert_gap_after(internal, site, (jcv_graphedge*)current, pos0, pos1, vertex0, vertex1);
+    jcv_edge_create(e, s1, s2);
+    jcv_real dx = s2->p.x - s1->p.x;
+    jcv_real dy = s2->p.y - s1->p.y;
+    e->c += (w1 - w2) * (jcv_real)0.5 / ((dx*dx) > (dy*dy) ? dx : dy);
 }
 
-void jcv_boxshape_fillgaps(const jcv_clipper* clipper, jcv_context_internal* allocator, jcv_site* site)
+// Clips the segment to the rect, snapping clipped ends exactly onto the rect's sides.
+// Returns 0 if nothing remains.
+static int jcv_power_clip_segment(const double* rect, double* p0, double* p1, int* clipped)
 {
-    // They're sorted CCW, so if the current->pos[1] != next->pos[0], then we have a gap
-    int site_index = (int)(site - allocator->sites);
-    jcv_graphedge* current = allocator->build_site_edges[site_index];
-    if( !current )
-    {
-        assert( allocator->numsites == 1 );
-        jcv_point end = {clipper->max.x, clipper->min.y};
-        int vertex0 = allocator->numvertices++;
-        int vertex1 = allocator->numvertices++;
-        current = jcv_insert_gap_after(allocator, site, 0, &clipper->min, &end, vertex0, vertex1);
-    }
-
-    jcv_graphedge* next = current->next;
-    if( !next )
+    double t0 = 0;
+    double t1 = 1;
+    int side0 = -1;
+    int side1 = -1;
+    double d[2] = { p1[0] - p0[0], p1[1] - p0[1] };
+    for( int side = 0; side < 4; ++side )
     {
-        jcv_edge current_edge;
-        jcv_graphedge_copy(current, &current_edge);
-        jcv_point corner;
-        if( current_edge.pos[1].x < allocator->rect.max.x && current_edge.pos[1].y == allocator->rect.min.y )
+        int axis = side & 1;
+        double bound = rect[side];
+        // Sides 0,1 are the minimum x,y and sides 2,3 the maximum x,y
+        double num = side < 2 ? p0[axis] - bound : bound - p0[axis];
+        double den = side < 2 ? -d[axis] : d[axis];
+        if( den == 0 )
         {
-            corner.x = allocator->rect.max.x;
-            corner.y = allocator->rect.min.y;
+            if( num < 0 )
+                return 0;
+            continue;
         }
-        else if( current_edge.pos[1].x > allocator->rect.min.x && current_edge.pos[1].y == allocator->rect.max.y )
+        double t = num / den;
+        if( den < 0 )
         {
-            corner.x = allocator->rect.min.x;
-            corner.y = allocator->rect.max.y;
+            if( t > t0 ) { t0 = t; side0 = side; }
         }
-        else if( current_edge.pos[1].y > allocator->rect.min.y && current_edge.pos[1].x == allocator->rect.min.x )
+        else
         {
-            corner.x = allocator->rect.min.x;
-            corner.y = allocator->rect.min.y;
+            if( t < t1 ) { t1 = t; side1 = side; }
         }
-        else
+    }
+    if( !(t0 < t1) )
+        return 0;
+    // Unclipped ends are kept bit exact, as they are shared with the other edges of the vertex
+    double q0[2] = { p0[0] + d[0] * t0, p0[1] + d[1] * t0 };
+    double q1[2] = { p0[0] + d[0] * t1, p0[1] + d[1] * t1 };
+    clipped[0] = side0 >= 0;
+    clipped[1] = side1 >= 0;
+    if( clipped[0] )
+    {
+        q0[side0 & 1] = rect[side0];
+        p0[0] = q0[0]; p0[1] = q0[1];
+    }
+    if( clipped[1] )
+    {
+        q1[side1 & 1] = rect[side1];
+        p1[0] = q1[0]; p1[1] = q1[1];
+    }
+    return 1;
+}
+
+static void jcv_power_build_edges(jcv_context_internal* internal)
+{
+    int numsites = internal->numsites;
+    if( numsites == 0 )
+        return;
+
+    // Work relative to the center of the sites and rect, in double precision
+    jcv_rect bounds = internal->rect;
+    jcv_real maxweight = 0;
+    for( int i = 0; i < numsites; ++i )
+    {
+        jcv_rect_union(&bounds, &internal->sites[i].p);
+        maxweight = jcv_max(maxweight, jcv_abs(internal->weights[internal->sites[i].index]));
+    }
+    double centerx = ((double)bounds.min.x + (double)bounds.max.x) * 0.5;
+    double centery = ((double)bounds.min.y + (double)bounds.max.y) * 0.5;
+    double halfwidth = ((double)bounds.max.x - (double)bounds.min.x) * 0.5;
+    double halfheight = ((double)bounds.max.y - (double)bounds.min.y) * 0.5;
+    double radius = sqrt(halfwidth*halfwidth + halfheight*halfheight);
+
+    int numvertices = numsites + 3;
+    jcv_power_context ctx;
+    ctx.x = (double*)jcv_temp_alloc(internal, sizeof(double) * (size_t)numvertices * 3);
+    ctx.y = ctx.x + numvertices;
+    ctx.w = ctx.y + numvertices;
+    for( int i = 0; i < numsites; ++i )
+    {
+        ctx.x[i] = (double)internal->sites[i].p.x - centerx;
+        ctx.y[i] = (double)internal->sites[i].p.y - centery;
+        ctx.w[i] = (double)internal->weights[internal->sites[i].index];
+    }
+
+    // An enclosing triangle, far enough out that its vertices' cells never reach into the
+    // rect: within it, each point is closer to some site than to the enclosing vertices
+    double distance = 4 * radius + 2 * sqrt((double)maxweight);
+    if( !(distance > 0) )
+        distance = 1;
+    for( int i = 0; i < 3; ++i )
+    {
+        double angle = (double)JCV_PI * (0.5 + (double)i * 2.0 / 3.0);
+        ctx.x[numsites + i] = cos(angle) * distance;
+        ctx.y[numsites + i] = sin(angle) * distance;
+        ctx.w[numsites + i] = 0;
+    }
+
+    // Each insertion adds at most two triangles to the live set
+    int capacity = 2 * numvertices;
+    ctx.triangles = (jcv_power_triangle*)jcv_temp_alloc(internal, sizeof(jcv_power_triangle) * (size_t)capacity);
+    ctx.stamps = (int*)jcv_temp_alloc(internal, sizeof(int) * (size_t)capacity * 6);
+    ctx.freelist = ctx.stamps + capacity;
+    ctx.stack = ctx.freelist + capacity;
+    ctx.boundary = ctx.stack + capacity;
+    ctx.slots = (int*)jcv_temp_alloc(internal, sizeof(int) * (size_t)numvertices * 2);
+    ctx.numtriangles = 0;
+    ctx.numfree = 0;
+
+    int last = jcv_power_new_triangle(&ctx, numsites, numsites + 1, numsites + 2);
+    int* order = jcv_power_insertion_order(internal, &ctx, numsites, radius);
+    for( int i = 0; i < numsites; ++i )
+    {
+        int t = jcv_power_insert(&ctx, last, order[i]);
+        if( t >= 0 )
+            last = t;
+    }
+
+    // Each edge between two sites is the segment between the power centers of its triangles.
+    // Cocircular sites give triangles with (nearly) the same center, which are merged into one
+    // vertex, so that the cells around it close exactly
+    double mergedistance = radius * ((double)JCV_REAL_TYPE_EPSILON > 1e-9 ? (double)JCV_REAL_TYPE_EPSILON : 1e-9);
+    double rect[4] = {
+        (double)internal->rect.min.x - centerx, (double)internal->rect.min.y - centery,
+        (double)internal->rect.max.x - centerx, (double)internal->rect.max.y - centery };
+    double* centers = (double*)jcv_temp_alloc(internal, sizeof(double) * (size_t)ctx.numtriangles * 2);
+    int* parents = ctx.freelist;
+    for( int t = 0; t < ctx.numtriangles; ++t )
+    {
+        parents[t] = t;
+        if( ctx.triangles[t].v[0] >= 0 )
+            jcv_power_center(&ctx, &ctx.triangles[t], &centers[t*2+0], &centers[t*2+1]);
+    }
+    for( int t = 0; t < ctx.numtriangles; ++t )
+    {
+        const jcv_power_triangle* tri = &ctx.triangles[t];
+        if( tri->v[0] < 0 )
+            continue;
+        for( int i = 0; i < 3; ++i )
         {
-            corner.x = allocator->rect.max.x;
-            corner.y = allocator->rect.max.y;
+            int u = tri->n[i];
+            if( u < t )
+                continue;
+            if( jcv_abs_double(centers[t*2+0] - centers[u*2+0]) > mergedistance || jcv_abs_double(centers[t*2+1] - centers[u*2+1]) > mergedistance )
+                continue;
+            int rt = t, ru = u;
+            while( parents[rt] != rt ) rt = parents[rt];
+            while( parents[ru] != ru ) ru = parents[ru];
+            parents[rt > ru ? rt : ru] = rt > ru ? ru : rt;
         }
-        current = jcv_insert_gap_after(allocator, site, current, &current_edge.pos[1], &corner,
-            current_edge.vertices[1], allocator->numvertices++);
-        next = allocator->build_site_edges[site_index];
+    }
+    for( int t = 0; t < ctx.numtriangles; ++t )
+    {
+        int root = t;
+        while( parents[root] != root )
+            root = parents[root];
+        parents[t] = root;
     }
 
-    while( current && next )
+    int* vertexids = ctx.stamps;
+    for( int t = 0; t < ctx.numtriangles; ++t )
+        vertexids[t] = JCV_INVALID_VERTEX;
+    for( int t = 0; t < ctx.numtriangles; ++t )
     {
-        jcv_edge current_edge;
-        jcv_edge next_edge;
-        jcv_graphedge_copy(current, &current_edge);
-        jcv_graphedge_copy(next, &next_edge);
-        int current_edge_flags = jcv_get_edge_flags(&current_edge.pos[1], &clipper->min, &clipper->max);
-        if( current_edge_flags && !jcv_point_eq(&current_edge.pos[1], &next_edge.pos[0]))
+        const jcv_power_triangle* tri = &ctx.triangles[t];
+        if( tri->v[0] < 0 )
+            continue;
+        for( int i = 0; i < 3; ++i )
         {
-            int next_edge_flags = jcv_get_edge_flags(&next_edge.pos[0], &clipper->min, &clipper->max);
-            if( !next_edge_flags )
-                return;
-            if( current_edge_flags & next_edge_flags )
+            int u = tri->n[i];
+            int a = tri->v[(i+1)%3];
+            int b = tri->v[(i+2)%3];
+            if( u < t || a >= numsites || b >= numsites || parents[t] == parents[u] )
+                continue;
+
+            int owners[2] = { parents[t], parents[u] };
+            double p[2][2];
+            for( int k = 0; k < 2; ++k )
             {
-                jcv_insert_gap_after(allocator, site, current, &current_edge.pos[1], &next_edge.pos[0],
-                    current_edge.vertices[1], next_edge.vertices[0]);
+                p[k][0] = centers[owners[k]*2+0];
+                p[k][1] = centers[owners[k]*2+1];
             }
-            else
+            int clipped[2];
+            if( !jcv_power_clip_segment(rect, p[0], p[1], clipped) )
+                continue;
+
+            jcv_site* s1 = &internal->sites[a < b ? a : b];
+            jcv_site* s2 = &internal->sites[a < b ? b : a];
+            jcv_edge_internal* e = jcv_alloc_edge(internal);
+            jcv_power_edge_create(e, s1, s2, internal->weights[s1->index], internal->weights[s2->index]);
+            for( int k = 0; k < 2; ++k )
             {
-                int corner_flag = jcv_edge_flags_to_corner(current_edge_flags);
-                if (corner_flag)
-                    corner_flag = jcv_corner_rotate_90(corner_flag);
-                else
-                {
-                    if      (current_edge_flags == JCV_EDGE_TOP)    { corner_flag = JCV_CORNER_TOP_LEFT; }
-                    else if (current_edge_flags == JCV_EDGE_LEFT)   { corner_flag = JCV_CORNER_BOTTOM_LEFT; }
-                    else if (current_edge_flags == JCV_EDGE_BOTTOM) { corner_flag = JCV_CORNER_BOTTOM_RIGHT; }
-                    else if (current_edge_flags == JCV_EDGE_RIGHT)  { corner_flag = JCV_CORNER_TOP_RIGHT; }
-                }
-                jcv_point corner = jcv_corner_to_point(corner_flag, &clipper->min, &clipper->max);
-                jcv_insert_gap_after(allocator, site, current, &current_edge.pos[1], &corner,
-                    current_edge.vertices[1], allocator->numvertices++);
+                e->pos[k].x = (jcv_real)(p[k][0] + centerx);
+                e->pos[k].y = (jcv_real)(p[k][1] + centery);
+                if( clipped[k] )
+                    continue;
+                // Like the sweep's vertices, the ones outside the clipper's shape are left to its clip_fn
+                if( vertexids[owners[k]] == JCV_INVALID_VERTEX &&
+                    (!internal->clipper.test_fn || internal->clipper.test_fn(&internal->clipper, e->pos[k])) )
+                    vertexids[owners[k]] = jcv_add_vertex(internal, &e->pos[k]);
+                e->vertices[k] = vertexids[owners[k]];
             }
-        }
-        current = current->next;
-        if( current )
-        {
-            next = current->next;
-            if( !next )
-                next = allocator->build_site_edges[site_index];
+            e->next = internal->edges;
+            internal->edges = e;
+            ++internal->numedges;
+            ++internal->numdelaunayedges;
         }
     }
 }
 
-
-// Since the algorithm leaves gaps at the borders/corner, we want to fill them
-static void jcv_fillgaps(jcv_diagram* diagram)
+// When no edge reaches into the rect, one site owns all of it
+static void jcv_power_claim_rect(jcv_context_internal* internal)
 {
-    jcv_context_internal* internal = diagram->internal;
-    if (!internal->clipper.fill_fn)
+    if( internal->numedges > 0 || internal->numsites == 0 )
         return;
+    jcv_point center;
+    center.x = (internal->rect.min.x + internal->rect.max.x) * (jcv_real)0.5;
+    center.y = (internal->rect.min.y + internal->rect.max.y) * (jcv_real)0.5;
+    jcv_site* owner = &internal->sites[0];
+    for( int i = 1; i < internal->numsites; ++i )
+    {
+        if( jcv_site_power(internal, &internal->sites[i], &center) < jcv_site_power(internal, owner, &center) )
+            owner = &internal->sites[i];
+    }
+    owner->boundary = 1;
+}
 
-    int skip_interior_sites = internal->numsites > 1 &&
-        internal->clipper.fill_fn == jcv_boxshape_fillgaps;
-    for( int i = 0; i < internal->numsites; ++i )
+// Periodic diagrams
+//
+// The sites in a band along each side of the rect are copied across to the opposite side, and
+// the diagram is swept over the rect widened by the band. A cell inside the rect is complete if
+// the empty circle of each of its vertices is within the widened rect. Otherwise the band is
+// doubled, and the diagram regenerated. The copies' vertices are then mapped onto the ones inside the rect.
+
+// If the value is copied to the period in the direction of the shift
+static inline int jcv_periodic_is_copied(jcv_real v, jcv_real min, jcv_real max, jcv_real band, int shift)
+{
+    return shift == 0 || (shift > 0 ? v < min + band : v >= max - band);
+}
+
+static int jcv_periodic_count_copies(int num_points, const jcv_point_input* points, const jcv_rect* rect, const jcv_point* band)
+{
+    int count = 0;
+    for( int i = 0; i < num_points; ++i )
     {
-        jcv_site* site = &internal->sites[i];
-        if( skip_interior_sites && !site->boundary )
-            continue;
-        internal->clipper.fill_fn(&internal->clipper, internal, site);
+        jcv_point p = jcv_point_input_get(points, i);
+        jcv_real x = jcv_periodic_wrap(p.x, rect->min.x, rect->max.x);
+        jcv_real y = jcv_periodic_wrap(p.y, rect->min.y, rect->max.y);
+        int nx = 1 + jcv_periodic_is_copied(x, rect->min.x, rect->max.x, band->x, 1) + jcv_periodic_is_copied(x, rect->min.x, rect->max.x, band->x, -1);
+        int ny = 1 + jcv_periodic_is_copied(y, rect->min.y, rect->max.y, band->y, 1) + jcv_periodic_is_copied(y, rect->min.y, rect->max.y, band->y, -1);
+        count += nx * ny - 1;
     }
+    return count;
 }
 
-static void jcv_finalize_site_edges(jcv_context_internal* internal)
+// Appends the copies of the sites. A copy's index is num_points + k, where sources[k] is the index of its site
+static void jcv_periodic_add_copies(jcv_context_internal* internal, int num_points, const jcv_rect* rect, const jcv_point* band, uint32_t* sources)
 {
-    int total = 0;
-    internal->site_edge_offsets = (int*)jcv_alloc(internal, sizeof(int) * (size_t)(internal->numsites + 1));
-    for( int i = 0; i < internal->numsites; ++i )
+    jcv_real width = rect->max.x - rect->min.x;
+    jcv_real height = rect->max.y - rect->min.y;
+    int numsites = internal->numsites;
+    jcv_site* sites = internal->sites;
+    int count = 0;
+    for( int i = 0; i < numsites; ++i )
     {
-        internal->site_edge_offsets[i] = total;
-        total += internal->build_site_counts[i];
+        const jcv_point p = sites[i].p;
+        for( int sy = -1; sy <= 1; ++sy )
+        {
+            if( !jcv_periodic_is_copied(p.y, rect->min.y, rect->max.y, band->y, sy) )
+                continue;
+            for( int sx = -1; sx <= 1; ++sx )
+            {
+                if( (sx == 0 && sy == 0) || !jcv_periodic_is_copied(p.x, rect->min.x, rect->max.x, band->x, sx) )
+                    continue;
+                jcv_site* copy = &sites[numsites + count];
+                copy->p.x = p.x + (jcv_real)sx * width;
+                copy->p.y = p.y + (jcv_real)sy * height;
+                copy->index = (uint32_t)(num_points + count);
+                copy->boundary = 0;
+                sources[count++] = sites[i].index;
+            }
+        }
     }
-    internal->site_edge_offsets[internal->numsites] = total;
-    internal->site_edge_refs = (jcv_edge_internal**)jcv_alloc(internal, sizeof(jcv_edge_internal*) * (size_t)total);
-    int cursor = 0;
-    for( int i = 0; i < internal->numsites; ++i )
+    internal->numsites += count;
+}
+
+// Moves the sites inside the rect first, followed by the copies, which get their site's index.
+// Returns 0 if a cell inside the rect may be incomplete, because the band was too narrow.
+static int jcv_periodic_fold(jcv_context_internal* internal, int num_points, const uint32_t* sources, const jcv_rect* sweeprect, int* numinside)
+{
+    int numsites = internal->numsites;
+    jcv_site* sites = internal->sites;
+    int* positions = (int*)jcv_temp_alloc(internal, sizeof(int) * (size_t)(numsites + num_points));
+    int* inputs = positions + numsites;
+    int count = 0;
+    for( int i = 0; i < numsites; ++i )
     {
-        for( jcv_graphedge* graph = internal->build_site_edges[i]; graph; graph = graph->next )
-            internal->site_edge_refs[cursor++] = graph->edge;
+        if( sites[i].index < (uint32_t)num_points )
+            positions[i] = count++;
+    }
+    *numinside = count;
+    for( int i = 0; i < numsites; ++i )
+    {
+        if( sites[i].index >= (uint32_t)num_points )
+            positions[i] = count++;
+    }
+
+    jcv_site* tmp = (jcv_site*)jcv_temp_alloc(internal, sizeof(jcv_site) * (size_t)numsites);
+    memcpy(tmp, sites, sizeof(jcv_site) * (size_t)numsites);
+    for( int i = 0; i < numsites; ++i )
+        sites[positions[i]] = tmp[i];
+    for( jcv_edge_internal* e = internal->edges; e; e = e->next )
+    {
+        for( int k = 0; k < 2; ++k )
+        {
+            if( e->sites[k] )
+                e->sites[k] = &sites[positions[e->sites[k] - sites]];
+        }
+    }
+
+    internal->site_sources = (int*)jcv_alloc(internal, sizeof(int) * (size_t)numsites);
+    for( int i = 0; i < num_points; ++i )
+        inputs[i] = -1;
+    for( int i = 0; i < *numinside; ++i )
+    {
+        inputs[sites[i].index] = i;
+        internal->site_sources[i] = i;
+    }
+    for( int i = *numinside; i < numsites; ++i )
+    {
+        sites[i].index = sources[sites[i].index - (uint32_t)num_points];
+        // The site itself may have been pruned, as a duplicate of a copy
+        int source = inputs[sites[i].index];
+        internal->site_sources[i] = source >= 0 ? source : i;
     }
+
+    for( jcv_edge_internal* e = internal->edges; e; e = e->next )
+    {
+        const jcv_site* site = e->sites[0] - sites < *numinside ? e->sites[0] : e->sites[1];
+        if( !site || site - sites >= *numinside )
+            continue;
+        for( int i = 0; i < 2; ++i )
+        {
+            const jcv_point* v = &e->pos[i];
+            if( !jcv_is_valid(v) )
+                return 0;
+            jcv_real r = JCV_SQRT(jcv_point_dist_sq(v, &site->p));
+            if( v->x - r < sweeprect->min.x || v->x + r > sweeprect->max.x ||
+                v->y - r < sweeprect->min.y || v->y + r > sweeprect->max.y )
+                return 0;
+        }
+    }
+    return 1;
 }
 
-static void jcv_circle_event(jcv_context_internal* internal)
+// Returns the id of the vertex's copy inside the rect, found in the cell of the site's copy there
+static int jcv_periodic_vertex(const jcv_context_internal* internal, const int* copies, int site, const jcv_point* pos, int vertex)
+{
+    const jcv_rect* rect = &internal->rect;
+    int sx = jcv_periodic_shift(pos->x, rect->min.x, rect->max.x);
+    int sy = jcv_periodic_shift(pos->y, rect->min.y, rect->max.y);
+    if( sx == 0 && sy == 0 )
+        return vertex;
+    int copy = copies[site * 9 + (1 - sy) * 3 + (1 - sx)];
+    if( copy < 0 )
+        return vertex;
+
+    jcv_point target;
+    target.x = pos->x - (jcv_real)sx * (rect->max.x - rect->min.x);
+    target.y = pos->y - (jcv_real)sy * (rect->max.y - rect->min.y);
+    jcv_real best = JCV_FLT_MAX;
+    jcv_edge_internal* const* current = internal->site_edge_refs + internal->site_edge_offsets[copy];
+    jcv_edge_internal* const* end = internal->site_edge_refs + internal->site_edge_offsets[copy+1];
+    for( ; current != end; ++current )
+    {
+        for( int i = 0; i < 2; ++i )
+        {
+            jcv_real dist = jcv_point_dist_sq(&(*current)->pos[i], &target);
+            if( dist < best )
+            {
+                best = dist;
+                vertex = (*current)->vertices[i];
+            }
+        }
+    }
+    return vertex;
+}
+
+// Shares the vertices across the wrap, and keeps one copy of each edge in the edge list:
+// the one from the site with the lower position, or with a positive shift if it neighbours itself
+static void jcv_periodic_share_vertices(jcv_context_internal* internal, int numinside)
 {
-    jcv_halfedge* left      = jcv_pq_pop(internal->eventqueue);
+    jcv_site* sites = internal->sites;
+    const jcv_rect* rect = &internal->rect;
+    int* copies = (int*)jcv_temp_alloc(internal, sizeof(int) * (size_t)numinside * 9);
+    for( int i = 0; i < numinside * 9; ++i )
+        copies[i] = -1;
+    for( int i = numinside; i < internal->numsites; ++i )
+    {
+        int source = internal->site_sources[i];
+        if( source == i )
+            continue;
+        int sx = jcv_periodic_shift(sites[i].p.x, rect->min.x, rect->max.x);
+        int sy = jcv_periodic_shift(sites[i].p.y, rect->min.y, rect->max.y);
+        copies[source * 9 + (sy + 1) * 3 + (sx + 1)] = i;
+    }
 
-    jcv_halfedge* leftleft  = left->left;
-    jcv_halfedge* right     = left->right;
-    jcv_halfedge* rightright= right->right;
-    jcv_site* bottom = jcv_halfedge_leftsite(left);
-    jcv_site* top    = jcv_halfedge_rightsite(right);
+    // First map the vertices onto the ids of their copies, which are only read from inside the rect
+    for( jcv_edge_internal* e = internal->edges; e; e = e->next )
+    {
+        int k = e->sites[0] - sites < numinside ? 0 : 1;
+        if( !e->sites[k] || e->sites[k] - sites >= numinside || e->a == JCV_INVALID_VALUE )
+            continue;
+        int site = (int)(e->sites[k] - sites);
+        for( int i = 0; i < 2; ++i )
+            e->vertices[i] = jcv_periodic_vertex(internal, copies, site, &e->pos[i], e->vertices[i]);
+    }
 
-    jcv_point vertex = left->vertex;
-    int vertex_index = JCV_INVALID_VERTEX;
-    if( !(internal->options & JCV_OPTION_DELAUNAY_ONLY) )
+    int* ids = (int*)jcv_temp_alloc(internal, sizeof(int) * (size_t)(internal->numvertices + 1));
+    for( int i = 0; i < internal->numvertices; ++i )
+        ids[i] = -1;
+    // The shared vertices are stored wrapped into the rect
+    jcv_point* vertices = (jcv_point*)internal->alloc(internal->memctx, sizeof(jcv_point) * (size_t)(internal->numvertices + 1));
+    int numvertices = 0;
+    int numedges = 0;
+    int numdelaunayedges = 0;
+    jcv_edge_internal* edges = 0;
+    jcv_edge_internal** tail = &edges;
+    for( jcv_edge_internal* e = internal->edges; e; e = e->next )
     {
-        jcv_edge_internal* incident_edges[2] = {left->edge, right->edge};
-        // Four or more cocircular sites can report the same vertex in consecutive
-        // circle events. In that case one incident edge already carries its index.
-        for( int i = 0; i < 2 && vertex_index == JCV_INVALID_VERTEX; ++i )
+        int k = e->sites[0] - sites < numinside ? 0 : 1;
+        if( !e->sites[k] || !e->sites[1-k] || e->sites[k] - sites >= numinside )
+            continue;
+        int site = (int)(e->sites[k] - sites);
+        int other = (int)(e->sites[1-k] - sites);
+        if( e->a != JCV_INVALID_VALUE )
         {
-            for( int endpoint = 0; endpoint < 2; ++endpoint )
+            for( int i = 0; i < 2; ++i )
             {
-                if( incident_edges[i]->vertices[endpoint] >= 0 &&
-                    incident_edges[i]->pos[endpoint].x == vertex.x &&
-                    incident_edges[i]->pos[endpoint].y == vertex.y )
+                if( e->vertices[i] < 0 )
+                    continue;
+                int* id = &ids[e->vertices[i]];
+                if( *id < 0 )
                 {
-                    vertex_index = incident_edges[i]->vertices[endpoint];
-                    break;
+                    vertices[numvertices] = jcv_periodic_wrap_point(internal, internal->vertices[e->vertices[i]]);
+                    *id = numvertices++;
                 }
+                e->vertices[i] = *id;
             }
         }
-        if( vertex_index == JCV_INVALID_VERTEX &&
-            (!internal->clipper.test_fn || internal->clipper.test_fn(&internal->clipper, vertex)) )
+
+        int keep = other < numinside;
+        if( !keep )
         {
-            vertex_index = internal->numvertices++;
+            int source = internal->site_sources[other];
+            int sx = jcv_periodic_shift(sites[other].p.x, rect->min.x, rect->max.x);
+            int sy = jcv_periodic_shift(sites[other].p.y, rect->min.y, rect->max.y);
+            keep = site < source || (site == source && (sy > 0 || (sy == 0 && sx > 0)));
         }
-        jcv_endpos(left->edge, &vertex, left->direction, vertex_index);
-        jcv_endpos(right->edge, &vertex, right->direction, vertex_index);
+        if( !keep )
+            continue;
+        *tail = e;
+        tail = &e->next;
+        numedges += e->a != JCV_INVALID_VALUE;
+        ++numdelaunayedges;
     }
+    *tail = 0;
+    internal->edges = edges;
+    internal->numedges = numedges;
+    internal->numdelaunayedges = numdelaunayedges;
+    internal->numvertices = numvertices;
+    FJCVFreeFn freefn = internal->free;
+    if( internal->vertices )
+        freefn(internal->memctx, internal->vertices);
+    internal->vertices = vertices;
+    internal->vertexcapacity = internal->numvertices;
+}
 
-    jcv_pq_remove(internal->eventqueue, right);
-    jcv_beachline_remove(internal, left);
-    jcv_beachline_remove(internal, right);
-    jcv_halfedge_delete(internal, left);
-    jcv_halfedge_delete(internal, right);
+#if defined(JCV_USE_PTHREADS)
 
-    int direction = JCV_DIRECTION_LEFT;
-    if( bottom->p.y > top->p.y )
-    {
-        jcv_site* temp = bottom;
-        bottom = top;
-        top = temp;
-        direction = JCV_DIRECTION_RIGHT;
-    }
+#ifndef JCV_PTHREAD_COUNT
+    #define JCV_PTHREAD_COUNT 8
+#endif
 
-    jcv_edge_internal* edge = jcv_edge_new(internal, bottom, top);
-    edge->next = internal->edges;
-    internal->edges = edge;
-    ++internal->numedges;
-    ++internal->numdelaunayedges;
+typedef struct jcv_pthread_task_
+{
+    jcv_parallel_task_fn    fn;
+    void*                   ctx;
+    int                     first;
+    int                     count;
+} jcv_pthread_task;
 
-    jcv_halfedge* he = jcv_halfedge_new(internal, edge, direction);
-    jcv_beachline_insert_after(internal, leftleft, he);
-    if( !(internal->options & JCV_OPTION_DELAUNAY_ONLY) )
-        jcv_endpos(edge, &vertex, JCV_DIRECTION_RIGHT - direction, vertex_index);
+static void* jcv_pthread_run(void* arg)
+{
+    const jcv_pthread_task* task = (const jcv_pthread_task*)arg;
+    for( int i = task->first; i < task->count; i += JCV_PTHREAD_COUNT )
+        task->fn(task->ctx, i);
+    return 0;
+}
 
-    jcv_point p;
-    if( jcv_check_circle_event( leftleft, he, &p ) )
+static void jcv_pthread_parallel_for(int count, jcv_parallel_task_fn fn, void* ctx)
+{
+    pthread_t threads[JCV_PTHREAD_COUNT];
+    jcv_pthread_task tasks[JCV_PTHREAD_COUNT];
+    int started[JCV_PTHREAD_COUNT];
+    for( int t = 0; t < JCV_PTHREAD_COUNT; ++t )
+    {
+        tasks[t].fn = fn;
+        tasks[t].ctx = ctx;
+        tasks[t].first = t;
+        tasks[t].count = count;
+        // The calling thread takes the first share, and any share that couldn't get a thread
+        started[t] = t > 0 && t < count && pthread_create(&threads[t], 0, jcv_pthread_run, &tasks[t]) == 0;
+    }
+    for( int t = 0; t < JCV_PTHREAD_COUNT; ++t )
     {
-        jcv_pq_remove(internal->eventqueue, leftleft);
-        leftleft->vertex    = p;
-        leftleft->y         = jcv_calc_circle_event_y(bottom, &p);
-        jcv_pq_push(internal->eventqueue, leftleft);
+        if( !started[t] )
+            jcv_pthread_run(&tasks[t]);
     }
-    if( jcv_check_circle_event( he, rightright, &p ) )
+    for( int t = 0; t < JCV_PTHREAD_COUNT; ++t )
     {
-        he->vertex      = p;
-        he->y           = jcv_calc_circle_event_y(bottom, &p);
-        jcv_pq_push(internal->eventqueue, he);
+        if( started[t] )
+            pthread_join(threads[t], 0);
     }
 }
+#endif
 
-static void jcv_diagram_generate_internal(int num_points, const jcv_point* points, const jcv_rect* rect,
-                                          const jcv_clipper* clipper, void* userallocctx,
-                                          FJCVAllocFn allocfn, FJCVFreeFn freefn,
-                                          unsigned int options, jcv_diagram* d);
+#if defined(JCV_PARALLEL_FOR)
 
-void jcv_diagram_generate( int num_points, const jcv_point* points, const jcv_rect* rect, const jcv_clipper* clipper, jcv_diagram* d )
-{
-    jcv_diagram_generate_internal(num_points, points, rect, clipper, 0, jcv_alloc_fn, jcv_free_fn, JCV_OPTION_NONE, d);
-}
+// The sample sort splits the sites into this many ranges of values, which are sorted as separate tasks
+#define JCV_SAMPLE_SORT_BUCKETS 64
+#define JCV_SAMPLE_SORT_OVERSAMPLING 32
 
-void jcv_delaunay_generate( int num_points, const jcv_point* points, const jcv_rect* rect, const jcv_clipper* clipper, jcv_diagram* d )
+typedef struct jcv_sample_sort_
 {
-    jcv_diagram_generate_internal(num_points, points, rect, clipper, 0, jcv_alloc_fn, jcv_free_fn, JCV_OPTION_DELAUNAY_ONLY, d);
-}
-
-void jcv_diagram_generate_useralloc( int num_points, const jcv_point* points, const jcv_rect* rect, const jcv_clipper* clipper, void* userallocctx, FJCVAllocFn allocfn, FJCVFreeFn freefn, jcv_diagram* d )
+    jcv_site*       sites;
+    jcv_site*       scratch;
+    unsigned char*  buckets;        // The bucket of each site
+    int*            offsets;        // Per chunk and bucket: the site count, then where the chunk writes its sites
+    int*            bucketstarts;
+    jcv_site        splitters[JCV_SAMPLE_SORT_BUCKETS - 1];
+    int             count;
+    int             chunksize;
+} jcv_sample_sort;
+
+// Returns the index of the first splitter that is greater than the site, so equal sites share a bucket
+static inline int jcv_sample_sort_bucket(const jcv_sample_sort* sort, const jcv_site* site)
 {
-    jcv_diagram_generate_internal(num_points, points, rect, clipper, userallocctx, allocfn, freefn, JCV_OPTION_NONE, d);
+    int lo = 0;
+    int hi = JCV_SAMPLE_SORT_BUCKETS - 1;
+    while( lo < hi )
+    {
+        int mid = (lo + hi) / 2;
+        if( jcv_site_less(site, &sort->splitters[mid]) )
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
 }
 
-typedef union jcv_cast_align_struct_
-{
-    char*                   charp;
-    jcv_halfedge**          halfedgepp;
-    jcv_context_internal*   internalp;
-    jcv_site*               sitep;
-    jcv_priorityqueue*      priorityqueuep;
-} jcv_cast_align_struct;
-
-static inline void jcv_rect_union(jcv_rect* rect, const jcv_point* p)
+static void jcv_sample_sort_count(void* ctx, int chunk)
 {
-    rect->min.x = jcv_min(rect->min.x, p->x);
-    rect->min.y = jcv_min(rect->min.y, p->y);
-    rect->max.x = jcv_max(rect->max.x, p->x);
-    rect->max.y = jcv_max(rect->max.y, p->y);
+    jcv_sample_sort* sort = (jcv_sample_sort*)ctx;
+    int* counts = sort->offsets + chunk * JCV_SAMPLE_SORT_BUCKETS;
+    memset(counts, 0, sizeof(int) * JCV_SAMPLE_SORT_BUCKETS);
+    int begin = chunk * sort->chunksize;
+    int end = begin + sort->chunksize < sort->count ? begin + sort->chunksize : sort->count;
+    for( int i = begin; i < end; ++i )
+    {
+        int bucket = jcv_sample_sort_bucket(sort, &sort->sites[i]);
+        sort->buckets[i] = (unsigned char)bucket;
+        counts[bucket]++;
+    }
 }
 
-static inline void jcv_rect_round(jcv_rect* rect)
+static void jcv_sample_sort_scatter(void* ctx, int chunk)
 {
-    rect->min.x = jcv_floor(rect->min.x);
-    rect->min.y = jcv_floor(rect->min.y);
-    rect->max.x = jcv_ceil(rect->max.x);
-    rect->max.y = jcv_ceil(rect->max.y);
+    jcv_sample_sort* sort = (jcv_sample_sort*)ctx;
+    int* positions = sort->offsets + chunk * JCV_SAMPLE_SORT_BUCKETS;
+    int begin = chunk * sort->chunksize;
+    int end = begin + sort->chunksize < sort->count ? begin + sort->chunksize : sort->count;
+    for( int i = begin; i < end; ++i )
+        sort->scratch[positions[sort->buckets[i]]++] = sort->sites[i];
 }
 
-static inline void jcv_rect_inflate(jcv_rect* rect, jcv_real amount)
+static void jcv_sample_sort_bucket_range(void* ctx, int bucket)
 {
-    rect->min.x -= amount;
-    rect->min.y -= amount;
-    rect->max.x += amount;
-    rect->max.y += amount;
+    jcv_sample_sort* sort = (jcv_sample_sort*)ctx;
+    int begin = sort->bucketstarts[bucket];
+    int count = sort->bucketstarts[bucket + 1] - begin;
+    jcv_sites_sort(sort->scratch + begin, count);
+    memcpy(sort->sites + begin, sort->scratch + begin, sizeof(jcv_site) * (size_t)count);
 }
 
-static int jcv_prune_duplicates(jcv_context_internal* internal, jcv_rect* rect)
-{
-    int num_sites = internal->numsites;
-    jcv_site* sites = internal->sites;
-
-    jcv_rect r;
-    r.min.x = r.min.y = JCV_FLT_MAX;
-    r.max.x = r.max.y = -JCV_FLT_MAX;
+#endif
 
-    int offset = 0;
-    // Prune duplicates first
-    for (int i = 0; i < num_sites; i++)
+// Sorts the sites like jcv_sites_sort. With JCV_PARALLEL_FOR, many sites are sorted with a sample sort:
+// they are split into ranges of values, chunk by chunk in parallel, and the ranges are then sorted in parallel.
+// The result is ordered by jcv_site_less like the serial sort, so duplicates are still adjacent.
+static void jcv_sites_sort_parallel(jcv_context_internal* internal, jcv_site* sites, int count)
+{
+#if defined(JCV_PARALLEL_FOR)
+    if( count >= JCV_PARALLEL_MIN_SITES && count >= JCV_SAMPLE_SORT_BUCKETS * JCV_SAMPLE_SORT_OVERSAMPLING )
     {
-        const jcv_site* s = &sites[i];
-        // Remove duplicates, to avoid anomalies
-        if( i > 0 && jcv_point_eq(&s->p, &sites[i - 1].p) )
+        if( jcv_sites_sort_presorted(sites, count) )
+            return;
+
+        jcv_sample_sort sort;
+        sort.sites = sites;
+        sort.count = count;
+        sort.chunksize = (count + JCV_SAMPLE_SORT_BUCKETS - 1) / JCV_SAMPLE_SORT_BUCKETS;
+
+        size_t scratchsize = sizeof(jcv_site) * (size_t)count;
+        size_t offsetssize = sizeof(int) * (JCV_SAMPLE_SORT_BUCKETS * JCV_SAMPLE_SORT_BUCKETS + JCV_SAMPLE_SORT_BUCKETS + 1);
+        void* mem = internal->alloc(internal->memctx, scratchsize + sizeof(void*) + offsetssize + (size_t)count);
+        sort.scratch = (jcv_site*)mem;
+        void* offsets = jcv_align((char*)mem + scratchsize, sizeof(void*));
+        sort.offsets = (int*)offsets;
+        sort.bucketstarts = sort.offsets + JCV_SAMPLE_SORT_BUCKETS * JCV_SAMPLE_SORT_BUCKETS;
+        sort.buckets = (unsigned char*)offsets + offsetssize;
+
+        // The splitters are evenly spaced in a sorted, evenly spaced sample of the sites
+        // (gathered in the scratch memory, which isn't used yet)
+        jcv_site* samples = sort.scratch;
+        int numsamples = JCV_SAMPLE_SORT_BUCKETS * JCV_SAMPLE_SORT_OVERSAMPLING;
+        for( int i = 0; i < numsamples; ++i )
+            samples[i] = sites[(size_t)i * (size_t)count / (size_t)numsamples];
+        jcv_sites_sort(samples, numsamples);
+        for( int i = 0; i < JCV_SAMPLE_SORT_BUCKETS - 1; ++i )
+            sort.splitters[i] = samples[(i + 1) * JCV_SAMPLE_SORT_OVERSAMPLING];
+
+        JCV_PARALLEL_FOR(JCV_SAMPLE_SORT_BUCKETS, jcv_sample_sort_count, &sort);
+
+        // Each chunk writes its part of a bucket after the parts of the chunks before it
+        int total = 0;
+        for( int b = 0; b < JCV_SAMPLE_SORT_BUCKETS; ++b )
         {
-            offset++;
-            continue;
+            sort.bucketstarts[b] = total;
+            for( int c = 0; c < JCV_SAMPLE_SORT_BUCKETS; ++c )
+            {
+                int* offset = &sort.offsets[c * JCV_SAMPLE_SORT_BUCKETS + b];
+                int n = *offset;
+                *offset = total;
+                total += n;
+            }
         }
+        sort.bucketstarts[JCV_SAMPLE_SORT_BUCKETS] = total;
 
-        sites[i - offset] = sites[i];
+        JCV_PARALLEL_FOR(JCV_SAMPLE_SORT_BUCKETS, jcv_sample_sort_scatter, &sort);
+        JCV_PARALLEL_FOR(JCV_SAMPLE_SORT_BUCKETS, jcv_sample_sort_bucket_range, &sort);
 
-        jcv_rect_union(&r, &s->p);
-    }
-    internal->numsites -= offset;
-    if (rect) {
-        *rect = r;
+        FJCVFreeFn freefn = internal->free;
+        freefn(internal->memctx, mem);
+        return;
     }
-    return offset;
+#else
+    (void)internal;
+#endif
+    jcv_sites_sort(sites, count);
 }
 
-static int jcv_prune_not_in_shape(jcv_context_internal* internal, jcv_rect* rect)
+// The transform of the sites of a normalised diagram: (p - origin) * scale
+typedef struct jcv_normalization_
 {
-    int num_sites = internal->numsites;
-    jcv_site* sites = internal->sites;
-
-    jcv_rect r;
-    r.min.x = r.min.y = JCV_FLT_MAX;
-    r.max.x = r.max.y = -JCV_FLT_MAX;
+    jcv_point   origin;
+    jcv_real    scale;      // A power of two, so that the scaling is exact
+    jcv_rect    rect;       // The diagram's rect, in the input coordinates
+} jcv_normalization;
 
-    int offset = 0;
-    for (int i = 0; i < num_sites; i++)
-    {
-        const jcv_site* s = &sites[i];
+static inline jcv_point jcv_normalize_point(const jcv_normalization* n, jcv_point p)
+{
+    p.x = (p.x - n->origin.x) * n->scale;
+    p.y = (p.y - n->origin.y) * n->scale;
+    return p;
+}
 
-        if (!internal->clipper.test_fn(&internal->clipper, s->p))
-        {
-            offset++;
-            continue;
-        }
+// Maps a point back, and clamps it to the rect, which the rounding could otherwise put it outside of
+static inline jcv_point jcv_denormalize_point(const jcv_normalization* n, jcv_point p)
+{
+    if( p.x == JCV_INVALID_VALUE )
+        return p;
+    p.x = jcv_min(jcv_max(p.x / n->scale + n->origin.x, n->rect.min.x), n->rect.max.x);
+    p.y = jcv_min(jcv_max(p.y / n->scale + n->origin.y, n->rect.min.y), n->rect.max.y);
+    return p;
+}
 
-        sites[i - offset] = sites[i];
+// Centres the sites on their bounds, and scales them into [-1, 1]. Also normalises the bounds and the rect
+static void jcv_normalize_sites(jcv_context_internal* internal, jcv_rect* bounds, const jcv_rect* rect, jcv_normalization* n, jcv_rect* normalized_rect)
+{
+    n->origin.x = bounds->min.x * (jcv_real)0.5 + bounds->max.x * (jcv_real)0.5;
+    n->origin.y = bounds->min.y * (jcv_real)0.5 + bounds->max.y * (jcv_real)0.5;
+    double dx = (double)bounds->max.x - (double)bounds->min.x;
+    double dy = (double)bounds->max.y - (double)bounds->min.y;
+    double extent = 0.5 * (dx > dy ? dx : dy);
+    // A power of two, so the scaling itself is exact. Kept within the range of jcv_real
+    double scale = 1.0;
+    if( extent > 0 )
+    {
+        while( extent * scale >= 1.0 )
+            scale *= 0.5;
+        while( extent * scale < 0.5 && scale < (double)JCV_FLT_MAX * 0.5 )
+            scale *= 2.0;
+    }
+    n->scale = (jcv_real)scale;
 
-        jcv_rect_union(&r, &s->p);
+    if( rect )
+    {
+        n->rect = *rect;
     }
-    internal->numsites -= offset;
-    if (rect) {
-        *rect = r;
+    else
+    {
+        // The same automatic rect as jcv_diagram_generate's, in the input coordinates
+        n->rect = *bounds;
+        jcv_rect_round(&n->rect);
+        jcv_rect_inflate(&n->rect, 10);
     }
-    return offset;
+    normalized_rect->min = jcv_normalize_point(n, n->rect.min);
+    normalized_rect->max = jcv_normalize_point(n, n->rect.max);
+    bounds->min = jcv_normalize_point(n, bounds->min);
+    bounds->max = jcv_normalize_point(n, bounds->max);
+    for( int i = 0; i < internal->numsites; ++i )
+        internal->sites[i].p = jcv_normalize_point(n, internal->sites[i].p);
 }
 
-static jcv_context_internal* jcv_alloc_internal(int num_points, void* userallocctx, FJCVAllocFn allocfn, FJCVFreeFn freefn)
+// Maps the sites, edges and vertices back to the input coordinates. The sites get their input positions
+static void jcv_denormalize_diagram(jcv_context_internal* internal, const jcv_point_input* points, const jcv_normalization* n)
 {
-    // Interesting limits from Euler's equation
-    // Slide 81: https://courses.cs.washington.edu/courses/csep521/01au/lectures/lecture10slides.pdf
-    // Page 3: https://sites.cs.ucsb.edu/~suri/cs235/Voronoi.pdf
-    size_t eventssize = (size_t)(num_points*2) * sizeof(jcv_halfedge*); // beachline can have max 2*n-5 parabolas
-    size_t sitessize = (size_t)num_points * sizeof(jcv_site);
-    size_t memsize = sizeof(jcv_priorityqueue) + eventssize + sitessize + sizeof(jcv_context_internal) + 16u; // 16 bytes padding for alignment
-
-    char* originalmem = (char*)allocfn(userallocctx, memsize);
-    memset(originalmem, 0, memsize);
-
-    // align memory
-    char* mem = (char*)jcv_align(originalmem, sizeof(void*));
-
-    jcv_cast_align_struct aligned;
-    aligned.charp = mem;
-    jcv_context_internal* internal = aligned.internalp;
-    mem += sizeof(jcv_context_internal);
-    internal->mem    = originalmem;
-    internal->memctx = userallocctx;
-    internal->alloc  = allocfn;
-    internal->free   = freefn;
-
-    mem = (char*)jcv_align(mem, sizeof(void*));
-    aligned.charp = mem;
-    internal->sites = aligned.sitep;
-    mem += sitessize;
-
-    mem = (char*)jcv_align(mem, sizeof(void*));
-    aligned.charp = mem;
-    internal->eventqueue = aligned.priorityqueuep;
-    mem += sizeof(jcv_priorityqueue);
-    assert( ((uintptr_t)mem & (sizeof(void*)-1)) == 0 );
-
-    jcv_cast_align_struct tmp;
-    tmp.charp = mem;
-    internal->eventmem = tmp.halfedgepp;
-
-    assert((mem+eventssize) <= (originalmem+memsize));
-
-    return internal;
+    for( int i = 0; i < internal->numsites; ++i )
+        internal->sites[i].p = jcv_point_input_get(points, (int)internal->sites[i].index);
+    for( int i = 0; i < internal->numvertices; ++i )
+        internal->vertices[i] = jcv_denormalize_point(n, internal->vertices[i]);
+    for( jcv_edge_internal* e = internal->edges; e; e = e->next )
+    {
+        if( e->a == JCV_INVALID_VALUE )
+            continue;
+        e->pos[0] = jcv_denormalize_point(n, e->pos[0]);
+        e->pos[1] = jcv_denormalize_point(n, e->pos[1]);
+        // a * (x - ox) * s + b * (y - oy) * s = c, where a and b don't change
+        e->c = e->c / n->scale + e->a * n->origin.x + e->b * n->origin.y;
+    }
+    internal->rect = n->rect;
+    internal->clipper.min = n->rect.min;
+    internal->clipper.max = n->rect.max;
+    internal->site_grid_scale.x *= n->scale;
+    internal->site_grid_scale.y *= n->scale;
 }
 
-static void jcv_diagram_generate_internal(int num_points, const jcv_point* points, const jcv_rect* rect,
-                                          const jcv_clipper* clipper, void* userallocctx,
-                                          FJCVAllocFn allocfn, FJCVFreeFn freefn,
-                                          unsigned int options, jcv_diagram* d)
+// Returns 0 if a periodic diagram's band was too narrow
+static int jcv_diagram_generate_internal(int num_points, const jcv_point_input* points, const jcv_real* weights,
+                                         const jcv_point* band, const jcv_rect* rect, const jcv_clipper* clipper,
+                                         void* userallocctx, FJCVAllocFn allocfn, FJCVFreeFn freefn,
+                                         unsigned int options, jcv_diagram* d)
 {
     if( d->internal )
         jcv_diagram_free( d );
 
-    jcv_context_internal* internal = jcv_alloc_internal(num_points, userallocctx, allocfn, freefn);
+    // A periodic diagram also holds the copies of the sites along the sides
+    int max_num_sites = band ? num_points + jcv_periodic_count_copies(num_points, points, rect, band) : num_points;
+    jcv_context_internal* internal = jcv_alloc_internal(max_num_sites, userallocctx, allocfn, freefn);
     internal->options = options;
+    internal->lastcirclevertex = JCV_INVALID_VERTEX;
 
     jcv_beachline_init(internal);
     internal->beachline_start = jcv_halfedge_new(internal, 0, 0);
@@ -2293,20 +5487,92 @@ static void jcv_diagram_generate_internal(int num_points, const jcv_point* point
     internal->beachline_end->left       = internal->beachline_start;
     internal->beachline_end->right      = 0;
 
-    int max_num_events = num_points*2; // beachline can have max 2*n-5 parabolas
+    int max_num_events = max_num_sites*2; // beachline can have max 2*n-5 parabolas
     jcv_pq_create(internal->eventqueue, max_num_events, internal->eventmem);
 
-    internal->numsites = num_points;
     jcv_site* sites = internal->sites;
 
-    for( int i = 0; i < num_points; ++i )
+    // Packed input is first scanned with SIMD for its bounds (which the pruning of duplicates cannot change)
+    // and for NaN or infinite points. If all are finite, the sites are a straight copy. Otherwise, and for
+    // strided, int32 or periodic input, one scalar pass copies the points, drops the ones that are NaN or
+    // infinite, and accumulates the bounds
+    jcv_rect tmp_rect;
+    tmp_rect.min.x = tmp_rect.min.y = JCV_FLT_MAX;
+    tmp_rect.max.x = tmp_rect.max.y = -JCV_FLT_MAX;
+    int numsites = 0;
+    if( !band && jcv_point_input_simd_bounds(points, num_points, &tmp_rect) )
+    {
+        for( ; numsites < num_points; ++numsites )
+        {
+            jcv_site* site = &sites[numsites];
+            site->p        = jcv_point_input_get(points, numsites);
+            site->index    = (uint32_t)numsites;
+            site->boundary = 0;
+        }
+    }
+    else
+    {
+        for( int i = 0; i < num_points; ++i )
+        {
+            jcv_point p = jcv_point_input_get(points, i);
+            // x - x is NaN for both NaN and infinity
+            if( !(p.x - p.x == 0 && p.y - p.y == 0) )
+                continue;
+            if( band )
+            {
+                p.x = jcv_periodic_wrap(p.x, rect->min.x, rect->max.x);
+                p.y = jcv_periodic_wrap(p.y, rect->min.y, rect->max.y);
+            }
+            jcv_site* site = &sites[numsites++];
+            site->p        = p;
+            site->index    = (uint32_t)i;
+            site->boundary = 0;
+            tmp_rect.min.x = jcv_min(tmp_rect.min.x, p.x);
+            tmp_rect.min.y = jcv_min(tmp_rect.min.y, p.y);
+            tmp_rect.max.x = jcv_max(tmp_rect.max.x, p.x);
+            tmp_rect.max.y = jcv_max(tmp_rect.max.y, p.y);
+        }
+    }
+    internal->numsites = numsites;
+
+    jcv_normalization normalization;
+    memset(&normalization, 0, sizeof(normalization));
+    jcv_rect normalized_rect;
+    if( (options & JCV_OPTION_NORMALIZE) && numsites > 0 )
+    {
+        jcv_normalize_sites(internal, &tmp_rect, rect, &normalization, &normalized_rect);
+        rect = &normalized_rect;
+    }
+    else
+    {
+        options &= ~(unsigned int)JCV_OPTION_NORMALIZE;
+        internal->options = options;
+    }
+
+    jcv_sites_sort_parallel(internal, sites, numsites);
+
+    // Duplicates are adjacent after sorting, and the pruning keeps the first one
+    internal->input_sources = (int*)jcv_alloc(internal, sizeof(int) * (size_t)(num_points > 0 ? num_points : 1));
+    memset(internal->input_sources, 0xff, sizeof(int) * (size_t)num_points);
+    for( int i = 0, first = 0; i < numsites; ++i )
     {
-        sites[i].p        = points[i];
-        sites[i].index    = (uint32_t)i;
-        sites[i].boundary = 0;
+        if( !jcv_point_eq(&sites[i].p, &sites[first].p) )
+            first = i;
+        internal->input_sources[sites[i].index] = (int)sites[first].index;
     }
 
-    jcv_sites_sort(sites, num_points);
+    if( weights )
+    {
+        internal->weights = (jcv_real*)jcv_alloc(internal, sizeof(jcv_real) * (size_t)num_points);
+        memcpy(internal->weights, weights, sizeof(jcv_real) * (size_t)num_points);
+        for( int i = 0; i < num_points; ++i )
+        {
+            if( internal->input_sources[i] < 0 )
+                continue;
+            jcv_real* kept = &internal->weights[internal->input_sources[i]];
+            *kept = jcv_max(*kept, weights[i]);
+        }
+    }
 
     jcv_clipper box_clipper;
     if (clipper == 0) {
@@ -2317,17 +5583,31 @@ static void jcv_diagram_generate_internal(int num_points, const jcv_point* point
     }
     internal->clipper = *clipper;
 
-    jcv_rect tmp_rect;
-    tmp_rect.min.x = tmp_rect.min.y = JCV_FLT_MAX;
-    tmp_rect.max.x = tmp_rect.max.y = -JCV_FLT_MAX;
-    jcv_prune_duplicates(internal, &tmp_rect);
+    jcv_prune_duplicates(internal, 0);
+
+    // The copies are made from the remaining sites, and the sweep covers the rect widened by the band
+    const jcv_rect* sweeprect = rect;
+    jcv_rect periodic_rect;
+    uint32_t* sources = 0;
+    if( band )
+    {
+        sources = (uint32_t*)jcv_temp_alloc(internal, sizeof(uint32_t) * (size_t)(max_num_sites - num_points + 1));
+        jcv_periodic_add_copies(internal, num_points, rect, band, sources);
+        jcv_sites_sort_parallel(internal, sites, internal->numsites);
+        jcv_prune_duplicates(internal, 0);
+        periodic_rect.min.x = rect->min.x - band->x;
+        periodic_rect.min.y = rect->min.y - band->y;
+        periodic_rect.max.x = rect->max.x + band->x;
+        periodic_rect.max.y = rect->max.y + band->y;
+        sweeprect = &periodic_rect;
+    }
 
     // Prune using the test function
     if (internal->clipper.test_fn)
     {
         // e.g. used by the box clipper in the test_fn
-        internal->clipper.min = rect ? rect->min : tmp_rect.min;
-        internal->clipper.max = rect ? rect->max : tmp_rect.max;
+        internal->clipper.min = sweeprect ? sweeprect->min : tmp_rect.min;
+        internal->clipper.max = sweeprect ? sweeprect->max : tmp_rect.max;
 
         jcv_prune_not_in_shape(internal, &tmp_rect);
 
@@ -2354,26 +5634,23 @@ static void jcv_diagram_generate_internal(int num_points, const jcv_point* point
 
     if( !(options & JCV_OPTION_DELAUNAY_ONLY) )
     {
-        internal->build_site_edges = (jcv_graphedge**)jcv_temp_alloc(internal, sizeof(jcv_graphedge*) * (size_t)internal->numsites);
-        memset(internal->build_site_edges, 0, sizeof(jcv_graphedge*) * (size_t)internal->numsites);
+        // About two vertices per site, and the ones where the cells along the sides are clipped
+        jcv_reserve_vertices(internal, 2 * internal->numsites + 8 * (int)JCV_SQRT((jcv_real)internal->numsites) + 64);
+        // Lazy cells are built after the generation's temporary memory is gone
+        size_t buildsize = sizeof(jcv_graphedge*) * (size_t)internal->numsites;
+        internal->build_site_edges = (jcv_graphedge**)((options & JCV_OPTION_LAZY_CELLS) ? jcv_alloc(internal, buildsize) : jcv_temp_alloc(internal, buildsize));
+        memset(internal->build_site_edges, 0, buildsize);
         internal->build_site_counts = (int*)internal->eventmem;
     }
 
     jcv_priorityqueue* pq = internal->eventqueue;
     jcv_site* site = jcv_nextsite(internal);
 
-    int finished = 0;
+    // Power cells can be empty, or not contain their site, so they cannot be swept
+    int finished = weights != 0;
     while( !finished )
     {
-        jcv_point lowest_pq_point;
-        if( !jcv_pq_empty(pq) )
-        {
-            jcv_halfedge* he = jcv_pq_top(pq);
-            lowest_pq_point.x = he->vertex.x;
-            lowest_pq_point.y = he->y;
-        }
-
-        if( site != 0 && (jcv_pq_empty(pq) || jcv_point_less(&site->p, &lowest_pq_point) ) )
+        if( site != 0 && (jcv_pq_empty(pq) || jcv_site_before_event(site, jcv_pq_top(pq)) ) )
         {
             jcv_site_event(internal, site);
             site = jcv_nextsite(internal);
@@ -2388,15 +5665,65 @@ static void jcv_diagram_generate_internal(int num_points, const jcv_point* point
         }
     }
 
+    if( weights )
+        jcv_power_build_edges(internal);
+
+    if( band )
+    {
+        int numinside = 0;
+        int complete = jcv_periodic_fold(internal, num_points, sources, sweeprect, &numinside);
+        if( !complete && (band->x < rect->max.x - rect->min.x || band->y < rect->max.y - rect->min.y) )
+        {
+            jcv_temp_free_all(internal);
+            return 0;
+        }
+        d->numsites = numinside;
+    }
+
+    // The periodic copies come after the sites inside the rect, and share their input index
+    internal->input_to_site = (int*)jcv_alloc(internal, sizeof(int) * (size_t)(num_points > 0 ? num_points : 1));
+    memset(internal->input_to_site, 0xff, sizeof(int) * (size_t)num_points);
+    for( int i = 0; i < d->numsites; ++i )
+        internal->input_to_site[sites[i].index] = i;
+    // A duplicate of a rejected point is rejected too
+    for( int i = 0; i < num_points; ++i )
+    {
+        if( internal->input_sources[i] >= 0 && internal->input_to_site[internal->input_sources[i]] < 0 )
+            internal->input_sources[i] = -1;
+    }
+
     if( !(options & JCV_OPTION_DELAUNAY_ONLY) )
     {
         jcv_build_graph_edges(internal);
-        jcv_fillgaps(d);
-        jcv_finalize_site_edges(internal);
+        if( options & JCV_OPTION_LAZY_CELLS )
+        {
+            jcv_index_site_edges(internal);
+        }
+        else
+        {
+            if( weights )
+                jcv_power_claim_rect(internal);
+            jcv_fillgaps(d);
+            jcv_finalize_site_edges(internal);
+        }
+        jcv_build_site_grid(internal);
+        if( band )
+            jcv_periodic_share_vertices(internal, d->numsites);
     }
+    // The copies of a periodic diagram's sites surround the rect, so it has no hull
+    if( !band )
+        jcv_build_hull(internal);
     jcv_temp_free_all(internal);
-    internal->build_site_edges = 0;
+    if( !(options & JCV_OPTION_LAZY_CELLS) )
+        internal->build_site_edges = 0;
+    if( options & JCV_OPTION_NORMALIZE )
+    {
+        jcv_denormalize_diagram(internal, points, &normalization);
+        d->min = internal->rect.min;
+        d->max = internal->rect.max;
+    }
     d->numvertices = (options & JCV_OPTION_DELAUNAY_ONLY) ? 0 : internal->numvertices;
+    return 1;
 }
 
 #endif // JC_VORONOI_IMPLEMENTATION
@@ -2408,6 +5735,31 @@ ABOUT:
     A fast single file 2D voronoi diagram generator
 
 HISTORY:
+    0.11    2026-10-18  - Added point-location queries walking over neighbouring sites
+                          Added a site locator for bulk nearest-site queries
+                          Added a scanline rasterizer for site label images
+                          Added natural neighbour interpolation
+                          Added power diagram generation
+                          Added periodic diagram generation
+                          Added convex hull extraction
+                          Added minimum spanning tree and k nearest neighbours over the Delaunay edges
+                          Added CSR export of the cell neighbours
+                          Added batched edge iteration, and a positions only variant
+                          Store the unique vertex positions as they are created
+                          Added lazy generation, building each cell on first use
+                          Added jcv_diagram_get_input_to_site
+                          Added jcv_diagram_get_input_sources, reporting merged and rejected points
+                          Added jcv_diagram_generate_strided and jcv_diagram_generate_soa
+                          Points that are NaN or infinite are now pruned, in the pass that copies the input
+                          Added JCV_PARALLEL_FOR (or JCV_USE_PTHREADS), used for a parallel sample sort of the sites
+                          Moved the circle event data out of the beachline half edges, into a parallel pool
+                          Sites with the same y are found by walking the beachline from the previous site
+                          Circle events and beachline searches use filtered exact predicates on the sites
+                          Removed JCV_EDGE_INTERSECT_THRESHOLD
+                          Added JCV_USE_MIXED_PRECISION for float storage with double vertex and circle event math
+                          Added jcv_diagram_generate_int for integer sites, with exactly rounded vertices
+                          Added jcv_diagram_generate_normalized for sites with a large magnitude
+                          Added jcv_diagram_weld_vertices to merge the vertices of nearly cocircular sites
     0.10    2026-07-23  - Specialized the event priority queue for half edges
                           Replaced generic site qsort with a specialized introsort
                           Added Delaunay-only generation without Voronoi finalization
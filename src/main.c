@@ -61,67 +61,6 @@ static void draw_line(int x0, int y0, int x1, int y1, unsigned char* image, int
     }
 }
 
-// http://fgiesen.wordpress.com/2013/02/08/triangle-rasterization-in-practice/
-static inline int orient2d(const jcv_point* a, const jcv_point* b, const jcv_point* c)
-{
-    return ((int)b->x - (int)a->x)*((int)c->y - (int)a->y) - ((int)b->y - (int)a->y)*((int)c->x - (int)a->x);
-}
-
-static inline int min2(int a, int b)
-{
-    return (a < b) ? a : b;
-}
-
-static inline int max2(int a, int b)
-{
-    return (a > b) ? a : b;
-}
-
-static inline int min3(int a, int b, int c)
-{
-    return min2(a, min2(b, c));
-}
-static inline int max3(int a, int b, int c)
-{
-    return max2(a, max2(b, c));
-}
-
-static void draw_triangle(const jcv_point* v0, const jcv_point* v1, const jcv_point* v2, unsigned char* image, int width, int height, int nchannels, unsigned char* color)
-{
-    int area = orient2d(v0, v1, v2);
-    if( area == 0 )
-        return;
-
-    // Compute triangle bounding box
-    int minX = min3((int)v0->x, (int)v1->x, (int)v2->x);
-    int minY = min3((int)v0->y, (int)v1->y, (int)v2->y);
-    int maxX = max3((int)v0->x, (int)v1->x, (int)v2->x);
-    int maxY = max3((int)v0->y, (int)v1->y, (int)v2->y);
-
-    // Clip against screen bounds
-    minX = max2(minX, 0);
-    minY = max2(minY, 0);
-    maxX = min2(maxX, width - 1);
-    maxY = min2(maxY, height - 1);
-
-    // Rasterize
-    jcv_point p;
-    for (p.y = (jcv_real)minY; p.y <= (jcv_real)maxY; p.y++) {
-        for (p.x = (jcv_real)minX; p.x <= (jcv_real)maxX; p.x++) {
-            // Determine barycentric coordinates
-            int w0 = orient2d(v1, v2, &p);
-            int w1 = orient2d(v2, v0, &p);
-            int w2 = orient2d(v0, v1, &p);
-
-            // If p is on or inside all edges, render pixel.
-            if (w0 >= 0 && w1 >= 0 && w2 >= 0)
-            {
-                plot((int)p.x, (int)p.y, image, width, height, nchannels, color);
-            }
-        }
-    }
-}
-
 static void relax_points(const jcv_diagram* diagram, jcv_point* points)
 {
     const jcv_site* sites = jcv_diagram_get_sites(diagram);
@@ -744,38 +683,34 @@ int main(int argc, const char** argv)
             printf("Done.\n");
         }
 
-        // If you want to draw triangles, or relax the diagram,
-        // you can iterate over the sites and get all edges easily
-
-        //if (0)
+        // To fill the cells, rasterize a label image that holds the owning site of each pixel
         if( !output_svg )
         {
             const jcv_site* sites = jcv_diagram_get_sites( &diagram );
-            for( int i = 0; i < diagram.numsites; ++i )
+            uint32_t* labels = (uint32_t*)malloc(sizeof(uint32_t) * (size_t)(width*height));
+            unsigned char* colors = (unsigned char*)malloc((size_t)diagram.numsites * 3);
+            if( labels && colors )
             {
-                const jcv_site* site = &sites[i];
-
-                srand((unsigned int)site->index); // for generating colors for the triangles
-
-                unsigned char color_tri[3];
-                unsigned char basecolor = 120;
-                color_tri[0] = basecolor + (unsigned char)(rand() % (235 - basecolor));
-                color_tri[1] = basecolor + (unsigned char)(rand() % (235 - basecolor));
-                color_tri[2] = basecolor + (unsigned char)(rand() % (235 - basecolor));
+                for( int i = 0; i < diagram.numsites; ++i )
+                {
+                    srand((unsigned int)sites[i].index); // for generating colors for the cells
 
-                jcv_point s = remap(&site->p, &diagram.min, &diagram.max, &dimensions );
+                    unsigned char basecolor = 120;
+                    colors[i*3+0] = basecolor + (unsigned char)(rand() % (235 - basecolor));
+                    colors[i*3+1] = basecolor + (unsigned char)(rand() % (235 - basecolor));
+                    colors[i*3+2] = basecolor + (unsigned char)(rand() % (235 - basecolor));
+                }
 
-                jcv_edge_iter site_edges;
-                jcv_edge e;
-                jcv_site_get_edges(&diagram, site, &site_edges);
-                while( jcv_edge_next(&site_edges, &e) )
+                memset(labels, 0xFF, sizeof(uint32_t) * (size_t)(width*height));
+                jcv_diagram_rasterize_labels( &diagram, 0, width, height, 0, height, labels );
+                for( int i = 0; i < width*height; ++i )
                 {
-                    jcv_point p0 = remap(&e.pos[0], &diagram.min, &diagram.max, &dimensions );
-                    jcv_point p1 = remap(&e.pos[1], &diagram.min, &diagram.max, &dimensions );
-
-                    draw_triangle( &s, &p0, &p1, image, width, height, 3, color_tri);
+                    if( labels[i] != 0xFFFFFFFF )
+                        memcpy(&image[i*3], &colors[labels[i]*3], 3);
                 }
             }
+            free(colors);
+            free(labels);
         }
 
         // If all you need are the edges
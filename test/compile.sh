@@ -44,3 +44,4 @@ DOUBLEDEFINES="-Wno-double-promotion -DTEST_USE_DOUBLE -DJCV_USE_DOUBLE=1 -DJCV_
 
 ${CXX} -o ../build/test $CCFLAGS $CXXFLAGS $LINKFLAGS test.cpp
 ${CXX} -o ../build/test_double $CCFLAGS $CXXFLAGS $LINKFLAGS $DOUBLEDEFINES test.cpp
+${CXX} -o ../build/test_mixed $CCFLAGS $CXXFLAGS $LINKFLAGS -DJCV_USE_MIXED_PRECISION test.cpp
@@ -24,11 +24,13 @@ CCFLAGS="${ARCH} ${ASAN_FLAGS} -g ${OPT} -DJC_TEST_USE_COLORS -I../src ${SYSROOT
 CFLAGS="-c $CFLAGS -std=${STDVERSION} ${CCFLAGS}"
 CXXFLAGS="$CXXFLAGS -std=c++11 -Wno-global-constructors -Wno-weak-vtables -Wno-old-style-cast -Wno-zero-as-null-pointer-constant -Wno-c++98-compat -Wno-c++98-compat-pedantic -Wno-suggest-override"
 LINKFLAGS="-lm ${ASAN_LDFLAGS}"
-# DOUBLEDEFINES="-Wno-double-promotion -DTEST_USE_DOUBLE -DJCV_REAL_TYPE=double -DJCV_ATAN2=atan2 -DJCV_SQRT=sqrt -DJCV_REAL_TYPE_EPSILON=DBL_EPSILON"
+DOUBLEDEFINES="-Wno-double-promotion -DTEST_USE_DOUBLE -DJCV_REAL_TYPE=double -DJCV_ATAN2=atan2 -DJCV_SQRT=sqrt -DJCV_REAL_TYPE_EPSILON=DBL_EPSILON"
 
 NAME=jc_voronoi
 ALGORITHM=USE_JC_VORONOI
 ${CXX} -o ../build/perftest_${NAME} $CCFLAGS $CXXFLAGS $LINKFLAGS -D${ALGORITHM} -I.. perftest.cpp
+${CXX} -o ../build/perftest_${NAME}_mixed $CCFLAGS $CXXFLAGS $LINKFLAGS -D${ALGORITHM} -DJCV_USE_MIXED_PRECISION -I.. perftest.cpp
+${CXX} -o ../build/perftest_${NAME}_double $CCFLAGS $CXXFLAGS $LINKFLAGS -D${ALGORITHM} ${DOUBLEDEFINES} -I.. perftest.cpp
 
 
 NAME=boost
@@ -261,6 +261,20 @@ void fill_symmetric_diagonal_pairs(PointF* sites, int count)
 	}
 }
 
+// Sites on a circle, with radii that differ by less than the float precision of their coordinates
+void fill_near_cocircular_sites(PointF* sites, int count)
+{
+	unsigned int state = 45;
+	for( int i = 0; i < count; ++i )
+	{
+		state = state * 1664525u + 1013904223u;
+		const float angle = 6.2831853071795864769f * (float)i / (float)count;
+		const float radius = MAP_DIMENSION * 0.4f + (float)(state % 7) * 0.0001f;
+		sites[i].x = MAP_DIMENSION * 0.5f + radius * cosf(angle);
+		sites[i].y = MAP_DIMENSION * 0.5f + radius * sinf(angle);
+	}
+}
+
 void populate_site_arrays(Context* context)
 {
 	for( int i = 0; i < context->count; ++i )
@@ -307,8 +321,11 @@ void setup_sites(int count, Context* context)
 	context->dgmax = PointF(-FLT_MAX, -FLT_MAX);
 
 	const bool symmetric_diagonal_pairs = context->testname && strcmp(context->testname, "symmetric_diagonal_pairs") == 0;
+	const bool near_cocircular = context->testname && strcmp(context->testname, "near_cocircular") == 0;
 	if (symmetric_diagonal_pairs)
 		fill_symmetric_diagonal_pairs(context->fsites, count);
+	else if (near_cocircular)
+		fill_near_cocircular_sites(context->fsites, count);
 	else
 		fill_random_sites(context->fsites, count);
 	populate_site_arrays(context);
@@ -349,11 +366,18 @@ void null_setup(Context* context)
 }
 
 #if defined(USE_JC_VORONOI)
+static const jcv_point* jc_voronoi_sites(const Context* context)
+{
+	if( sizeof(jcv_real) == sizeof(double) )
+		return (const jcv_point*)context->dsites;
+	return (const jcv_point*)context->fsites;
+}
+
 int jc_voronoi_impl(Context* context, bool calculatecellarea)
 {
 	jcv_diagram diagram = { 0 };
 	jcv_rect rect = { {context->dgmin.x, context->dgmin.y}, {context->dgmax.x, context->dgmax.y} };
-	jcv_diagram_generate(context->count, (const jcv_point*)context->fsites, &rect, 0, &diagram );
+	jcv_diagram_generate(context->count, jc_voronoi_sites(context), &rect, 0, &diagram );
 
 	if( calculatecellarea )
 	{
@@ -429,7 +453,7 @@ int jc_voronoi_cell_areas(Context* context)
 void setup_jc_voronoi_vertices(Context* context)
 {
 	jcv_rect rect = { {context->dgmin.x, context->dgmin.y}, {context->dgmax.x, context->dgmax.y} };
-	jcv_diagram_generate(context->count, (const jcv_point*)context->fsites, &rect, 0, &context->vertexdiagram);
+	jcv_diagram_generate(context->count, jc_voronoi_sites(context), &rect, 0, &context->vertexdiagram);
 	context->vertices = new jcv_point[jcv_get_num_vertices(&context->vertexdiagram)];
 }
 
@@ -442,6 +466,38 @@ int jc_voronoi_get_vertices(Context* context)
 	return 0;
 }
 
+// The cells whose edges don't form a closed loop
+int jc_voronoi_count_open_cells(const jcv_diagram* diagram)
+{
+	int opencells = 0;
+	const jcv_site* sites = jcv_diagram_get_sites( diagram );
+	for( int i = 0; i < diagram->numsites; ++i )
+	{
+		bool closed = false;
+		jcv_point start = { 0, 0 };
+		jcv_point end = { 0, 0 };
+		PerfGraphEdgeIter graph_iter;
+		perf_graph_edge_begin(diagram, &sites[i], &graph_iter);
+		for( const PerfGraphEdge* edge = perf_graph_edge_next(&graph_iter); edge; edge = perf_graph_edge_next(&graph_iter) )
+		{
+			const jcv_point* pos0 = perf_graph_edge_position(diagram, edge, 0);
+			if( !closed )
+			{
+				start = *pos0;
+				closed = true;
+			}
+			else if( pos0->x != end.x || pos0->y != end.y )
+			{
+				closed = false;
+				break;
+			}
+			end = *perf_graph_edge_position(diagram, edge, 1);
+		}
+		opencells += !closed || end.x != start.x || end.y != start.y;
+	}
+	return opencells;
+}
+
 void teardown_jc_voronoi_vertices(Context* context)
 {
 	delete[] context->vertices;
@@ -908,6 +964,7 @@ int main(int argc, const char** argv)
 	setup_jc_voronoi_vertices(&context);
 	run_postprocess_test("jc_voronoi_get_vertices", context.testname, &context, jc_voronoi_get_vertices);
 	printf("# collected %d unique vertices\n", jcv_get_num_vertices(&context.vertexdiagram));
+	printf("# %d open cells\n", jc_voronoi_count_open_cells(&context.vertexdiagram));
 	teardown_jc_voronoi_vertices(&context);
 #elif defined(USE_FASTJET)
 	run_test("fastjet", context.testname, &context, null_setup, fastjet_voronoi);
@@ -4,6 +4,15 @@
 #include <memory.h>
 #include <deque>
 
+// Runs the tasks in reverse, to catch any dependency on their order
+static int g_parallel_task_count = 0;
+static void test_parallel_for(int count, void (*fn)(void*, int), void* ctx)
+{
+    for( int i = count - 1; i >= 0; --i, ++g_parallel_task_count )
+        fn(ctx, i);
+}
+#define JCV_PARALLEL_FOR(_COUNT_, _FN_, _CTX_) test_parallel_for(_COUNT_, _FN_, _CTX_)
+
 #define JC_VORONOI_IMPLEMENTATION
 #include "jc_voronoi.h"
 
@@ -1032,8 +1041,8 @@ TEST_F(VoronoiTest, priority_queue_push_remove_pop)
         {2, 9}, {8, 0}, {2, 4}, {5, 7},
     };
     const int count = (int)(sizeof(values) / sizeof(values[0]));
-    jcv_halfedge nodes[count];
-    jcv_halfedge* items[count + 2];
+    jcv_halfedge_event nodes[count];
+    jcv_halfedge_event* items[count + 2];
     jcv_priorityqueue queue;
     memset(nodes, 0, sizeof(nodes));
     memset(items, 0, sizeof(items));
@@ -1053,11 +1062,11 @@ TEST_F(VoronoiTest, priority_queue_push_remove_pop)
     ASSERT_EQ(0, nodes[2].pqpos);
     jcv_pq_remove(&queue, &nodes[2]);
 
-    jcv_halfedge* previous = 0;
+    jcv_halfedge_event* previous = 0;
     int popped = 0;
     while( !jcv_pq_empty(&queue) )
     {
-        jcv_halfedge* current = jcv_pq_pop(&queue);
+        jcv_halfedge_event* current = jcv_pq_pop(&queue);
         ASSERT_EQ(0, current->pqpos);
         if( previous )
             ASSERT_FALSE(jcv_halfedge_compare(previous, current));
@@ -1563,3 +1572,1352 @@ TEST_F(VoronoiTest, Delaunay_edge_remains_valid_after_next)
     ASSERT_TRUE(retained_edge->sites[0] == retained_sites[0] &&
                 retained_edge->sites[1] == retained_sites[1]);
 }
+
+static const jcv_site* test_find_nearest_site(const jcv_diagram* diagram, jcv_point p)
+{
+    const jcv_site* sites = jcv_diagram_get_sites(diagram);
+    const jcv_site* nearest = 0;
+    jcv_real best = JCV_FLT_MAX;
+    for( int i = 0; i < diagram->numsites; ++i )
+    {
+        jcv_real dx = sites[i].p.x - p.x;
+        jcv_real dy = sites[i].p.y - p.y;
+        jcv_real dist = dx*dx + dy*dy;
+        if( dist < best )
+        {
+            best = dist;
+            nearest = &sites[i];
+        }
+    }
+    return nearest;
+}
+
+TEST_F(VoronoiTest, Find_site_matches_nearest_site)
+{
+    const int num_points = 500;
+    jcv_point points[num_points];
+    srand(7);
+    for( int i = 0; i < num_points; ++i )
+    {
+        points[i].x = (jcv_real)(rand() % 1000) * (jcv_real)0.5;
+        points[i].y = (jcv_real)(rand() % 1000) * (jcv_real)0.25;
+    }
+    jcv_rect rect = { {0, 0}, {500, 250} };
+    jcv_diagram_generate(num_points, points, &rect, 0, &ctx->diagram);
+
+    const int num_queries = 64 * 32;
+    jcv_point queries[num_queries];
+    for( int y = 0; y < 32; ++y )
+    {
+        for( int x = 0; x < 64; ++x )
+        {
+            queries[y * 64 + x].x = ((jcv_real)x + (jcv_real)0.5) * (jcv_real)(500.0 / 64.0);
+            queries[y * 64 + x].y = ((jcv_real)y + (jcv_real)0.5) * (jcv_real)(250.0 / 32.0);
+        }
+    }
+
+    const jcv_site* found[num_queries];
+    jcv_diagram_find_sites(&ctx->diagram, num_queries, queries, found);
+    for( int i = 0; i < num_queries; ++i )
+    {
+        const jcv_site* nearest = test_find_nearest_site(&ctx->diagram, queries[i]);
+        ASSERT_TRUE(found[i] != 0);
+        ASSERT_EQ(jcv_point_dist_sq(&nearest->p, &queries[i]), jcv_point_dist_sq(&found[i]->p, &queries[i]));
+        ASSERT_TRUE(jcv_diagram_find_site(&ctx->diagram, queries[i], 0) == found[i]);
+    }
+
+    // A hint far away from the query still walks to the owning site
+    const jcv_site* sites = jcv_diagram_get_sites(&ctx->diagram);
+    ASSERT_TRUE(jcv_diagram_find_site(&ctx->diagram, sites[0].p, &sites[num_points - 1]) == &sites[0]);
+}
+
+TEST_F(VoronoiTest, Find_site_without_cells)
+{
+    jcv_point point = {1, 1};
+    ASSERT_TRUE(jcv_diagram_find_site(&ctx->diagram, point, 0) == 0);
+
+    jcv_point points[] = { {0, 0}, {2, 0}, {1, 2} };
+    jcv_delaunay_generate(3, points, 0, 0, &ctx->diagram);
+    ASSERT_TRUE(jcv_diagram_find_site(&ctx->diagram, point, 0) == 0);
+}
+
+TEST_F(VoronoiTest, Site_locator_matches_nearest_site)
+{
+    const int num_points = 1000;
+    jcv_point points[num_points];
+    srand(11);
+    for( int i = 0; i < num_points; ++i )
+    {
+        points[i].x = (jcv_real)(rand() % 2000) * (jcv_real)0.5;
+        points[i].y = (jcv_real)(rand() % 1000) * (jcv_real)0.5;
+    }
+    jcv_rect rect = { {0, 0}, {1000, 500} };
+    jcv_diagram_generate(num_points, points, &rect, 0, &ctx->diagram);
+
+    jcv_site_locator* locator = jcv_site_locator_create(&ctx->diagram);
+    ASSERT_TRUE(locator != 0);
+
+    // The last queries are on the rect's corners and outside of it
+    const int num_queries = 4096 + 3;
+    jcv_real x[num_queries];
+    jcv_real y[num_queries];
+    for( int i = 0; i < 4096; ++i )
+    {
+        x[i] = (jcv_real)(rand() % 10001) * (jcv_real)0.1;
+        y[i] = (jcv_real)(rand() % 5001) * (jcv_real)0.1;
+    }
+    x[4096] = 0; y[4096] = 0;
+    x[4097] = 1000; y[4097] = 500;
+    x[4098] = -10; y[4098] = 250;
+
+    int indices[num_queries];
+    jcv_site_locator_find(locator, num_queries, x, y, indices);
+
+    const jcv_site* sites = jcv_diagram_get_sites(&ctx->diagram);
+    for( int i = 0; i < num_queries; ++i )
+    {
+        jcv_point p = { x[i], y[i] };
+        const jcv_site* nearest = test_find_nearest_site(&ctx->diagram, p);
+        ASSERT_TRUE(indices[i] >= 0 && indices[i] < ctx->diagram.numsites);
+        ASSERT_EQ(jcv_point_dist_sq(&nearest->p, &p), jcv_point_dist_sq(&sites[indices[i]].p, &p));
+    }
+    jcv_site_locator_free(locator);
+
+    jcv_diagram delaunay = {};
+    jcv_delaunay_generate(num_points, points, &rect, 0, &delaunay);
+    ASSERT_TRUE(jcv_site_locator_create(&delaunay) == 0);
+    jcv_diagram_free(&delaunay);
+}
+
+TEST_F(VoronoiTest, Rasterize_labels_matches_nearest_site)
+{
+    const int num_points = 300;
+    jcv_point points[num_points];
+    srand(5);
+    for( int i = 0; i < num_points; ++i )
+    {
+        points[i].x = (jcv_real)(rand() % 1024) * (jcv_real)0.25;
+        points[i].y = (jcv_real)(rand() % 512) * (jcv_real)0.25;
+    }
+    jcv_rect rect = { {0, 0}, {256, 128} };
+    jcv_diagram_generate(num_points, points, &rect, 0, &ctx->diagram);
+
+    const int width = 200;
+    const int height = 100;
+    const uint32_t unset = 0xFFFFFFFF;
+    uint32_t* labels = (uint32_t*)malloc(sizeof(uint32_t) * width * height);
+    uint32_t* bands = (uint32_t*)malloc(sizeof(uint32_t) * width * height);
+    for( int i = 0; i < width * height; ++i )
+        labels[i] = bands[i] = unset;
+
+    jcv_diagram_rasterize_labels(&ctx->diagram, &rect, width, height, 0, height, labels);
+    for( int row = 0; row < height; row += 7 )
+        jcv_diagram_rasterize_labels(&ctx->diagram, &rect, width, height, row, row + 7, bands);
+
+    const jcv_site* sites = jcv_diagram_get_sites(&ctx->diagram);
+    for( int y = 0; y < height; ++y )
+    {
+        for( int x = 0; x < width; ++x )
+        {
+            uint32_t label = labels[y * width + x];
+            ASSERT_NE(unset, label);
+            ASSERT_EQ(label, bands[y * width + x]);
+
+            jcv_point p = { ((jcv_real)x + (jcv_real)0.5) * (jcv_real)(256.0 / width), ((jcv_real)y + (jcv_real)0.5) * (jcv_real)(128.0 / height) };
+            const jcv_site* nearest = test_find_nearest_site(&ctx->diagram, p);
+            jcv_real expected = JCV_SQRT(jcv_point_dist_sq(&nearest->p, &p));
+            jcv_real actual = JCV_SQRT(jcv_point_dist_sq(&sites[label].p, &p));
+            ASSERT_LE(actual - expected, (jcv_real)0.001);
+        }
+    }
+    free(bands);
+    free(labels);
+}
+
+TEST_F(VoronoiTest, Interpolate_natural_neighbours)
+{
+    const int num_points = 200;
+    jcv_point points[num_points];
+    jcv_real linear[num_points];
+    jcv_real constant[num_points];
+    srand(3);
+    for( int i = 0; i < num_points; ++i )
+    {
+        points[i].x = (jcv_real)(rand() % 1000) * (jcv_real)0.1;
+        points[i].y = (jcv_real)(rand() % 1000) * (jcv_real)0.1;
+        linear[i] = 2 * points[i].x - 3 * points[i].y + 5;
+        constant[i] = 7;
+    }
+    jcv_rect rect = { {0, 0}, {100, 100} };
+    jcv_diagram_generate(num_points, points, &rect, 0, &ctx->diagram);
+
+    // Sibson interpolation reproduces linear functions away from the clipped boundary
+    const int num_queries = 20 * 20;
+    jcv_point queries[num_queries];
+    for( int i = 0; i < num_queries; ++i )
+    {
+        queries[i].x = 30 + (jcv_real)(i % 20) * 2;
+        queries[i].y = 30 + (jcv_real)(i / 20) * 2;
+    }
+    jcv_real results[num_queries];
+    jcv_diagram_interpolate(&ctx->diagram, linear, num_queries, queries, results);
+    for( int i = 0; i < num_queries; ++i )
+        ASSERT_NEAR(2 * queries[i].x - 3 * queries[i].y + 5, results[i], (jcv_real)0.01);
+
+    // At a site, the weight is all its own
+    const jcv_site* sites = jcv_diagram_get_sites(&ctx->diagram);
+    jcv_real at_site;
+    jcv_diagram_interpolate(&ctx->diagram, linear, 1, &sites[10].p, &at_site);
+    ASSERT_NEAR(linear[sites[10].index], at_site, (jcv_real)0.001);
+
+    const int width = 32;
+    const int height = 32;
+    jcv_real image[width * height];
+    for( int row = 0; row < height; row += 5 )
+        jcv_diagram_interpolate_image(&ctx->diagram, constant, &rect, width, height, row, row + 5, image);
+    for( int i = 0; i < width * height; ++i )
+        ASSERT_NEAR((jcv_real)7, image[i], (jcv_real)0.001);
+}
+
+// Returns the cell area (the site is not necessarily inside its power cell)
+static double test_cell_area(const jcv_diagram* diagram, const jcv_site* site)
+{
+    double twice_area = 0.0;
+    test_graphedge_iter iter;
+    test_site_get_edges(diagram, site, &iter);
+    for( const jcv_edge* edge = test_graphedge_next(&iter); edge; edge = test_graphedge_next(&iter) )
+    {
+        const jcv_point* p0 = test_graphedge_get_position(diagram, edge, 0);
+        const jcv_point* p1 = test_graphedge_get_position(diagram, edge, 1);
+        twice_area += (double)p0->x * (double)p1->y - (double)p0->y * (double)p1->x;
+    }
+    return twice_area * 0.5;
+}
+
+// Points on a 0.01 grid in [0, 100)
+static void random_points(jcv_point* points, int num_points, unsigned int seed)
+{
+    srand(seed);
+    for( int i = 0; i < num_points; ++i )
+    {
+        points[i].x = (jcv_real)(rand() % 10000) * (jcv_real)0.01;
+        points[i].y = (jcv_real)(rand() % 10000) * (jcv_real)0.01;
+    }
+}
+
+TEST_F(VoronoiTest, Power_equal_weights_matches_voronoi)
+{
+    const int num_points = 300;
+    jcv_point points[num_points];
+    jcv_real weights[num_points];
+    random_points(points, num_points, 4);
+    for( int i = 0; i < num_points; ++i )
+        weights[i] = 25;
+    jcv_rect rect = { {0, 0}, {100, 100} };
+    jcv_diagram voronoi;
+    memset(&voronoi, 0, sizeof(voronoi));
+    jcv_diagram_generate(num_points, points, &rect, 0, &voronoi);
+    jcv_diagram_generate_weighted(num_points, points, weights, &rect, 0, &ctx->diagram);
+
+    ASSERT_EQ(voronoi.numsites, ctx->diagram.numsites);
+    const jcv_site* expected = jcv_diagram_get_sites(&voronoi);
+    const jcv_site* sites = jcv_diagram_get_sites(&ctx->diagram);
+    for( int i = 0; i < ctx->diagram.numsites; ++i )
+    {
+        ASSERT_EQ(expected[i].index, sites[i].index);
+        ASSERT_TRUE(is_closed_loop(&ctx->diagram, &sites[i]));
+        ASSERT_NEAR(test_cell_area(&voronoi, &expected[i]), test_cell_area(&ctx->diagram, &sites[i]), 0.01);
+    }
+    ASSERT_EQ(0, validate_vertex_indices(&ctx->diagram));
+    jcv_diagram_free(&voronoi);
+}
+
+TEST_F(VoronoiTest, Power_cells_hold_minimal_power_distance)
+{
+    const int num_points = 300;
+    jcv_point points[num_points];
+    jcv_real weights[num_points];
+    random_points(points, num_points, 5);
+    for( int i = 0; i < num_points; ++i )
+        weights[i] = (jcv_real)(rand() % 100);
+    jcv_rect rect = { {0, 0}, {100, 100} };
+    jcv_diagram_generate_weighted(num_points, points, weights, &rect, 0, &ctx->diagram);
+
+    // The non empty cells are closed, and tile the rect
+    const jcv_site* sites = jcv_diagram_get_sites(&ctx->diagram);
+    double total = 0.0;
+    for( int i = 0; i < ctx->diagram.numsites; ++i )
+    {
+        test_graphedge_iter iter;
+        test_site_get_edges(&ctx->diagram, &sites[i], &iter);
+        if( !test_graphedge_next(&iter) )
+            continue;
+        ASSERT_TRUE(is_closed_loop(&ctx->diagram, &sites[i]));
+        total += test_cell_area(&ctx->diagram, &sites[i]);
+    }
+    ASSERT_NEAR(100.0 * 100.0, total, 0.1);
+
+    const int num_queries = 50 * 50;
+    jcv_real x[num_queries];
+    jcv_real y[num_queries];
+    for( int i = 0; i < num_queries; ++i )
+    {
+        x[i] = (jcv_real)(i % 50) * 2 + (jcv_real)0.5;
+        y[i] = (jcv_real)(i / 50) * 2 + (jcv_real)0.5;
+    }
+    int found[num_queries];
+    jcv_site_locator* locator = jcv_site_locator_create(&ctx->diagram);
+    jcv_site_locator_find(locator, num_queries, x, y, found);
+    jcv_site_locator_free(locator);
+
+    for( int i = 0; i < num_queries; ++i )
+    {
+        jcv_real best = JCV_FLT_MAX;
+        for( int j = 0; j < ctx->diagram.numsites; ++j )
+        {
+            jcv_real dx = sites[j].p.x - x[i];
+            jcv_real dy = sites[j].p.y - y[i];
+            best = jcv_min(best, dx*dx + dy*dy - weights[sites[j].index]);
+        }
+        jcv_point p = { x[i], y[i] };
+        const jcv_site* site = jcv_diagram_find_site(&ctx->diagram, p, 0);
+        ASSERT_TRUE(site != 0);
+        jcv_real dx = site->p.x - x[i];
+        jcv_real dy = site->p.y - y[i];
+        ASSERT_NEAR(best, dx*dx + dy*dy - weights[site->index], (jcv_real)0.001);
+
+        const jcv_site* located = &sites[found[i]];
+        dx = located->p.x - x[i];
+        dy = located->p.y - y[i];
+        ASSERT_NEAR(best, dx*dx + dy*dy - weights[located->index], (jcv_real)0.001);
+    }
+}
+
+// A box clipper for the rect in clipper->ctx, regardless of the rect the diagram is generated with
+static jcv_clipper inner_box_clipper(const jcv_clipper* clipper)
+{
+    const jcv_rect* inner = (const jcv_rect*)clipper->ctx;
+    jcv_clipper box = *clipper;
+    box.min = inner->min;
+    box.max = inner->max;
+    return box;
+}
+
+static int inner_box_test(const jcv_clipper* clipper, jcv_point p)
+{
+    jcv_clipper box = inner_box_clipper(clipper);
+    return jcv_boxshape_test(&box, p);
+}
+
+static int inner_box_clip(const jcv_clipper* clipper, jcv_edge* e)
+{
+    jcv_clipper box = inner_box_clipper(clipper);
+    return jcv_boxshape_clip(&box, e);
+}
+
+static void inner_box_fillgaps(const jcv_clipper* clipper, jcv_context_internal* internal, jcv_site* site)
+{
+    jcv_clipper box = inner_box_clipper(clipper);
+    jcv_boxshape_fillgaps(&box, internal, site);
+}
+
+TEST_F(VoronoiTest, Power_diagram_uses_custom_clipper)
+{
+    const int num_points = 200;
+    jcv_point points[num_points];
+    jcv_real weights[num_points];
+    random_points(points, num_points, 3);
+    for( int i = 0; i < num_points; ++i )
+        weights[i] = (jcv_real)(rand() % 100) * (jcv_real)0.5;
+    jcv_rect rect = { {0, 0}, {100, 100} };
+    jcv_rect inner = { {25, 25}, {75, 75} };
+    jcv_clipper clipper = {};
+    clipper.test_fn = inner_box_test;
+    clipper.clip_fn = inner_box_clip;
+    clipper.fill_fn = inner_box_fillgaps;
+    clipper.ctx = &inner;
+    jcv_diagram_generate_weighted(num_points, points, weights, &rect, &clipper, &ctx->diagram);
+
+    // Clipping to the inner box gives the diagram of the inner rect, without vertices outside of it
+    jcv_diagram expected;
+    memset(&expected, 0, sizeof(expected));
+    jcv_diagram_generate_weighted(num_points, points, weights, &inner, 0, &expected);
+    ASSERT_EQ(expected.numsites, ctx->diagram.numsites);
+    ASSERT_EQ(jcv_diagram_get_edge_count(&expected), jcv_diagram_get_edge_count(&ctx->diagram));
+    ASSERT_EQ(jcv_get_num_vertices(&expected), jcv_get_num_vertices(&ctx->diagram));
+
+    const jcv_site* expected_sites = jcv_diagram_get_sites(&expected);
+    const jcv_site* sites = jcv_diagram_get_sites(&ctx->diagram);
+    for( int i = 0; i < ctx->diagram.numsites; ++i )
+    {
+        ASSERT_EQ(expected_sites[i].index, sites[i].index);
+        ASSERT_NEAR(test_cell_area(&expected, &expected_sites[i]), test_cell_area(&ctx->diagram, &sites[i]), 0.01);
+    }
+    ASSERT_EQ(0, validate_vertex_indices(&ctx->diagram));
+    jcv_diagram_free(&expected);
+}
+
+TEST_F(VoronoiTest, Site_locator_scans_points_outside_custom_clipper)
+{
+    const int num_points = 200;
+    jcv_point points[num_points];
+    random_points(points, num_points, 12);
+    jcv_rect rect = { {0, 0}, {100, 100} };
+    jcv_rect inner = { {25, 25}, {75, 75} };
+    jcv_clipper clipper = {};
+    clipper.test_fn = inner_box_test;
+    clipper.clip_fn = inner_box_clip;
+    clipper.fill_fn = inner_box_fillgaps;
+    clipper.ctx = &inner;
+    jcv_diagram_generate(num_points, points, &rect, &clipper, &ctx->diagram);
+
+    jcv_site_locator* locator = jcv_site_locator_create(&ctx->diagram);
+    ASSERT_TRUE(locator != 0);
+
+    // Most of the queries are inside the rect, but outside of the clipped cells
+    const int num_queries = 1024;
+    jcv_real x[num_queries];
+    jcv_real y[num_queries];
+    for( int i = 0; i < num_queries; ++i )
+    {
+        x[i] = (jcv_real)(rand() % 1001) * (jcv_real)0.1;
+        y[i] = (jcv_real)(rand() % 1001) * (jcv_real)0.1;
+    }
+    int indices[num_queries];
+    jcv_site_locator_find(locator, num_queries, x, y, indices);
+
+    const jcv_site* sites = jcv_diagram_get_sites(&ctx->diagram);
+    for( int i = 0; i < num_queries; ++i )
+    {
+        jcv_point p = { x[i], y[i] };
+        const jcv_site* nearest = test_find_nearest_site(&ctx->diagram, p);
+        ASSERT_TRUE(indices[i] >= 0 && indices[i] < ctx->diagram.numsites);
+        ASSERT_EQ(jcv_point_dist_sq(&nearest->p, &p), jcv_point_dist_sq(&sites[indices[i]].p, &p));
+    }
+    jcv_site_locator_free(locator);
+}
+
+TEST_F(VoronoiTest, Periodic_cells_match_tiled_diagram)
+{
+    const int num_points = 300;
+    jcv_point points[num_points * 9];
+    random_points(points, num_points, 6);
+    jcv_rect rect = { {0, 0}, {100, 100} };
+    jcv_diagram_generate_periodic(num_points, points, &rect, &ctx->diagram);
+    ASSERT_EQ(num_points, ctx->diagram.numsites);
+    const int* input_to_site = jcv_diagram_get_input_to_site(&ctx->diagram);
+    for( int i = 0; i < num_points; ++i )
+        ASSERT_EQ((uint32_t)i, jcv_diagram_get_sites(&ctx->diagram)[input_to_site[i]].index);
+
+    // The reference: the center tile of a 3x3 tiling
+    for( int i = 0, tile = 0; tile < 9; ++tile )
+    {
+        if( tile == 4 )
+            continue;
+        for( int j = 0; j < num_points; ++j, ++i )
+        {
+            points[num_points + i].x = points[j].x + (jcv_real)(tile % 3 - 1) * 100;
+            points[num_points + i].y = points[j].y + (jcv_real)(tile / 3 - 1) * 100;
+        }
+    }
+    jcv_rect tiled_rect = { {-100, -100}, {200, 200} };
+    jcv_diagram tiled;
+    memset(&tiled, 0, sizeof(tiled));
+    jcv_diagram_generate(num_points * 9, points, &tiled_rect, 0, &tiled);
+    const jcv_site* tiled_sites = jcv_diagram_get_sites(&tiled);
+    double expected_areas[num_points];
+    for( int i = 0; i < tiled.numsites; ++i )
+    {
+        if( tiled_sites[i].index < (uint32_t)num_points )
+            expected_areas[tiled_sites[i].index] = test_cell_area(&tiled, &tiled_sites[i]);
+    }
+
+    const jcv_site* sites = jcv_diagram_get_sites(&ctx->diagram);
+    int num_vertices = jcv_get_num_vertices(&ctx->diagram);
+    jcv_point* vertices = (jcv_point*)malloc(sizeof(jcv_point) * (size_t)num_vertices);
+    jcv_diagram_get_vertices(&ctx->diagram, vertices);
+    double total = 0.0;
+    for( int i = 0; i < ctx->diagram.numsites; ++i )
+    {
+        ASSERT_TRUE(is_closed_loop(&ctx->diagram, &sites[i]));
+        double area = test_cell_area(&ctx->diagram, &sites[i]);
+        ASSERT_NEAR(expected_areas[sites[i].index], area, 0.01);
+        total += area;
+
+        // A vertex outside the rect is shared with its copy inside it
+        test_graphedge_iter iter;
+        test_site_get_edges(&ctx->diagram, &sites[i], &iter);
+        for( const jcv_edge* edge = test_graphedge_next(&iter); edge; edge = test_graphedge_next(&iter) )
+        {
+            ASSERT_TRUE(edge->sites[1] != 0);
+            ASSERT_LT(edge->sites[1]->index, (uint32_t)num_points);
+            const jcv_point* p = test_graphedge_get_position(&ctx->diagram, edge, 0);
+            int vertex = test_graphedge_get_vertex(&ctx->diagram, edge, 0);
+            ASSERT_TRUE(vertex >= 0 && vertex < num_vertices);
+            ASSERT_NEAR(0.0, remainder((double)p->x - (double)vertices[vertex].x, 100.0), 0.001);
+            ASSERT_NEAR(0.0, remainder((double)p->y - (double)vertices[vertex].y, 100.0), 0.001);
+        }
+    }
+    ASSERT_NEAR(100.0 * 100.0, total, 0.1);
+    // Euler's formula on a torus
+    ASSERT_EQ(0, num_vertices - jcv_diagram_get_edge_count(&ctx->diagram) + ctx->diagram.numsites);
+
+    // Queries wrap around
+    jcv_point p = { 250, -50 };
+    jcv_point wrapped = { 50, 50 };
+    ASSERT_EQ(jcv_diagram_find_site(&ctx->diagram, wrapped, 0), jcv_diagram_find_site(&ctx->diagram, p, 0));
+    free(vertices);
+    jcv_diagram_free(&tiled);
+}
+
+TEST_F(VoronoiTest, Periodic_without_rect_is_a_regular_diagram)
+{
+    const int num_points = 100;
+    jcv_point points[num_points];
+    random_points(points, num_points, 15);
+    jcv_diagram regular;
+    memset(&regular, 0, sizeof(regular));
+    jcv_diagram_generate(num_points, points, 0, 0, &regular);
+    jcv_diagram_generate_periodic(num_points, points, 0, &ctx->diagram);
+    ASSERT_EQ(regular.numsites, ctx->diagram.numsites);
+    ASSERT_EQ(regular.numvertices, ctx->diagram.numvertices);
+    ASSERT_EQ(regular.min.x, ctx->diagram.min.x);
+    ASSERT_EQ(regular.max.y, ctx->diagram.max.y);
+    jcv_diagram_free(&regular);
+}
+
+// Exact, as a contracted (fma) evaluation could put a site on a side slightly outside it
+static double test_cross(const jcv_point* a, const jcv_point* b, const jcv_point* c)
+{
+    return jcv_orient(a, b, c);
+}
+
+TEST_F(VoronoiTest, Hull_is_convex_and_counter_clockwise)
+{
+    const int num_points = 500;
+    jcv_point points[num_points];
+    random_points(points, num_points, 7);
+    jcv_diagram_generate(num_points, points, 0, 0, &ctx->diagram);
+    const jcv_site* sites = jcv_diagram_get_sites(&ctx->diagram);
+    int count = 0;
+    const int* hull = jcv_diagram_get_hull(&ctx->diagram, &count);
+    ASSERT_GE(count, 3);
+
+    // Every site is on or to the left of each hull side
+    double area = 0.0;
+    for( int i = 0; i < count; ++i )
+    {
+        const jcv_point* a = &sites[hull[i]].p;
+        const jcv_point* b = &sites[hull[(i + 1) % count]].p;
+        area += (double)a->x * (double)b->y - (double)b->x * (double)a->y;
+        for( int j = 0; j < ctx->diagram.numsites; ++j )
+            ASSERT_GE(test_cross(a, b, &sites[j].p), 0.0);
+    }
+    ASSERT_GT(area, 0.0);
+
+    // And no other site is left out
+    for( int j = 0; j < ctx->diagram.numsites; ++j )
+    {
+        int on_hull = 0;
+        for( int i = 0; i < count; ++i )
+            on_hull |= hull[i] == j;
+        int on_side = 0;
+        for( int i = 0; i < count && !on_side; ++i )
+            on_side = test_cross(&sites[hull[i]].p, &sites[hull[(i + 1) % count]].p, &sites[j].p) == 0.0;
+        ASSERT_EQ(on_hull, on_side);
+    }
+}
+
+TEST_F(VoronoiTest, Hull_of_square_and_line)
+{
+    jcv_point points[] = { {0, 0}, {1, 1}, {2, 0}, {2, 2}, {0, 2}, {2, 1} };
+    jcv_diagram_generate(6, points, 0, 0, &ctx->diagram);
+    const jcv_site* sites = jcv_diagram_get_sites(&ctx->diagram);
+    int count = 0;
+    const int* hull = jcv_diagram_get_hull(&ctx->diagram, &count);
+    ASSERT_EQ(5, count);
+    const uint32_t expected[] = { 0, 2, 5, 3, 4 };
+    for( int i = 0; i < count; ++i )
+        ASSERT_EQ(expected[i], sites[hull[i]].index);
+    jcv_diagram_free(&ctx->diagram);
+
+    jcv_point line[] = { {1, 1}, {3, 3}, {0, 0}, {2, 2} };
+    memset(&ctx->diagram, 0, sizeof(ctx->diagram));
+    jcv_diagram_generate(4, line, 0, 0, &ctx->diagram);
+    sites = jcv_diagram_get_sites(&ctx->diagram);
+    hull = jcv_diagram_get_hull(&ctx->diagram, &count);
+    ASSERT_EQ(4, count);
+    const uint32_t expected_line[] = { 2, 0, 3, 1 };
+    for( int i = 0; i < count; ++i )
+        ASSERT_EQ(expected_line[i], sites[hull[i]].index);
+}
+
+TEST_F(VoronoiTest, Hull_of_delaunay_and_power_diagrams)
+{
+    const int num_points = 200;
+    jcv_point points[num_points];
+    jcv_real weights[num_points];
+    random_points(points, num_points, 16);
+    for( int i = 0; i < num_points; ++i )
+        weights[i] = (jcv_real)(rand() % 100) * (jcv_real)0.1;
+    jcv_rect rect = { {0, 0}, {100, 100} };
+    jcv_diagram_generate(num_points, points, &rect, 0, &ctx->diagram);
+    int expected_count = 0;
+    const int* expected = jcv_diagram_get_hull(&ctx->diagram, &expected_count);
+    ASSERT_GE(expected_count, 3);
+
+    jcv_diagram delaunay;
+    memset(&delaunay, 0, sizeof(delaunay));
+    jcv_delaunay_generate(num_points, points, &rect, 0, &delaunay);
+    jcv_diagram power;
+    memset(&power, 0, sizeof(power));
+    jcv_diagram_generate_weighted(num_points, points, weights, &rect, 0, &power);
+    const jcv_diagram* diagrams[] = { &delaunay, &power };
+    for( int d = 0; d < 2; ++d )
+    {
+        int count = 0;
+        const int* hull = jcv_diagram_get_hull(diagrams[d], &count);
+        ASSERT_EQ(expected_count, count);
+        for( int i = 0; i < count; ++i )
+            ASSERT_EQ(jcv_diagram_get_sites(&ctx->diagram)[expected[i]].index, jcv_diagram_get_sites(diagrams[d])[hull[i]].index);
+    }
+    jcv_diagram_free(&delaunay);
+    jcv_diagram_free(&power);
+}
+
+TEST_F(VoronoiTest, Emst_matches_brute_force)
+{
+    const int num_points = 400;
+    jcv_point points[num_points];
+    random_points(points, num_points, 8);
+    jcv_diagram_generate(num_points, points, 0, 0, &ctx->diagram);
+    const jcv_site* sites = jcv_diagram_get_sites(&ctx->diagram);
+    int numsites = ctx->diagram.numsites;
+
+    // Prim's algorithm over all pairs
+    double expected = 0.0;
+    double best[num_points];
+    int intree[num_points] = {0};
+    for( int i = 0; i < numsites; ++i )
+        best[i] = 1e30;
+    best[0] = 0.0;
+    for( int step = 0; step < numsites; ++step )
+    {
+        int next = -1;
+        for( int i = 0; i < numsites; ++i )
+        {
+            if( !intree[i] && (next < 0 || best[i] < best[next]) )
+                next = i;
+        }
+        intree[next] = 1;
+        expected += sqrt(best[next]);
+        for( int i = 0; i < numsites; ++i )
+        {
+            double dist = (double)jcv_point_dist_sq(&sites[next].p, &sites[i].p);
+            best[i] = (intree[i] || dist > best[i]) ? best[i] : dist;
+        }
+    }
+
+    int edges[num_points * 2];
+    ASSERT_EQ(numsites - 1, jcv_diagram_get_emst(&ctx->diagram, edges));
+    double total = 0.0;
+    for( int i = 0; i < numsites - 1; ++i )
+        total += sqrt((double)jcv_point_dist_sq(&sites[edges[i*2+0]].p, &sites[edges[i*2+1]].p));
+    ASSERT_NEAR(expected, total, 0.001);
+}
+
+static int test_compare_real(const void* a, const void* b)
+{
+    jcv_real x = *(const jcv_real*)a;
+    jcv_real y = *(const jcv_real*)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+TEST_F(VoronoiTest, Knn_matches_brute_force)
+{
+    const int num_points = 300;
+    const int k = 6;
+    jcv_point points[num_points];
+    random_points(points, num_points, 9);
+    jcv_delaunay_generate(num_points, points, 0, 0, &ctx->diagram);
+    const jcv_site* sites = jcv_diagram_get_sites(&ctx->diagram);
+    int numsites = ctx->diagram.numsites;
+    int neighbors[num_points * k];
+    jcv_diagram_get_knn(&ctx->diagram, k, neighbors);
+
+    for( int i = 0; i < numsites; ++i )
+    {
+        jcv_real dists[num_points];
+        int count = 0;
+        for( int j = 0; j < numsites; ++j )
+        {
+            if( j != i )
+                dists[count++] = jcv_point_dist_sq(&sites[i].p, &sites[j].p);
+        }
+        qsort(dists, (size_t)count, sizeof(jcv_real), test_compare_real);
+        for( int n = 0; n < k; ++n )
+        {
+            ASSERT_GE(neighbors[i*k+n], 0);
+            ASSERT_EQ(dists[n], jcv_point_dist_sq(&sites[i].p, &sites[neighbors[i*k+n]].p));
+        }
+    }
+
+    // Fewer sites than neighbours asked for
+    jcv_point three[] = { {0, 0}, {1, 0}, {0, 2} };
+    jcv_diagram_free(&ctx->diagram);
+    memset(&ctx->diagram, 0, sizeof(ctx->diagram));
+    jcv_diagram_generate(3, three, 0, 0, &ctx->diagram);
+    jcv_diagram_get_knn(&ctx->diagram, k, neighbors);
+    ASSERT_GE(neighbors[1], 0);
+    ASSERT_EQ(-1, neighbors[2]);
+}
+
+TEST_F(VoronoiTest, Neighbors_match_site_edges)
+{
+    const int num_points = 200;
+    jcv_point points[num_points];
+    random_points(points, num_points, 10);
+    jcv_rect rect = { {10, 10}, {90, 90} };
+    jcv_diagram_generate(num_points, points, &rect, 0, &ctx->diagram);
+    const jcv_site* sites = jcv_diagram_get_sites(&ctx->diagram);
+    int numsites = ctx->diagram.numsites;
+
+    int count = jcv_diagram_get_neighbor_count(&ctx->diagram);
+    int* offsets = (int*)malloc(sizeof(int) * (size_t)(numsites + 1));
+    int* neighbors = (int*)malloc(sizeof(int) * (size_t)count);
+    jcv_diagram_get_neighbors(&ctx->diagram, offsets, neighbors);
+    ASSERT_EQ(0, offsets[0]);
+    ASSERT_EQ(count, offsets[numsites]);
+
+    int numgaps = 0;
+    for( int i = 0; i < numsites; ++i )
+    {
+        jcv_edge_iter iter;
+        jcv_edge edge;
+        jcv_site_get_edges(&ctx->diagram, &sites[i], &iter);
+        int n = offsets[i];
+        while( jcv_edge_next(&iter, &edge) )
+        {
+            ASSERT_LT(n, offsets[i+1]);
+            int expected = edge.sites[1] ? (int)(edge.sites[1] - sites) : -1;
+            ASSERT_EQ(expected, neighbors[n]);
+            numgaps += expected < 0;
+            ++n;
+        }
+        ASSERT_EQ(offsets[i+1], n);
+    }
+    ASSERT_GT(numgaps, 0);
+    free(neighbors);
+    free(offsets);
+}
+
+static void test_batch_matches_next(const jcv_diagram* diagram, const jcv_site* site)
+{
+    jcv_edge_iter iter, batch_iter, positions_iter;
+    if( site )
+    {
+        jcv_site_get_edges(diagram, site, &iter);
+        jcv_site_get_edges(diagram, site, &batch_iter);
+        jcv_site_get_edges(diagram, site, &positions_iter);
+    }
+    else
+    {
+        jcv_diagram_get_edges(diagram, &iter);
+        jcv_diagram_get_edges(diagram, &batch_iter);
+        jcv_diagram_get_edges(diagram, &positions_iter);
+    }
+
+    const int max = 7;
+    jcv_edge edge;
+    jcv_edge batch[max];
+    jcv_real x0[max], y0[max], x1[max], y1[max];
+    int numbatch = 0;
+    int numpositions = 0;
+    int next = 0;
+    while( jcv_edge_next(&iter, &edge) )
+    {
+        if( next == numbatch )
+        {
+            numbatch = jcv_edge_next_batch(&batch_iter, batch, max);
+            numpositions = jcv_edge_next_positions(&positions_iter, x0, y0, x1, y1, max);
+            ASSERT_EQ(numbatch, numpositions);
+            ASSERT_GT(numbatch, 0);
+            next = 0;
+        }
+        ASSERT_EQ(edge.sites[0], batch[next].sites[0]);
+        ASSERT_EQ(edge.sites[1], batch[next].sites[1]);
+        ASSERT_EQ(edge.vertices[0], batch[next].vertices[0]);
+        ASSERT_EQ(edge.vertices[1], batch[next].vertices[1]);
+        ASSERT_EQ(0, memcmp(edge.pos, batch[next].pos, sizeof(edge.pos)));
+        ASSERT_EQ(edge.c, batch[next].c);
+        ASSERT_EQ(edge.pos[0].x, x0[next]);
+        ASSERT_EQ(edge.pos[0].y, y0[next]);
+        ASSERT_EQ(edge.pos[1].x, x1[next]);
+        ASSERT_EQ(edge.pos[1].y, y1[next]);
+        ++next;
+    }
+    ASSERT_EQ(numbatch, next);
+    ASSERT_EQ(0, jcv_edge_next_batch(&batch_iter, batch, max));
+    ASSERT_EQ(0, jcv_edge_next_positions(&positions_iter, x0, y0, x1, y1, max));
+}
+
+TEST_F(VoronoiTest, Edge_batches_match_edge_next)
+{
+    const int num_points = 200;
+    jcv_point points[num_points];
+    random_points(points, num_points, 11);
+    jcv_rect rect = { {10, 10}, {90, 90} };
+    jcv_diagram_generate(num_points, points, &rect, 0, &ctx->diagram);
+    test_batch_matches_next(&ctx->diagram, 0);
+    const jcv_site* sites = jcv_diagram_get_sites(&ctx->diagram);
+    for( int i = 0; i < ctx->diagram.numsites; ++i )
+        test_batch_matches_next(&ctx->diagram, &sites[i]);
+}
+
+TEST_F(VoronoiTest, Vertex_positions_match_edges)
+{
+    const int num_points = 200;
+    jcv_point points[num_points];
+    jcv_real weights[num_points];
+    random_points(points, num_points, 12);
+    for( int i = 0; i < num_points; ++i )
+        weights[i] = (jcv_real)(rand() % 100) * (jcv_real)0.1;
+    jcv_rect rect = { {10, 10}, {90, 90} };
+    for( int pass = 0; pass < 2; ++pass )
+    {
+        if( pass == 0 )
+            jcv_diagram_generate(num_points, points, &rect, 0, &ctx->diagram);
+        else
+            jcv_diagram_generate_weighted(num_points, points, weights, &rect, 0, &ctx->diagram);
+
+        const jcv_point* positions = jcv_diagram_get_vertex_positions(&ctx->diagram);
+        jcv_point* vertices = (jcv_point*)malloc(sizeof(jcv_point) * (size_t)ctx->diagram.numvertices);
+        jcv_diagram_get_vertices(&ctx->diagram, vertices);
+        ASSERT_EQ(0, memcmp(positions, vertices, sizeof(jcv_point) * (size_t)ctx->diagram.numvertices));
+        free(vertices);
+
+        jcv_edge_iter iter;
+        jcv_edge edge;
+        jcv_diagram_get_edges(&ctx->diagram, &iter);
+        while( jcv_edge_next(&iter, &edge) )
+        {
+            ASSERT_POINT_EQ(positions[edge.vertices[0]], edge.pos[0]);
+            ASSERT_POINT_EQ(positions[edge.vertices[1]], edge.pos[1]);
+        }
+    }
+}
+
+TEST_F(VoronoiTest, Lazy_cells_match_full_diagram)
+{
+    const int num_points = 300;
+    jcv_point points[num_points];
+    random_points(points, num_points, 13);
+    jcv_rect rect = { {10, 10}, {90, 90} };
+    jcv_diagram_generate(num_points, points, &rect, 0, &ctx->diagram);
+    jcv_diagram lazy;
+    memset(&lazy, 0, sizeof(lazy));
+    jcv_diagram_generate_lazy(num_points, points, &rect, 0, &lazy);
+    ASSERT_EQ(ctx->diagram.numsites, lazy.numsites);
+
+    const jcv_site* sites = jcv_diagram_get_sites(&ctx->diagram);
+    const jcv_site* lazy_sites = jcv_diagram_get_sites(&lazy);
+    jcv_point p = { 50, 50 };
+    ASSERT_EQ(jcv_diagram_find_site(&ctx->diagram, p, 0)->index, jcv_diagram_find_site(&lazy, p, 0)->index);
+
+    // Visit the cells out of order, and some of them twice
+    for( int n = 0; n < lazy.numsites * 2; ++n )
+    {
+        int i = (n * 7919) % lazy.numsites;
+        jcv_edge_iter iter, lazy_iter;
+        jcv_edge edge, lazy_edge;
+        jcv_site_get_edges(&ctx->diagram, &sites[i], &iter);
+        jcv_site_get_edges(&lazy, &lazy_sites[i], &lazy_iter);
+        while( jcv_edge_next(&iter, &edge) )
+        {
+            ASSERT_TRUE(jcv_edge_next(&lazy_iter, &lazy_edge));
+            ASSERT_POINT_EQ(edge.pos[0], lazy_edge.pos[0]);
+            ASSERT_POINT_EQ(edge.pos[1], lazy_edge.pos[1]);
+            ASSERT_EQ(edge.sites[1] ? (int)edge.sites[1]->index : -1, lazy_edge.sites[1] ? (int)lazy_edge.sites[1]->index : -1);
+        }
+        ASSERT_FALSE(jcv_edge_next(&lazy_iter, &lazy_edge));
+    }
+    ASSERT_EQ(jcv_get_num_vertices(&ctx->diagram), jcv_get_num_vertices(&lazy));
+    ASSERT_EQ(jcv_diagram_get_edge_count(&ctx->diagram), jcv_diagram_get_edge_count(&lazy));
+    jcv_diagram_free(&lazy);
+}
+
+TEST_F(VoronoiTest, Input_to_site_is_the_reverse_of_site_index)
+{
+    const int num_points = 100;
+    jcv_point points[num_points];
+    random_points(points, num_points, 11);
+    // A duplicate, and points outside of the rect
+    points[7] = points[3];
+    points[20].x = 5;
+    points[21].y = 95;
+
+    jcv_rect rect = { {10, 10}, {90, 90} };
+    jcv_diagram_generate(num_points, points, &rect, 0, &ctx->diagram);
+    const jcv_site* sites = jcv_diagram_get_sites(&ctx->diagram);
+    const int* input_to_site = jcv_diagram_get_input_to_site(&ctx->diagram);
+
+    int nummapped = 0;
+    for( int i = 0; i < num_points; ++i )
+    {
+        int site = input_to_site[i];
+        if( site < 0 )
+            continue;
+        ASSERT_LT(site, ctx->diagram.numsites);
+        ASSERT_EQ((uint32_t)i, sites[site].index);
+        ++nummapped;
+    }
+    ASSERT_EQ(ctx->diagram.numsites, nummapped);
+    ASSERT_EQ(-1, input_to_site[20]);
+    ASSERT_EQ(-1, input_to_site[21]);
+    ASSERT_TRUE(input_to_site[3] < 0 || input_to_site[7] < 0);
+    for( int i = 0; i < ctx->diagram.numsites; ++i )
+        ASSERT_EQ(i, input_to_site[sites[i].index]);
+}
+
+TEST_F(VoronoiTest, Input_sources_report_merged_and_rejected_points)
+{
+    const int num_points = 100;
+    jcv_point points[num_points];
+    srand(12);
+    for( int i = 0; i < num_points; ++i )
+    {
+        points[i].x = (jcv_real)(rand() % 8000) * (jcv_real)0.01 + 10;
+        points[i].y = (jcv_real)(rand() % 8000) * (jcv_real)0.01 + 10;
+    }
+    points[7] = points[3];
+    points[8] = points[3];
+    points[20].x = 5;
+    points[30] = points[20];
+
+    jcv_rect rect = { {10, 10}, {90, 90} };
+    jcv_diagram_generate(num_points, points, &rect, 0, &ctx->diagram);
+    const jcv_site* sites = jcv_diagram_get_sites(&ctx->diagram);
+    const int* input_to_site = jcv_diagram_get_input_to_site(&ctx->diagram);
+    const int* sources = jcv_diagram_get_input_sources(&ctx->diagram);
+
+    ASSERT_EQ(-1, sources[20]);
+    ASSERT_EQ(-1, sources[30]);
+    int kept = sources[3];
+    ASSERT_TRUE(kept == 3 || kept == 7 || kept == 8);
+    ASSERT_EQ(kept, sources[7]);
+    ASSERT_EQ(kept, sources[8]);
+    for( int i = 0; i < num_points; ++i )
+    {
+        if( sources[i] < 0 )
+        {
+            ASSERT_EQ(-1, input_to_site[i]);
+            continue;
+        }
+        // Kept points are their own source, and merged points share the kept point's site
+        int site = input_to_site[sources[i]];
+        ASSERT_GE(site, 0);
+        ASSERT_EQ((uint32_t)sources[i], sites[site].index);
+        ASSERT_EQ(sources[i] == i, input_to_site[i] >= 0);
+        ASSERT_TRUE(jcv_point_eq(&points[i], &sites[site].p));
+    }
+}
+
+TEST_F(VoronoiTest, Strided_and_soa_input_match_packed_input)
+{
+    struct Entity
+    {
+        int         id;
+        jcv_point   position;
+        jcv_real    mass;
+    };
+    const int num_points = 200;
+    jcv_point points[num_points];
+    Entity entities[num_points];
+    jcv_real xs[num_points];
+    jcv_real ys[num_points];
+    random_points(points, num_points, 13);
+    for( int i = 0; i < num_points; ++i )
+    {
+        entities[i].id = i;
+        entities[i].position = points[i];
+        entities[i].mass = 1;
+        xs[i] = points[i].x;
+        ys[i] = points[i].y;
+    }
+    jcv_rect rect = { {10, 10}, {90, 90} };
+    jcv_diagram_generate(num_points, points, &rect, 0, &ctx->diagram);
+
+    jcv_diagram strided;
+    memset(&strided, 0, sizeof(strided));
+    jcv_diagram_generate_strided(num_points, &entities[0].position, sizeof(Entity), &rect, 0, &strided);
+    jcv_diagram soa;
+    memset(&soa, 0, sizeof(soa));
+    jcv_diagram_generate_soa(num_points, xs, ys, &rect, 0, &soa);
+
+    const jcv_diagram* diagrams[2] = { &strided, &soa };
+    const jcv_site* expected = jcv_diagram_get_sites(&ctx->diagram);
+    for( int d = 0; d < 2; ++d )
+    {
+        ASSERT_EQ(ctx->diagram.numsites, diagrams[d]->numsites);
+        ASSERT_EQ(ctx->diagram.numvertices, diagrams[d]->numvertices);
+        ASSERT_EQ(jcv_diagram_get_edge_count(&ctx->diagram), jcv_diagram_get_edge_count(diagrams[d]));
+        const jcv_site* sites = jcv_diagram_get_sites(diagrams[d]);
+        for( int i = 0; i < ctx->diagram.numsites; ++i )
+        {
+            ASSERT_EQ(expected[i].index, sites[i].index);
+            ASSERT_TRUE(jcv_point_eq(&expected[i].p, &sites[i].p));
+        }
+    }
+    jcv_diagram_free(&strided);
+    jcv_diagram_free(&soa);
+}
+
+TEST_F(VoronoiTest, Non_finite_points_are_pruned)
+{
+    const int num_points = 50;
+    jcv_point points[num_points];
+    random_points(points, num_points, 14);
+    jcv_real inf = (jcv_real)HUGE_VAL;
+    points[5].x = inf - inf;
+    points[6].y = -inf;
+    points[7].x = inf;
+    points[7].y = inf;
+
+    // The automatic bounds only cover the finite points
+    jcv_diagram_generate(num_points, points, 0, 0, &ctx->diagram);
+    ASSERT_EQ(num_points - 3, ctx->diagram.numsites);
+    ASSERT_GE(ctx->diagram.min.x, (jcv_real)-10);
+    ASSERT_LE(ctx->diagram.max.x, (jcv_real)110);
+    ASSERT_LE(ctx->diagram.max.y, (jcv_real)110);
+    const int* sources = jcv_diagram_get_input_sources(&ctx->diagram);
+    const int* input_to_site = jcv_diagram_get_input_to_site(&ctx->diagram);
+    for( int i = 5; i <= 7; ++i )
+    {
+        ASSERT_EQ(-1, sources[i]);
+        ASSERT_EQ(-1, input_to_site[i]);
+    }
+    jcv_edge_iter iter;
+    jcv_edge edge;
+    jcv_diagram_get_edges(&ctx->diagram, &iter);
+    while( jcv_edge_next(&iter, &edge) )
+    {
+        ASSERT_TRUE(edge.pos[0].x - edge.pos[0].x == 0);
+        ASSERT_TRUE(edge.pos[1].y - edge.pos[1].y == 0);
+    }
+}
+
+TEST_F(VoronoiTest, Simd_bounds_match_scalar_bounds)
+{
+    const int max_points = 37;
+    jcv_point points[max_points];
+    jcv_point_input input = jcv_point_input_strided(points, sizeof(jcv_point));
+    // Every count, so the extremes fall in each lane and in the scalar tail
+    for( int num_points = 1; num_points <= max_points; ++num_points )
+    {
+        random_points(points, num_points, (unsigned int)num_points);
+        jcv_rect expected = { { JCV_FLT_MAX, JCV_FLT_MAX }, { -JCV_FLT_MAX, -JCV_FLT_MAX } };
+        for( int i = 0; i < num_points; ++i )
+        {
+            expected.min.x = jcv_min(expected.min.x, points[i].x);
+            expected.min.y = jcv_min(expected.min.y, points[i].y);
+            expected.max.x = jcv_max(expected.max.x, points[i].x);
+            expected.max.y = jcv_max(expected.max.y, points[i].y);
+        }
+        jcv_rect bounds;
+#if defined(JCV_HAS_SIMD)
+        ASSERT_TRUE(jcv_point_input_simd_bounds(&input, num_points, &bounds));
+        ASSERT_EQ(expected.min.x, bounds.min.x);
+        ASSERT_EQ(expected.min.y, bounds.min.y);
+        ASSERT_EQ(expected.max.x, bounds.max.x);
+        ASSERT_EQ(expected.max.y, bounds.max.y);
+#endif
+        // A NaN or infinite coordinate anywhere leaves the input to the scalar loop
+        jcv_real inf = (jcv_real)HUGE_VAL;
+        for( int i = 0; i < num_points * 2; ++i )
+        {
+            jcv_real* value = (i & 1) ? &points[i / 2].y : &points[i / 2].x;
+            jcv_real saved = *value;
+            *value = (i % 3 == 0) ? inf - inf : ((i % 3 == 1) ? inf : -inf);
+            ASSERT_FALSE(jcv_point_input_simd_bounds(&input, num_points, &bounds));
+            *value = saved;
+        }
+    }
+    jcv_point_input strided = jcv_point_input_strided(points, sizeof(jcv_point) * 2);
+    jcv_rect bounds;
+    ASSERT_FALSE(jcv_point_input_simd_bounds(&strided, max_points / 2, &bounds));
+}
+
+TEST_F(VoronoiTest, Parallel_site_sort_matches_serial_sort)
+{
+    const int num_points = JCV_PARALLEL_MIN_SITES + 1000;
+    jcv_site* sites = (jcv_site*)malloc(sizeof(jcv_site) * (size_t)num_points);
+    jcv_site* expected = (jcv_site*)malloc(sizeof(jcv_site) * (size_t)num_points);
+    srand(15);
+    for( int i = 0; i < num_points; ++i )
+    {
+        // Few distinct rows, and many duplicates
+        sites[i].p.x = (jcv_real)(rand() % 1000);
+        sites[i].p.y = (jcv_real)(rand() % 50);
+        sites[i].index = (uint32_t)i;
+        sites[i].boundary = 0;
+    }
+    memcpy(expected, sites, sizeof(jcv_site) * (size_t)num_points);
+    jcv_sites_sort(expected, num_points);
+
+    jcv_context_internal internal;
+    memset(&internal, 0, sizeof(internal));
+    internal.alloc = jcv_alloc_fn;
+    internal.free = jcv_free_fn;
+    g_parallel_task_count = 0;
+    jcv_sites_sort_parallel(&internal, sites, num_points);
+    ASSERT_GT(g_parallel_task_count, 0);
+    for( int i = 0; i < num_points; ++i )
+    {
+        ASSERT_EQ(expected[i].p.x, sites[i].p.x);
+        ASSERT_EQ(expected[i].p.y, sites[i].p.y);
+    }
+
+    // The diagram sees the same unique sites
+    jcv_point* points = (jcv_point*)malloc(sizeof(jcv_point) * (size_t)num_points);
+    for( int i = 0; i < num_points; ++i )
+        points[i] = sites[i].p;
+    for( int i = 0; i < num_points; ++i )
+    {
+        int j = rand() % num_points;
+        jcv_point tmp = points[i];
+        points[i] = points[j];
+        points[j] = tmp;
+    }
+    int numunique = 1;
+    for( int i = 1; i < num_points; ++i )
+        numunique += !jcv_point_eq(&expected[i].p, &expected[i-1].p);
+    g_parallel_task_count = 0;
+    jcv_diagram_generate(num_points, points, 0, 0, &ctx->diagram);
+    ASSERT_GT(g_parallel_task_count, 0);
+    ASSERT_EQ(numunique, ctx->diagram.numsites);
+    const jcv_site* diagramsites = jcv_diagram_get_sites(&ctx->diagram);
+    for( int i = 1; i < ctx->diagram.numsites; ++i )
+        ASSERT_TRUE(jcv_site_less(&diagramsites[i-1], &diagramsites[i]));
+
+    free(points);
+    free(expected);
+    free(sites);
+}
+
+TEST_F(VoronoiTest, Quantized_sites_give_complete_cells)
+{
+    // Integer coordinates give long runs of sites with the same y
+    const int num_points = 600;
+    jcv_point points[num_points];
+    srand(16);
+    for( int i = 0; i < num_points; ++i )
+    {
+        points[i].x = (jcv_real)(rand() % 40) + 1;
+        points[i].y = (jcv_real)(rand() % 40) + 1;
+    }
+    jcv_rect rect = { {0, 0}, {41, 41} };
+    jcv_diagram_generate(num_points, points, &rect, 0, &ctx->diagram);
+    const jcv_site* sites = jcv_diagram_get_sites(&ctx->diagram);
+
+    double total = 0;
+    for( int i = 0; i < ctx->diagram.numsites; ++i )
+    {
+        double area = test_cell_area(&ctx->diagram, &sites[i]);
+        ASSERT_GT(area, 0.0);
+        total += area;
+        // The cell of a site contains the site
+        ASSERT_EQ(&sites[i], jcv_diagram_find_site(&ctx->diagram, sites[i].p, 0));
+    }
+    ASSERT_NEAR(41.0 * 41.0, total, 0.01);
+}
+
+TEST_F(VoronoiTest, Predicates_are_exact_for_nearly_collinear_sites)
+{
+    // Consecutive Fibonacci numbers give F(n)^2 - F(n-1) * F(n+1) = +-1, while the products
+    // are far beyond the precision of a double
+    const int n = 77;
+    double fib[80] = { 0, 1 };
+    for( int i = 2; i <= n + 1; ++i )
+        fib[i] = fib[i-1] + fib[i-2];
+
+    // The float coordinates can't hold these, so the expansions are also checked on their own
+    double square[2], product[2], h[4];
+    int squarelen = jcv_exact_mul(1, &fib[n], 1, &fib[n], square);
+    int productlen = jcv_exact_mul(1, &fib[n-1], 1, &fib[n+1], product);
+    ASSERT_NE((n & 1) ? 1.0 : -1.0, fib[n] * fib[n] - fib[n-1] * fib[n+1]);
+    for( int i = 0; i < productlen; ++i )
+        product[i] = -product[i];
+    ASSERT_EQ((n & 1) ? 1.0 : -1.0, jcv_exact_estimate(jcv_exact_sum(squarelen, square, productlen, product, h), h));
+
+#if defined(TEST_USE_DOUBLE)
+    const int m = n;
+#else
+    const int m = 35;
+#endif
+    jcv_point a = { 0, 0 };
+    jcv_point b = { (jcv_real)fib[m], (jcv_real)fib[m-1] };
+    jcv_point c = { (jcv_real)fib[m+1], (jcv_real)fib[m] };
+    double sign = (m & 1) ? 1 : -1;
+    ASSERT_EQ(sign, jcv_orient(&a, &b, &c) > 0 ? 1 : -1);
+    ASSERT_EQ(-sign, jcv_orient(&a, &c, &b) > 0 ? 1 : -1);
+
+    jcv_point d = { b.x + b.x, b.y + b.y };
+    ASSERT_EQ(0, jcv_orient(&a, &b, &d));
+
+    // The site with the smaller circle through it, touching the sweepline at p, owns p
+    jcv_point left = { -1, 0 };
+    jcv_point right = { 1, 0 };
+    jcv_point p = { 0, 2 };
+    ASSERT_EQ(0, jcv_compare_tangent_circles(&p, &left, &right));
+    p.x = (jcv_real)0.5;
+    ASSERT_GT(jcv_compare_tangent_circles(&p, &left, &right), 0);
+    // On the sweepline, the closer site owns p
+    p.x = (jcv_real)-0.25;
+    p.y = 0;
+    ASSERT_LT(jcv_compare_tangent_circles(&p, &left, &right), 0);
+}
+
+TEST_F(VoronoiTest, Integer_sites_on_a_circle_share_one_exact_vertex)
+{
+    // All sites are on the circle around (1/3, 1/3) with 9 r^2 = 3 * 10681 + 2,
+    // so each circle event has the same centre, which isn't representable
+    const int32_t points[] = { -59, -6, -55, -22, -54, 25, -52, 29, -47, -36, -36, -47, -22, -55, -15, 58,
+                               -6, -59, 1, 60, 25, -54, 29, -52, 41, 44, 44, 41, 58, -15, 60, 1 };
+    const int num_points = (int)(sizeof(points) / sizeof(points[0]) / 2);
+    jcv_diagram_generate_int(num_points, points, 0, 0, &ctx->diagram);
+    ASSERT_EQ(num_points, ctx->diagram.numsites);
+
+    const jcv_real third = (jcv_real)(1.0 / 3.0);
+    int num_vertices = jcv_get_num_vertices(&ctx->diagram);
+    jcv_point* vertices = (jcv_point*)malloc(sizeof(jcv_point) * (size_t)num_vertices);
+    jcv_diagram_get_vertices(&ctx->diagram, vertices);
+    int num_center = 0;
+    for( int i = 0; i < num_vertices; ++i )
+    {
+        if( jcv_abs(vertices[i].x - third) < 1 && jcv_abs(vertices[i].y - third) < 1 )
+        {
+            ASSERT_EQ(third, vertices[i].x);
+            ASSERT_EQ(third, vertices[i].y);
+            ++num_center;
+        }
+    }
+    free(vertices);
+    ASSERT_EQ(1, num_center);
+
+    // Every cell is a wedge from the centre to the border
+    const jcv_site* sites = jcv_diagram_get_sites(&ctx->diagram);
+    for( int i = 0; i < ctx->diagram.numsites; ++i )
+    {
+        int num_center_edges = 0;
+        jcv_edge_iter iter;
+        jcv_edge edge;
+        jcv_site_get_edges(&ctx->diagram, &sites[i], &iter);
+        while( jcv_edge_next(&iter, &edge) )
+            num_center_edges += (edge.pos[0].x == third && edge.pos[0].y == third) + (edge.pos[1].x == third && edge.pos[1].y == third);
+        ASSERT_EQ(2, num_center_edges);
+    }
+}
+
+TEST_F(VoronoiTest, Normalized_diagram_keeps_the_precision_of_large_coordinates)
+{
+    // Far from the origin, the sites' spacing is close to the precision of a float
+    const jcv_real offset = (jcv_real)(1 << 20);
+    const int num_points = 500;
+    jcv_point points[num_points];
+    jcv_point offset_points[num_points];
+    srand(49);
+    for( int i = 0; i < num_points; ++i )
+    {
+        points[i].x = (jcv_real)(rand() % 8000) * (jcv_real)0.125;
+        points[i].y = (jcv_real)(rand() % 8000) * (jcv_real)0.125;
+        offset_points[i].x = points[i].x + offset;
+        offset_points[i].y = points[i].y + offset;
+    }
+    jcv_rect rect = { {0, 0}, {1000, 1000} };
+    jcv_rect offset_rect = { {offset, offset}, {offset + 1000, offset + 1000} };
+
+    jcv_diagram reference;
+    memset(&reference, 0, sizeof(reference));
+    jcv_diagram_generate(num_points, points, &rect, 0, &reference);
+    jcv_diagram_generate_normalized(num_points, offset_points, &offset_rect, &ctx->diagram);
+    ASSERT_EQ(reference.numsites, ctx->diagram.numsites);
+    ASSERT_EQ(offset_rect.min.x, ctx->diagram.min.x);
+    ASSERT_EQ(offset_rect.max.y, ctx->diagram.max.y);
+
+    // The same cells, with the corners within the precision of the offset coordinates
+    const jcv_site* reference_sites = jcv_diagram_get_sites(&reference);
+    const jcv_site* sites = jcv_diagram_get_sites(&ctx->diagram);
+    for( int i = 0; i < reference.numsites; ++i )
+    {
+        ASSERT_EQ(offset_points[reference_sites[i].index].x, sites[i].p.x);
+        ASSERT_EQ(offset_points[reference_sites[i].index].y, sites[i].p.y);
+
+        jcv_edge_iter reference_iter, iter;
+        jcv_edge reference_edge, edge;
+        jcv_site_get_edges(&reference, &reference_sites[i], &reference_iter);
+        jcv_site_get_edges(&ctx->diagram, &sites[i], &iter);
+        while( jcv_edge_next(&reference_iter, &reference_edge) )
+        {
+            ASSERT_TRUE(jcv_edge_next(&iter, &edge));
+            ASSERT_NEAR(reference_edge.pos[0].x + offset, edge.pos[0].x, 0.25);
+            ASSERT_NEAR(reference_edge.pos[0].y + offset, edge.pos[0].y, 0.25);
+        }
+        ASSERT_FALSE(jcv_edge_next(&iter, &edge));
+    }
+    ASSERT_EQ(&sites[7], jcv_diagram_find_site(&ctx->diagram, sites[7].p, 0));
+    jcv_diagram_free(&reference);
+}
+
+TEST_F(VoronoiTest, Welding_merges_the_vertices_of_nearly_cocircular_sites)
+{
+    // The rounded positions are only nearly on the circle, which gives many vertices close to its centre
+    const int num_points = 64;
+    jcv_point points[num_points];
+    for( int i = 0; i < num_points; ++i )
+    {
+        double angle = 2.0 * 3.14159265358979323846 * i / num_points;
+        points[i].x = (jcv_real)(100.3 + 100.0 * cos(angle));
+        points[i].y = (jcv_real)(100.7 + 100.0 * sin(angle));
+    }
+    jcv_rect rect = { {-10, -10}, {210, 210} };
+    jcv_diagram_generate(num_points, points, &rect, 0, &ctx->diagram);
+    int num_vertices = jcv_get_num_vertices(&ctx->diagram);
+    ASSERT_GT(num_vertices, 2 * num_points / 2 + 1);
+
+    int welded = jcv_diagram_weld_vertices(&ctx->diagram, (jcv_real)0.01);
+    ASSERT_EQ(welded, jcv_get_num_vertices(&ctx->diagram));
+    ASSERT_LT(welded, num_vertices);
+
+    // One vertex at the centre, and the cells are closed chains of vertex ids
+    const jcv_point* vertices = jcv_diagram_get_vertex_positions(&ctx->diagram);
+    int num_center = 0;
+    for( int i = 0; i < welded; ++i )
+        num_center += jcv_abs(vertices[i].x - (jcv_real)100.3) < 1 && jcv_abs(vertices[i].y - (jcv_real)100.7) < 1;
+    ASSERT_EQ(1, num_center);
+
+    const jcv_site* sites = jcv_diagram_get_sites(&ctx->diagram);
+    for( int i = 0; i < ctx->diagram.numsites; ++i )
+    {
+        jcv_edge_iter iter;
+        jcv_edge edges[16];
+        jcv_site_get_edges(&ctx->diagram, &sites[i], &iter);
+        int count = jcv_edge_next_batch(&iter, edges, 16);
+        ASSERT_GE(count, 3);
+        for( int j = 0; j < count; ++j )
+        {
+            const jcv_edge* next = &edges[(j + 1) % count];
+            ASSERT_NE(edges[j].vertices[0], edges[j].vertices[1]);
+            ASSERT_EQ(edges[j].vertices[1], next->vertices[0]);
+            ASSERT_EQ(vertices[edges[j].vertices[1]].x, next->pos[0].x);
+            ASSERT_EQ(vertices[edges[j].vertices[1]].y, next->pos[0].y);
+        }
+    }
+
+    int num_edges = 0;
+    jcv_edge_iter iter;
+    jcv_edge edge;
+    jcv_diagram_get_edges(&ctx->diagram, &iter);
+    while( jcv_edge_next(&iter, &edge) )
+        ++num_edges;
+    ASSERT_EQ(jcv_diagram_get_edge_count(&ctx->diagram), num_edges);
+}
@@ -36,6 +36,30 @@ const negativeDelaunayEdges = voronoi.delaunayEdges([
 ], { bounds: [-100, -100, 100, 0] });
 assert.ok(negativeDelaunayEdges.length > 0);
 
+const square = [
+  { x: 10, y: 10 },
+  { x: 90, y: 10 },
+  { x: 90, y: 90 },
+  { x: 10, y: 90 },
+  { x: 40, y: 55 },
+];
+const triangulation = voronoi.triangulate(square, { bounds: [0, 0, 100, 100] });
+assert.ok(triangulation.triangles instanceof Uint32Array);
+assert.ok(triangulation.halfedges instanceof Int32Array);
+assert.ok(triangulation.hull instanceof Uint32Array);
+assert.equal(triangulation.triangles.length, 4 * 3);
+assert.equal(triangulation.halfedges.length, triangulation.triangles.length);
+assert.deepEqual([...triangulation.hull].sort(), [0, 1, 2, 3]);
+const nextHalfedge = (e) => (e % 3 === 2 ? e - 2 : e + 1);
+for (let e = 0; e < triangulation.halfedges.length; ++e) {
+  const opposite = triangulation.halfedges[e];
+  if (opposite === -1) continue;
+  assert.equal(triangulation.halfedges[opposite], e);
+  assert.equal(triangulation.triangles[opposite], triangulation.triangles[nextHalfedge(e)]);
+}
+assert.equal(triangulation.halfedges.filter((e) => e === -1).length, triangulation.hull.length);
+assert.deepEqual(voronoi.triangulate([], 100, 100).triangles, new Uint32Array());
+
 const diagram = voronoi.generate(points, { bounds: [0, 0, 100, 100] });
 const workerPoints = new Float32Array(points.flatMap(({ x, y }) => [x, y]));
 const workerDiagram = await workerVoronoi.generate(workerPoints, { bounds: [0, 0, 100, 100] });
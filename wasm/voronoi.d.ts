@@ -60,6 +60,16 @@ export interface GenerateOptions {
   height?: number;
 }
 
+/** Delaunator-compatible triangulation arrays. */
+export interface Triangulation {
+  /** Input point indices, three per triangle, in delaunator's winding. */
+  readonly triangles: Uint32Array;
+  /** Opposite halfedge of each triangle edge, or -1 on the hull. */
+  readonly halfedges: Int32Array;
+  /** Input point indices on the convex hull, in delaunator's winding. */
+  readonly hull: Uint32Array;
+}
+
 export interface VoronoiModuleOptions {
   locateFile?: (path: string, scriptDirectory: string) => string;
   wasmBinary?: Uint8Array;
@@ -73,6 +83,10 @@ export interface Voronoi {
   generate(points: PointInput, options: GenerateOptions): Diagram;
   generate(points: PointInput, width: number, height: number): Diagram;
 
+  /** Returns delaunator-style triangles, halfedges and hull arrays. */
+  triangulate(points: PointInput, options: GenerateOptions): Triangulation;
+  triangulate(points: PointInput, width: number, height: number): Triangulation;
+
   /** Returns flat x0, y0, x1, y1 coordinates for every Voronoi edge. */
   edges(points: PointInput, width: number, height: number): Float32Array;
 
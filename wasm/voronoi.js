@@ -476,8 +476,42 @@ export async function loadVoronoi(moduleOptions = {}) {
     });
   }
 
+  function triangulate(points, boundsOrWidth, height) {
+    const bounds = parseBounds(boundsOrWidth, height);
+    return withPoints(points, (flat, pointsPointer) => {
+      let countsPointer = 0;
+      let outputPointer = 0;
+      try {
+        countsPointer = module._malloc(2 * Int32Array.BYTES_PER_ELEMENT);
+        outputPointer = module._jcv_delaunay_triangles(
+          pointsPointer, flat.length / 2, ...bounds, countsPointer,
+        );
+        const countsIndex = countsPointer / Int32Array.BYTES_PER_ELEMENT;
+        const triangleLength = module.HEAP32[countsIndex];
+        const hullLength = module.HEAP32[countsIndex + 1];
+        if (triangleLength === -2) throw new Error("Delaunay output allocation failed");
+        if (triangleLength < 0) throw new Error("invalid Delaunay input");
+        if (!outputPointer) {
+          return { triangles: new Uint32Array(), halfedges: new Int32Array(), hull: new Uint32Array() };
+        }
+
+        const start = outputPointer / Int32Array.BYTES_PER_ELEMENT;
+        const hullStart = start + triangleLength * 2;
+        return {
+          triangles: new Uint32Array(module.HEAP32.slice(start, start + triangleLength).buffer),
+          halfedges: module.HEAP32.slice(start + triangleLength, hullStart),
+          hull: new Uint32Array(module.HEAP32.slice(hullStart, hullStart + hullLength).buffer),
+        };
+      } finally {
+        if (outputPointer) module._free(outputPointer);
+        if (countsPointer) module._free(countsPointer);
+      }
+    });
+  }
+
   return {
     generate,
+    triangulate,
     edges: (points, width, height) => generateEdges(
       points, [width, height], module._jcv_voronoi_edges,
     ),
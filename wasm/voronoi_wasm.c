@@ -1,4 +1,5 @@
 #include <limits.h>
+#include <math.h>
 #include <stddef.h>
 #include <stdlib.h>
 
@@ -184,8 +185,8 @@ void* jcv_wasm_generate_packed(const float* xy,
     header[12] = (uint32_t)cell_offsets_offset;
     header[13] = (uint32_t)cell_refs_offset;
 
-    for (i = 0; i < num_points; ++i)
-        input_to_site[i] = -1;
+    if (num_points > 0)
+        memcpy(input_to_site, jcv_diagram_get_input_to_site(&diagram), (size_t)num_points * sizeof(int32_t));
     for (i = 0; i < site_count; ++i)
     {
         int offset = i * JCV_PACK_SITE_WORDS;
@@ -193,8 +194,6 @@ void* jcv_wasm_generate_packed(const float* xy,
         site_floats[offset + 1] = sites[i].p.y;
         site_words[offset + 2] = sites[i].index;
         site_words[offset + 3] = sites[i].boundary;
-        if (sites[i].index < (uint32_t)num_points)
-            input_to_site[sites[i].index] = i;
     }
 
     i = 0;
@@ -383,3 +382,341 @@ float* jcv_delaunay_edges(const float* xy,
     *output_count = edge_count;
     return edges;
 }
+
+typedef struct jcv_tri_slot_
+{
+    double key;
+    int site;
+} jcv_tri_slot;
+
+/* Pseudo-angle of a neighbour direction, increasing counter-clockwise in [0, 4) */
+static double jcv_tri_angle(const jcv_site* center, const jcv_site* neighbor)
+{
+    double dx = (double)neighbor->p.x - (double)center->p.x;
+    double dy = (double)neighbor->p.y - (double)center->p.y;
+    double p = dx / (fabs(dx) + fabs(dy));
+    return dy < 0.0 ? 3.0 + p : 1.0 - p;
+}
+
+static int jcv_tri_slot_cmp(const void* a, const void* b)
+{
+    double ka = ((const jcv_tri_slot*)a)->key;
+    double kb = ((const jcv_tri_slot*)b)->key;
+    return ka < kb ? -1 : (ka > kb ? 1 : 0);
+}
+
+static void jcv_tri_sort_slots(jcv_tri_slot* slots, int count)
+{
+    int i;
+    if (count > 16)
+    {
+        qsort(slots, (size_t)count, sizeof(jcv_tri_slot), jcv_tri_slot_cmp);
+        return;
+    }
+    for (i = 1; i < count; ++i)
+    {
+        jcv_tri_slot slot = slots[i];
+        int j = i;
+        while (j > 0 && slots[j - 1].key > slot.key)
+        {
+            slots[j] = slots[j - 1];
+            --j;
+        }
+        slots[j] = slot;
+    }
+}
+
+/* Delaunator-compatible triangulation of the Delaunay adjacency. The returned
+ * block holds triangles[output_counts[0]], halfedges[output_counts[0]] and
+ * hull[output_counts[1]] as 32-bit integers referencing input points.
+ * Triangles and the hull use delaunator's winding, and a halfedge without an
+ * opposite triangle is -1.
+ *
+ * Each directed adjacency is a slot in a CSR table sorted counter-clockwise
+ * around its site. Stepping to the counter-clockwise successor around the
+ * target site walks the faces of the planar graph: every inner face is a
+ * Delaunay triangle (fanned if cocircular sites left a larger face), and the
+ * face with the largest positive area is the outside of the hull. */
+EMSCRIPTEN_KEEPALIVE
+int32_t* jcv_delaunay_triangles(const float* xy,
+                                int num_points,
+                                float min_x,
+                                float min_y,
+                                float max_x,
+                                float max_y,
+                                int* output_counts)
+{
+    jcv_diagram diagram = {0};
+    const jcv_site* sites;
+    jcv_rect rect;
+    jcv_delaunay_iter iter;
+    jcv_delaunay_edge edge;
+    int* offsets = NULL;
+    jcv_tri_slot* slots = NULL;
+    int* twins = NULL;
+    int* slot_faces = NULL;
+    int* slot_halfedges = NULL;
+    int* face_starts = NULL;
+    int* face_lengths = NULL;
+    int32_t* output = NULL;
+    int32_t* triangles;
+    int32_t* halfedges;
+    int32_t* hull;
+    size_t capacity;
+    int site_count;
+    int slot_count;
+    int face_count = 0;
+    int outer_face = -1;
+    double outer_area = 0.0;
+    int triangle_count = 0;
+    int hull_count;
+    int i;
+
+    if (output_counts == NULL)
+        return NULL;
+    output_counts[0] = -1;
+    output_counts[1] = 0;
+    if (num_points < 0 || max_x <= min_x || max_y <= min_y ||
+        (num_points > 0 && xy == NULL))
+        return NULL;
+    if (num_points == 0)
+    {
+        output_counts[0] = 0;
+        return NULL;
+    }
+
+    rect.min.x = min_x;
+    rect.min.y = min_y;
+    rect.max.x = max_x;
+    rect.max.y = max_y;
+    jcv_delaunay_generate(num_points, (const jcv_point*)xy, &rect, NULL, &diagram);
+    sites = jcv_diagram_get_sites(&diagram);
+    site_count = diagram.numsites;
+    slot_count = jcv_delaunay_get_edge_count(&diagram) * 2;
+    capacity = (size_t)(slot_count > 0 ? slot_count : 1);
+
+    offsets = (int*)calloc((size_t)site_count + 1, sizeof(int));
+    slots = (jcv_tri_slot*)malloc(sizeof(jcv_tri_slot) * capacity);
+    twins = (int*)malloc(sizeof(int) * capacity);
+    slot_faces = (int*)malloc(sizeof(int) * (capacity > (size_t)site_count ? capacity : (size_t)site_count));
+    slot_halfedges = (int*)malloc(sizeof(int) * capacity);
+    face_starts = (int*)malloc(sizeof(int) * capacity);
+    face_lengths = (int*)malloc(sizeof(int) * capacity);
+    if (offsets == NULL || slots == NULL || twins == NULL || slot_faces == NULL ||
+        slot_halfedges == NULL || face_starts == NULL || face_lengths == NULL)
+        goto failure;
+
+    /* CSR adjacency, with each site's neighbours sorted counter-clockwise */
+    jcv_delaunay_begin(&diagram, &iter);
+    while (jcv_delaunay_next(&iter, &edge))
+    {
+        offsets[edge.sites[0] - sites + 1]++;
+        offsets[edge.sites[1] - sites + 1]++;
+    }
+    for (i = 0; i < site_count; ++i)
+    {
+        offsets[i + 1] += offsets[i];
+        slot_faces[i] = offsets[i]; /* fill cursor until the faces are labeled */
+    }
+    jcv_delaunay_begin(&diagram, &iter);
+    while (jcv_delaunay_next(&iter, &edge))
+    {
+        int a = (int)(edge.sites[0] - sites);
+        int b = (int)(edge.sites[1] - sites);
+        slots[slot_faces[a]].site = b;
+        slots[slot_faces[a]++].key = jcv_tri_angle(edge.sites[0], edge.sites[1]);
+        slots[slot_faces[b]].site = a;
+        slots[slot_faces[b]++].key = jcv_tri_angle(edge.sites[1], edge.sites[0]);
+    }
+    for (i = 0; i < site_count; ++i)
+        jcv_tri_sort_slots(slots + offsets[i], offsets[i + 1] - offsets[i]);
+    for (i = 0; i < site_count; ++i)
+    {
+        int s;
+        for (s = offsets[i]; s < offsets[i + 1]; ++s)
+        {
+            int b = slots[s].site;
+            int t = offsets[b];
+            while (t < offsets[b + 1] && slots[t].site != i)
+                ++t;
+            twins[s] = t < offsets[b + 1] ? t : -1;
+        }
+    }
+    for (i = 0; i < slot_count; ++i)
+        slot_faces[i] = -1;
+
+    /* Label the faces. The slot twins[s] is owned by the target of s, so its
+     * successor continues the face on the same side. */
+    for (i = 0; i < slot_count; ++i)
+    {
+        double area = 0.0;
+        int length = 0;
+        int s = i;
+        if (slot_faces[i] >= 0)
+            continue;
+        do
+        {
+            int t = twins[s];
+            int b = slots[s].site;
+            const jcv_point* p1 = &sites[b].p;
+            const jcv_point* p0 = t >= 0 ? &sites[slots[t].site].p : p1;
+            slot_faces[s] = face_count;
+            area += (double)p0->x * (double)p1->y - (double)p1->x * (double)p0->y;
+            ++length;
+            if (t < 0)
+                break;
+            s = t + 1 < offsets[b + 1] ? t + 1 : offsets[b];
+        } while (s != i);
+
+        face_starts[face_count] = i;
+        face_lengths[face_count] = length;
+        if (outer_face < 0 || area > outer_area)
+        {
+            outer_face = face_count;
+            outer_area = area;
+        }
+        ++face_count;
+    }
+    for (i = 0; i < face_count; ++i)
+    {
+        if (i != outer_face && face_lengths[i] >= 3)
+            triangle_count += face_lengths[i] - 2;
+    }
+    hull_count = triangle_count > 0 ? face_lengths[outer_face] : site_count;
+
+    output = (int32_t*)malloc(sizeof(int32_t) * ((size_t)triangle_count * 6 + (size_t)hull_count + 1));
+    if (output == NULL)
+        goto failure;
+    triangles = output;
+    halfedges = output + triangle_count * 3;
+    hull = halfedges + triangle_count * 3;
+    for (i = 0; i < triangle_count * 3; ++i)
+        halfedges[i] = -1;
+
+    /* Fan each inner face from its first site. Slot k of a face with n slots
+     * becomes the edge v[k] -> v[k+1] of triangle (v[0], v[k], v[k+1]). */
+    {
+        int triangle = 0;
+        for (i = 0; i < face_count; ++i)
+        {
+            int length = face_lengths[i];
+            int first = triangle;
+            int32_t v0;
+            int s = face_starts[i];
+            int k;
+            if (i == outer_face || length < 3)
+                continue;
+            v0 = (int32_t)sites[slots[twins[s]].site].index;
+            for (k = 0; k < length; ++k)
+            {
+                int b = slots[s].site;
+                if (k == 0)
+                {
+                    slot_halfedges[s] = first * 3;
+                }
+                else if (k == length - 1)
+                {
+                    slot_halfedges[s] = (first + length - 3) * 3 + 2;
+                }
+                else
+                {
+                    int e = triangle * 3;
+                    triangles[e + 0] = v0;
+                    triangles[e + 1] = (int32_t)sites[slots[twins[s]].site].index;
+                    triangles[e + 2] = (int32_t)sites[b].index;
+                    slot_halfedges[s] = e + 1;
+                    if (k > 1)
+                    {
+                        halfedges[e] = e - 1;
+                        halfedges[e - 1] = e;
+                    }
+                    ++triangle;
+                }
+                s = twins[s] + 1 < offsets[b + 1] ? twins[s] + 1 : offsets[b];
+            }
+        }
+    }
+    for (i = 0; i < slot_count; ++i)
+    {
+        int face = slot_faces[i];
+        int t = twins[i];
+        int twin_face;
+        if (face == outer_face || face_lengths[face] < 3 || t < 0)
+            continue;
+        twin_face = slot_faces[t];
+        if (twin_face != outer_face && face_lengths[twin_face] >= 3)
+            halfedges[slot_halfedges[i]] = slot_halfedges[t];
+    }
+
+    if (triangle_count > 0)
+    {
+        /* The outer face runs opposite to the hull halfedges, so store it reversed */
+        int s = face_starts[outer_face];
+        for (i = hull_count - 1; i >= 0; --i)
+        {
+            int b = slots[s].site;
+            hull[i] = (int32_t)sites[slots[twins[s]].site].index;
+            s = twins[s] + 1 < offsets[b + 1] ? twins[s] + 1 : offsets[b];
+        }
+    }
+    else if (site_count > 0)
+    {
+        /* Collinear input: list the path of sites from one end to the other */
+        int previous = -1;
+        int current = 0;
+        for (i = 0; i < site_count; ++i)
+        {
+            if (offsets[i + 1] - offsets[i] <= 1)
+            {
+                current = i;
+                break;
+            }
+        }
+        for (i = 0; i < hull_count; ++i)
+        {
+            int next = -1;
+            int s;
+            hull[i] = (int32_t)sites[current].index;
+            for (s = offsets[current]; s < offsets[current + 1]; ++s)
+            {
+                if (slots[s].site != previous)
+                {
+                    next = slots[s].site;
+                    break;
+                }
+            }
+            if (next < 0)
+            {
+                hull_count = i + 1;
+                break;
+            }
+            previous = current;
+            current = next;
+        }
+    }
+
+    free(face_lengths);
+    free(face_starts);
+    free(slot_halfedges);
+    free(slot_faces);
+    free(twins);
+    free(slots);
+    free(offsets);
+    jcv_diagram_free(&diagram);
+    output_counts[0] = triangle_count * 3;
+    output_counts[1] = hull_count;
+    return output;
+
+failure:
+    free(face_lengths);
+    free(face_starts);
+    free(slot_halfedges);
+    free(slot_faces);
+    free(twins);
+    free(slots);
+    free(offsets);
+    if (diagram.internal != NULL)
+        jcv_diagram_free(&diagram);
+    output_counts[0] = -2;
+    return NULL;
+}